@@ -0,0 +1,354 @@
+/*
+This software contains the C++ implementation of the "branch-and-mincut" framework for image segmentation
+with various high-level priors as described in the paper:
+
+V. Lempitsky, A. Blake, C. Rother. Image Segmentation by Branch-and-Mincut.
+In proceedings of European Conference on Computer Vision (ECCV), October 2008.
+
+The software contains the core algorithm and an example of its application (globally-optimal
+segmentations under Chan-Vese functional).
+
+Implemented by Victor Lempitsky, 2008
+*/
+
+#include "BatchSegmentation.h"
+#include "ChanVeseSegmentation.h"
+#include "SegmentationOutput.h"
+#include "imageio.h"
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+//////////////////////////////////////////////
+
+static double wallTime()
+{
+#ifdef _OPENMP
+	return omp_get_wtime();
+#else
+	return double(clock())/CLOCKS_PER_SEC;
+#endif
+}
+
+static int threadNum()
+{
+#ifdef _OPENMP
+	return omp_get_thread_num();
+#else
+	return 0;
+#endif
+}
+
+static int threadCount()
+{
+#ifdef _OPENMP
+	return omp_get_num_threads();
+#else
+	return 1;
+#endif
+}
+
+//////////////////////////////////////////////
+
+//list of the images
+
+static bool isImageName(const char *name)
+{
+	const char *ext = strrchr(name, '.');
+	if(!ext) return false;
+	char lower[5] = {0};
+	for(int k = 0; k < 4 && ext[k+1]; k++)
+		lower[k] = (char)tolower(ext[k+1]);
+	return !strcmp(lower, "png") || !strcmp(lower, "pgm") || !strcmp(lower, "ppm");
+}
+
+//the image files of the directory sorted by name, false if it is not a directory
+static bool listDirectory(const char *dir, std::vector<std::string>& paths)
+{
+	std::string prefix(dir);
+	if(!prefix.empty() && prefix[prefix.size()-1] != '/' && prefix[prefix.size()-1] != '\\')
+		prefix += '/';
+#ifdef _WIN32
+	WIN32_FIND_DATAA data;
+	HANDLE find = FindFirstFileA((prefix+"*").c_str(), &data);
+	if(find == INVALID_HANDLE_VALUE) return false;
+	do
+	{
+		if(!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && isImageName(data.cFileName))
+			paths.push_back(prefix+data.cFileName);
+	} while(FindNextFileA(find, &data));
+	FindClose(find);
+#else
+	DIR *d = opendir(dir);
+	if(!d) return false;
+	struct dirent *entry;
+	while((entry = readdir(d)) != NULL)
+		if(entry->d_name[0] != '.' && isImageName(entry->d_name))
+			paths.push_back(prefix+entry->d_name);
+	closedir(d);
+#endif
+	std::sort(paths.begin(), paths.end());
+	return true;
+}
+
+//one path per line, empty lines and lines starting with # are skipped
+static bool readManifest(const char *filename, std::vector<std::string>& paths)
+{
+	FILE *file = fopen(filename, "r");
+	if(!file) return false;
+	char line[4096];
+	while(fgets(line, sizeof(line), file))
+	{
+		size_t len = strlen(line);
+		while(len > 0 && (line[len-1] == '\n' || line[len-1] == '\r' || line[len-1] == ' ' || line[len-1] == '\t'))
+			line[--len] = 0;
+		if(len > 0 && line[0] != '#')
+			paths.push_back(line);
+	}
+	fclose(file);
+	return true;
+}
+
+//<outDir>/<file name without the extension>
+static std::string outputBase(const char *outDir, const std::string& path)
+{
+	size_t slash = path.find_last_of("/\\");
+	std::string name = slash == std::string::npos ? path : path.substr(slash+1);
+	size_t dot = name.rfind('.');
+	if(dot != std::string::npos && dot > 0)
+		name.erase(dot);
+	std::string base(outDir);
+	if(!base.empty() && base[base.size()-1] != '/' && base[base.size()-1] != '\\')
+		base += '/';
+	return base+name;
+}
+
+//////////////////////////////////////////////
+
+//decoded image of a job
+struct BatchImage
+{
+	int job; //index in the list, -1 if there are no jobs left
+	const unsigned char *pixels; //NULL if the file could not be read
+	int width, height;
+	MappedImage mapped; //8-bit PGM files are mapped,
+	unsigned char *buffer; //the other formats are decoded here
+	double decodeTime; //seconds
+};
+
+struct BatchResult
+{
+	bool ok;
+	gtype energy;
+	int cb, cf;
+	double latency; //seconds spent on decoding, segmenting and writing the image (without the wait for the worker)
+	bool fullSearch; //for sequences: the frame was segmented from scratch
+};
+
+static int takeJob(int& nextJob, int count)
+{
+	int job;
+#pragma omp critical(batchJobs)
+	job = nextJob < count ? nextJob++ : -1;
+	return job;
+}
+
+static void loadImage(const std::string& path, BatchImage& im)
+{
+	double start = wallTime();
+	im.buffer = NULL;
+	if(MapImage(path.c_str(), im.mapped))
+	{
+		im.pixels = im.mapped.pixels;
+		im.width = im.mapped.width;
+		im.height = im.mapped.height;
+		//reading the pages in now, not when the worker gets to them
+		volatile unsigned char sum = 0;
+		for(size_t i = 0; i < (size_t)im.width*im.height; i += 4096)
+			sum += im.pixels[i];
+	}
+	else
+	{
+		memset(&im.mapped, 0, sizeof(im.mapped));
+		im.buffer = LoadImageAligned<unsigned char>(path.c_str(), im.width, im.height);
+		im.pixels = im.buffer;
+	}
+	im.decodeTime = wallTime()-start;
+}
+
+static void releaseImage(BatchImage& im)
+{
+	UnmapImage(im.mapped);
+	if(im.buffer)
+		FreeAligned(im.buffer);
+	im.buffer = NULL;
+	im.pixels = NULL;
+}
+
+//sequence is NULL for independent images, otherwise the frame is added to it
+static void segmentImage(const BatchImage& im, const std::string& path, const char *outDir, int lambda, int mu,
+						 bool overlays, ChanVeseSequence *sequence, BatchResult& result)
+{
+	double start = wallTime();
+	result.ok = false;
+	result.fullSearch = true;
+	if(im.pixels)
+	{
+		PackedMask segm;
+		ChanVeseBranch *leaf = sequence ? sequence->AddFrame(im.pixels, im.width, im.height, &segm) :
+			SegmentChanVese(im.pixels, im.width, im.height, lambda, mu, &segm);
+		std::string base = outputBase(outDir, path);
+		std::string maskFile = base+"_mask.png", overlayFile = base+"_overlay.png";
+		result.ok = WriteSegmentation(segm, path.c_str(), maskFile.c_str(), overlays ? overlayFile.c_str() : NULL);
+		result.energy = leaf->bound;
+		result.cb = leaf->minb;
+		result.cf = leaf->minf;
+		if(sequence)
+			result.fullSearch = sequence->FullSearch();
+		else
+			delete leaf;
+	}
+	result.latency = im.decodeTime+wallTime()-start;
+
+#pragma omp critical(batchOutput)
+	{
+		if(!result.ok)
+			printf("%s\tfailed\n", path.c_str());
+		else if(sequence)
+			printf("%s\t%d\t%d\t%d\t%.3lf\t%s\n", path.c_str(), result.energy, result.cb, result.cf, result.latency,
+				result.fullSearch ? "full" : "warm");
+		else
+			printf("%s\t%d\t%d\t%d\t%.3lf\n", path.c_str(), result.energy, result.cb, result.cf, result.latency);
+		fflush(stdout);
+	}
+}
+
+//takes the images from the list until there are none left. The next image is decoded by a second thread while this one
+//segments the current image (with a single thread both are done here, one after the other)
+static void runWorker(const std::vector<std::string>& paths, int& nextJob, const char *outDir, int lambda, int mu,
+					  bool overlays, ChanVeseSequence *sequence, std::vector<BatchResult>& results)
+{
+	int count = (int)paths.size();
+	BatchImage current, next;
+	current.job = takeJob(nextJob, count);
+	if(current.job >= 0)
+		loadImage(paths[current.job], current);
+	while(current.job >= 0)
+	{
+		next.job = takeJob(nextJob, count);
+#pragma omp parallel num_threads(2)
+		{
+			if(threadNum() == 0)
+				segmentImage(current, paths[current.job], outDir, lambda, mu, overlays, sequence, results[current.job]);
+			if(threadNum() == threadCount()-1 && next.job >= 0)
+				loadImage(paths[next.job], next);
+		}
+		releaseImage(current);
+		current = next;
+	}
+}
+
+static bool readList(const char *input, std::vector<std::string>& paths)
+{
+	if(listDirectory(input, paths) || readManifest(input, paths))
+		return true;
+	printf("Cannot read the image list %s!\n", input);
+	return false;
+}
+
+//prints the summary line and returns the number of failed images
+static int printSummary(const char *input, const std::vector<BatchResult>& results, int workers, double time, bool sequence)
+{
+	std::vector<double> latencies;
+	int k, count = (int)results.size(), fullSearches = 0;
+	for(k = 0; k < count; k++)
+		if(results[k].ok)
+		{
+			latencies.push_back(results[k].latency);
+			fullSearches += results[k].fullSearch;
+		}
+	int failed = count-(int)latencies.size();
+	double mean = 0, median = 0, p95 = 0, maximum = 0;
+	if(!latencies.empty())
+	{
+		std::sort(latencies.begin(), latencies.end());
+		for(size_t k = 0; k < latencies.size(); k++)
+			mean += latencies[k];
+		mean /= latencies.size();
+		median = latencies[latencies.size()/2];
+		p95 = latencies[(latencies.size()*95)/100 < latencies.size() ? (latencies.size()*95)/100 : latencies.size()-1];
+		maximum = latencies.back();
+	}
+	if(sequence)
+		printf("Sequence %s: %d frames (%d failed, %d full searches), %.3lf sec, %.2lf frames/sec, ",
+			input, count, failed, fullSearches, time, time > 0 ? (count-failed)/time : 0.0);
+	else
+		printf("Batch %s: %d images (%d failed), %d workers, %.3lf sec, %.2lf images/sec, ",
+			input, count, failed, workers, time, time > 0 ? (count-failed)/time : 0.0);
+	printf("latency mean %.3lf, median %.3lf, p95 %.3lf, max %.3lf sec.\n", mean, median, p95, maximum);
+	return failed;
+}
+
+int SegmentBatch(const char *input, const char *outDir, int workers, int lambda, int mu, bool overlays)
+{
+	std::vector<std::string> paths;
+	if(!readList(input, paths))
+		return -1;
+	int count = (int)paths.size();
+#ifdef _OPENMP
+	if(workers <= 0)
+		workers = omp_get_max_threads();
+	omp_set_nested(1);
+#else
+	workers = 1;
+#endif
+
+	ChanVeseBranch::mu = mu;
+	std::vector<BatchResult> results(count);
+	int nextJob = 0;
+	double start = wallTime();
+
+	printf("image\tenergy\tc_b\tc_f\tlatency\n");
+#pragma omp parallel num_threads(workers)
+	{
+		runWorker(paths, nextJob, outDir, lambda, mu, overlays, NULL, results);
+		ReleaseGraph();
+	}
+	return printSummary(input, results, workers, wallTime()-start, false);
+}
+
+int SegmentSequence(const char *input, const char *outDir, int lambda, int mu, bool overlays, int window)
+{
+	std::vector<std::string> paths;
+	if(!readList(input, paths))
+		return -1;
+#ifdef _OPENMP
+	omp_set_nested(1);
+#endif
+
+	ChanVeseBranch::mu = mu;
+	std::vector<BatchResult> results(paths.size());
+	int nextJob = 0;
+	double start = wallTime();
+
+	printf("frame\tenergy\tc_b\tc_f\tlatency\tsearch\n");
+	{
+		ChanVeseSequence sequence(lambda, mu, window);
+		runWorker(paths, nextJob, outDir, lambda, mu, overlays, &sequence, results);
+	}
+	ReleaseGraph();
+	return printSummary(input, results, 1, wallTime()-start, true);
+}
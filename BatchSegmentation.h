@@ -0,0 +1,33 @@
+/*
+This software contains the C++ implementation of the "branch-and-mincut" framework for image segmentation
+with various high-level priors as described in the paper:
+
+V. Lempitsky, A. Blake, C. Rother. Image Segmentation by Branch-and-Mincut.
+In proceedings of European Conference on Computer Vision (ECCV), October 2008.
+
+The software contains the core algorithm and an example of its application (globally-optimal
+segmentations under Chan-Vese functional).
+
+Implemented by Victor Lempitsky, 2008
+*/
+
+#ifndef BATCH_SEGMENTATION_H
+#define BATCH_SEGMENTATION_H
+
+//Headless Chan-Vese segmentation of many images (see SegmentChanVese).
+//input is either a directory (all the .png, .pgm and .ppm files in it, by name) or a manifest file with one image
+//path per line (empty lines and lines starting with # are skipped). For every image <name>.<ext> the mask is written
+//to <outDir>/<name>_mask.png, with overlays also the boundary drawn over the image to <outDir>/<name>_overlay.png.
+//
+//The images are segmented by workers threads at once (OpenMP, workers = 0 uses one per processor). Every worker keeps
+//its own graphs between the images (see PrepareGraph), so images of the same size only copy back the capacities, and
+//decodes its next image on a second thread while it segments the current one (this needs nested parallelism,
+//which is switched on here). One line is printed per image and a throughput/latency summary line at the end.
+//Returns the number of images that could not be read or written.
+int SegmentBatch(const char *input, const char *outDir, int workers, int lambda, int mu, bool overlays);
+
+//same for the frames of a video (in the order of the list) with ChanVeseSequence: every frame starts from the result of
+//the previous one, within +-window of its means. The lines of the frames also tell if the frame needed a full search
+int SegmentSequence(const char *input, const char *outDir, int lambda, int mu, bool overlays, int window = 10);
+
+#endif
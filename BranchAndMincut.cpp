@@ -13,15 +13,23 @@ Implemented by Victor Lempitsky, 2008
 
 
 #include "BranchAndMincut.h"
+#include "PushRelabel.h"
+#include "IBFS.h"
+#include "GridGraph.h"
+#include "ScratchStorage.h"
 #include <stdio.h>
 #include <time.h>
 #include <float.h>
+#include <limits.h>
+#include <math.h>
 
 //using stl for the queue in the min
 #include <queue>
 #include <deque>
 #include <vector>
 #include <functional>
+#include <map>
+#include <algorithm>
 
 
 //////////////////////////////////
@@ -29,78 +37,877 @@ Implemented by Victor Lempitsky, 2008
 
 int imWidth = 0;
 int imHeight = 0;
-static int *bestSegm;
 static Branch *bestBranch = NULL;
 static gtype upperBound; //best leaf energy found so far
+static bool bestInGraph; //true while the graph still holds the cut of bestBranch
 
 //////////////////////////////////////////////
 
 static int statFlowCalls; //counting calls to lower bound/energy evaluations
+static double statGraphTime = 0; //seconds spent building or restoring the graph
+static double statSearchTime = 0; //seconds spent in the search
+
+#pragma omp threadprivate(bestBranch, upperBound, bestInGraph, statFlowCalls, statGraphTime, statSearchTime)
+
+#define CONTRACTION_DEPTHS 64 //depths of the search tree with contraction statistics
+#define CONTRACTION_GAIN 0.125 //smallest fraction of the nodes a new contraction has to fix
 
 //////////////////////////////////////////////
 
 
-struct 
+//the graph is built once per run and reused by all bound evaluations, only the unary terms change.
+//FlowGraph hides the maxflow algorithm; the per-pixel loops live in the template below
+//so that the calls to the graph are not virtual.
+class FlowGraph
+{
+public:
+	virtual ~FlowGraph() {}
+	virtual void Reset(gtype *pairwise, gtype *commonUnaries, bool keepFlow) = 0;
+	virtual gtype Solve(const gtype *newBgUnaries, const gtype *newFgUnaries) = 0; //sets the unaries and returns the maxflow
+	virtual void GetSegmentation(int *segmentation, PackedMask *packed) = 0; //for the last Solve
+};
+
+//forward edges of a pixel in the N-connected grid, in the order of the pairwise array
+template <int N> struct Neighbours;
+template <> struct Neighbours<4> { enum { EDGES = 2 }; static const int dx[EDGES], dy[EDGES]; };
+template <> struct Neighbours<8> { enum { EDGES = 4 }; static const int dx[EDGES], dy[EDGES]; };
+template <> struct Neighbours<16> { enum { EDGES = 8 }; static const int dx[EDGES], dy[EDGES]; };
+const int Neighbours<4>::dx[] = {1, 0};
+const int Neighbours<4>::dy[] = {0, 1};
+const int Neighbours<8>::dx[] = {1, 1, 1, 0};
+const int Neighbours<8>::dy[] = {-1, 0, 1, 1};
+const int Neighbours<16>::dx[] = {1, 1, 1, 0, 1, 2, 2, 1};
+const int Neighbours<16>::dy[] = {-1, 0, 1, 1, -2, -1, 1, 2};
+//and of a voxel, the edges in the slice first
+template <> struct Neighbours<6> { enum { EDGES = 3 }; static const int dx[EDGES], dy[EDGES], dz[EDGES]; };
+template <> struct Neighbours<18> { enum { EDGES = 9 }; static const int dx[EDGES], dy[EDGES], dz[EDGES]; };
+template <> struct Neighbours<26> { enum { EDGES = 13 }; static const int dx[EDGES], dy[EDGES], dz[EDGES]; };
+const int Neighbours<6>::dx[] = {1, 0, 0};
+const int Neighbours<6>::dy[] = {0, 1, 0};
+const int Neighbours<6>::dz[] = {0, 0, 1};
+const int Neighbours<18>::dx[] = {1, 1, 1, 0, 0, 1, -1, 0, 0};
+const int Neighbours<18>::dy[] = {-1, 0, 1, 1, 0, 0, 0, 1, -1};
+const int Neighbours<18>::dz[] = {0, 0, 0, 0, 1, 1, 1, 1, 1};
+const int Neighbours<26>::dx[] = {1, 1, 1, 0, -1, 0, 1, -1, 0, 1, -1, 0, 1};
+const int Neighbours<26>::dy[] = {-1, 0, 1, 1, -1, -1, -1, 0, 0, 0, 1, 1, 1};
+const int Neighbours<26>::dz[] = {0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1};
+
+int NeighbourEdges(Neighbourhood nb)
+{
+	switch(nb)
+	{
+	case NEIGHBOURHOOD_4: return Neighbours<4>::EDGES;
+	case NEIGHBOURHOOD_16: return Neighbours<16>::EDGES;
+	case NEIGHBOURHOOD_6: return Neighbours<6>::EDGES;
+	case NEIGHBOURHOOD_18: return Neighbours<18>::EDGES;
+	case NEIGHBOURHOOD_26: return Neighbours<26>::EDGES;
+	default: return Neighbours<8>::EDGES;
+	}
+}
+
+bool IsVolumeNeighbourhood(Neighbourhood nb)
+{
+	return nb == NEIGHBOURHOOD_6 || nb == NEIGHBOURHOOD_18 || nb == NEIGHBOURHOOD_26;
+}
+
+void GetNeighbourOffset(Neighbourhood nb, int k, int *dx, int *dy, int *dz)
+{
+	assert(k >= 0 && k < NeighbourEdges(nb));
+	const int *x, *y, *z = NULL;
+	switch(nb)
+	{
+	case NEIGHBOURHOOD_4: x = Neighbours<4>::dx; y = Neighbours<4>::dy; break;
+	case NEIGHBOURHOOD_16: x = Neighbours<16>::dx; y = Neighbours<16>::dy; break;
+	case NEIGHBOURHOOD_6: x = Neighbours<6>::dx; y = Neighbours<6>::dy; z = Neighbours<6>::dz; break;
+	case NEIGHBOURHOOD_18: x = Neighbours<18>::dx; y = Neighbours<18>::dy; z = Neighbours<18>::dz; break;
+	case NEIGHBOURHOOD_26: x = Neighbours<26>::dx; y = Neighbours<26>::dy; z = Neighbours<26>::dz; break;
+	default: x = Neighbours<8>::dx; y = Neighbours<8>::dy; break;
+	}
+	*dx = x[k];
+	*dy = y[k];
+	if(dz)
+		*dz = z ? z[k] : 0;
+}
+
+//in 3D the edge covers the directions (of a sphere) that are closer to its line than to the lines of the other edges.
+//Their solid angle is counted on evenly spread points of the sphere (a Fibonacci lattice) and averaged over the edges
+//of the same length, which the symmetries of the grid map onto each other. The weight is the solid angle divided by |e|,
+//relative to the axis edges of the 26-connected grid
+static double VolumeEdgeWeight(Neighbourhood nb, int k)
+{
+	const int POINTS = 100000;
+	const double GOLDEN_ANGLE = 2.39996322972865332;
+	int edges = NeighbourEdges(nb), e, i, lengths[13], counts[13] = {0};
+	double dirs[13][3];
+	for(e = 0; e < edges; e++)
+	{
+		int dx, dy, dz;
+		GetNeighbourOffset(nb, e, &dx, &dy, &dz);
+		lengths[e] = dx*dx+dy*dy+dz*dz;
+		dirs[e][0] = dx/sqrt(double(lengths[e]));
+		dirs[e][1] = dy/sqrt(double(lengths[e]));
+		dirs[e][2] = dz/sqrt(double(lengths[e]));
+	}
+	for(i = 0; i < POINTS; i++)
+	{
+		double z = 1-(2*i+1)/double(POINTS), r = sqrt(1-z*z), phi = i*GOLDEN_ANGLE;
+		double x = r*cos(phi), y = r*sin(phi);
+		int closest = 0;
+		double best = -1;
+		for(e = 0; e < edges; e++)
+		{
+			double c = fabs(x*dirs[e][0]+y*dirs[e][1]+z*dirs[e][2]);
+			if(c > best)
+			{
+				best = c;
+				closest = e;
+			}
+		}
+		counts[closest]++;
+	}
+	int count = 0, same = 0;
+	for(e = 0; e < edges; e++)
+		if(lengths[e] == lengths[k])
+		{
+			count += counts[e];
+			same++;
+		}
+	return double(count)/same/POINTS/sqrt(double(lengths[k]));
+}
+
+//the edge covers half of the angles to the neighbouring edge directions on each side,
+//its weight is that angle divided by 2|e|, scaled by 8/pi
+double EuclideanEdgeWeight(Neighbourhood nb, int k)
+{
+	if(IsVolumeNeighbourhood(nb))
+		return VolumeEdgeWeight(nb, k)/VolumeEdgeWeight(NEIGHBOURHOOD_26, 1);
+
+	const double PI = 3.14159265358979323846;
+	int dx, dy, dx2, dy2;
+	GetNeighbourOffset(nb, k, &dx, &dy);
+	double phi = atan2(double(dy), double(dx));
+	double above = PI, below = PI; //angles to the closest directions (lines) on both sides
+
+	for(int e = 0; e < NeighbourEdges(nb); e++)
+		if(e != k)
+		{
+			GetNeighbourOffset(nb, e, &dx2, &dy2);
+			double diff = fmod(atan2(double(dy2), double(dx2))-phi+2*PI, PI);
+			if(diff < above)
+				above = diff;
+			if(PI-diff < below)
+				below = PI-diff;
+		}
+	return 4*(above+below)/2/(PI*sqrt(double(dx*dx+dy*dy)));
+}
+
+//number of the pixels in the region (nonzero), all the pixels for NULL
+static int RegionSize(const unsigned char *region)
+{
+	int n = imWidth*imHeight;
+	if(region)
+		for(int i = 0; i < imWidth*imHeight; i++)
+			n -= !region[i];
+	return n;
+}
+
+//appends the pixels of the square of the given size at (x0, y0) in the Z order, the quadrants outside the image are
+//skipped (so a long strip does not walk its enclosing square)
+static void MortonOrder(size_t x0, size_t y0, size_t size, int *pixels, int& n)
 {
-	GraphT *graph;
-	gtype *bgUnaries;
+	if(x0 >= (size_t)imWidth || y0 >= (size_t)imHeight)
+		return;
+	if(size == 1)
+	{
+		pixels[n++] = int(y0)*imWidth+int(x0);
+		return;
+	}
+	size_t half = size/2;
+	MortonOrder(x0, y0, half, pixels, n);
+	MortonOrder(x0+half, y0, half, pixels, n);
+	MortonOrder(x0, y0+half, half, pixels, n);
+	MortonOrder(x0+half, y0+half, half, pixels, n);
+}
+
+//fills pixels[node] with the image index of each node for the given order
+static void MakeNodeOrder(NodeOrder nodeOrder, int *pixels)
+{
+	int x, y, n = 0;
+	if(nodeOrder == NODE_ORDER_TILES)
+	{
+		for(int ty = 0; ty < imHeight; ty += NODE_TILE)
+			for(int tx = 0; tx < imWidth; tx += NODE_TILE)
+				for(y = ty; y < ty+NODE_TILE && y < imHeight; y++)
+					for(x = tx; x < tx+NODE_TILE && x < imWidth; x++)
+						pixels[n++] = y*imWidth+x;
+	}
+	else if(nodeOrder == NODE_ORDER_MORTON)
+	{
+		size_t side = 1;
+		while(side < (size_t)imWidth || side < (size_t)imHeight)
+			side *= 2;
+		MortonOrder(0, 0, side, pixels, n);
+	}
+	else
+		for(n = 0; n < imWidth*imHeight; n++)
+			pixels[n] = n;
+}
+
+//N is the neighbourhood (4, 8 or 16), the loops over the edges of a pixel have a fixed length
+template <class G, int N> class FlowGraphT : public FlowGraph
+{
+public:
+	G graph;
+	gtype *bgUnaries; //unaries that are currently in the graph
 	gtype *fgUnaries;
 	bool maxflowWasCalled;
+	int *pixels; //image index of each node
+	int *nodes; //node of each image index, -1 outside the region
+	int nodeNum;
+	RegionBoundary boundary;
+	gtype *builtPairwise; //pairwise terms of the capacities saved in the graph, NULL before the first Reset
+	int *edgePairwise; //index in the pairwise array of each edge of the graph
+	int edgeNum;
+	int *boundaryEdges; //node and index in the pairwise array of each edge to a fixed pixel outside the region
+	int boundaryNum; //ints used and allocated in boundaryEdges
+	int boundaryMax;
+
+	enum { EDGES = Neighbours<N>::EDGES };
+
+	FlowGraphT(NodeOrder nodeOrder, const unsigned char *region, RegionBoundary boundary_)
+		: graph(RegionSize(region), RegionSize(region)*EDGES), nodeNum(0), boundary(boundary_), builtPairwise(NULL),
+		edgeNum(0), boundaryEdges(NULL), boundaryNum(0), boundaryMax(0)
+	{
+		//the arrays of the pixels are scratch storage like the graph, they are as large as its nodes
+		bgUnaries = (gtype *)ScratchAlloc(sizeof(gtype)*imWidth*imHeight);
+		fgUnaries = (gtype *)ScratchAlloc(sizeof(gtype)*imWidth*imHeight);
+		pixels = (int *)ScratchAlloc(sizeof(int)*imWidth*imHeight);
+		nodes = (int *)ScratchAlloc(sizeof(int)*imWidth*imHeight);
+		MakeNodeOrder(nodeOrder, pixels);
+		//the pixels outside the region are dropped from the order
+		for(int n = 0; n < imWidth*imHeight; n++)
+		{
+			nodes[pixels[n]] = -1;
+			if(!region || region[pixels[n]])
+				pixels[nodeNum++] = pixels[n];
+		}
+		for(int n = 0; n < nodeNum; n++)
+			nodes[pixels[n]] = n;
+		edgePairwise = (int *)ScratchAlloc(sizeof(int)*std::max(nodeNum*EDGES, 1));
+	}
+	~FlowGraphT()
+	{
+		ScratchFree(bgUnaries);
+		ScratchFree(fgUnaries);
+		ScratchFree(pixels);
+		ScratchFree(nodes);
+		ScratchFree(builtPairwise);
+		ScratchFree(edgePairwise);
+		ScratchFree(boundaryEdges);
+	}
 
-	void Reset(gtype *pairwise, gtype *commonUnaries)
+	//the graph is only built for the first run, afterwards the initial capacities are copied back
+	//into the existing graph. If the pairwise terms have changed (e.g. another smoothness weight),
+	//the saved capacities of the changed edges are overwritten first
+	//with keepFlow the graph stays as it is, with the flow and the unaries of the last Solve
+	void Reset(gtype *pairwise, gtype *commonUnaries, bool keepFlow)
 	{
-		maxflowWasCalled = false;
-		graph->reset();
-		graph->add_node(imWidth*imHeight);
+		int i,n,k;
 
-		int x,y,i;
+		if(keepFlow && builtPairwise)
+		{
+			assert(!memcmp(builtPairwise, pairwise, sizeof(gtype)*imWidth*imHeight*EDGES));
+			return;
+		}
+
+		maxflowWasCalled = false;
+		if(!builtPairwise)
+		{
+			Build(pairwise);
+			graph.save_capacities();
+			builtPairwise = (gtype *)ScratchAlloc(sizeof(gtype)*imWidth*imHeight*EDGES);
+		}
+		else
+		{
+			for(k = 0; k < edgeNum; k++)
+			{
+				int p = edgePairwise[k];
+				if(builtPairwise[p] != pairwise[p])
+					graph.set_saved_edge(k, pairwise[p], pairwise[p]);
+			}
+			graph.restore_capacities();
+		}
+		memcpy(builtPairwise, pairwise, sizeof(gtype)*imWidth*imHeight*EDGES);
 
 		if(commonUnaries)
-			for(i = 0; i < imWidth*imHeight; i++)
+			for(n = 0; n < nodeNum; n++)
 			{
+				i = pixels[n];
 				if(commonUnaries[i] > 0)
-					graph->add_tweights(i, commonUnaries[i], 0);
+					graph.add_tweights(n, commonUnaries[i], 0);
+				else
+					graph.add_tweights(n, 0, -commonUnaries[i]);
+			}
+
+		//an edge to a fixed pixel outside the region is cut if the node takes the other label
+		for(k = 0; k < boundaryNum; k += 2)
+		{
+			gtype w = pairwise[boundaryEdges[k+1]];
+			if(boundary == REGION_BOUNDARY_FOREGROUND)
+				graph.add_tweights(boundaryEdges[k], 0, w);
+			else
+				graph.add_tweights(boundaryEdges[k], w, 0);
+		}
+
+		memset(fgUnaries, 0, sizeof(gtype)*imWidth*imHeight);
+		memset(bgUnaries, 0, sizeof(gtype)*imWidth*imHeight);
+	}
+
+	void Build(gtype *pairwise)
+	{
+		int x,y,i,n,k;
+
+		graph.reset();
+		graph.add_node(nodeNum);
+		edgeNum = 0;
+		boundaryNum = 0;
+
+		//edges are added in the node order so that the arcs of neighbouring nodes are close in memory
+		for(n = 0; n < nodeNum; n++)
+		{
+			i = pixels[n];
+			y = i/imWidth;
+			x = i-y*imWidth;
+			for(k = 0; k < EDGES; k++)
+			{
+				int x2 = x+Neighbours<N>::dx[k], y2 = y+Neighbours<N>::dy[k];
+				if(x2 >= 0 && x2 < imWidth && y2 >= 0 && y2 < imHeight)
+				{
+					if(nodes[y2*imWidth+x2] >= 0)
+					{
+						graph.add_edge(n, nodes[y2*imWidth+x2], pairwise[i*EDGES+k], pairwise[i*EDGES+k]);
+						edgePairwise[edgeNum++] = i*EDGES+k;
+					}
+					else if(boundary != REGION_BOUNDARY_FREE)
+					{
+						AddBoundaryEdge(n, i*EDGES+k);
+					}
+				}
+				//the edges from the pixels outside the region
+				int x0 = x-Neighbours<N>::dx[k], y0 = y-Neighbours<N>::dy[k];
+				if(boundary != REGION_BOUNDARY_FREE && x0 >= 0 && x0 < imWidth && y0 >= 0 && y0 < imHeight &&
+					nodes[y0*imWidth+x0] < 0)
+				{
+					AddBoundaryEdge(n, (y0*imWidth+x0)*EDGES+k);
+				}
+			}
+		}
+	}
+
+	//only the nodes at the border of the region have such edges, the array grows as the arcs of the graph do
+	void AddBoundaryEdge(int n, int p)
+	{
+		if(boundaryNum+2 > boundaryMax)
+		{
+			int newMax = std::max(2*boundaryMax, 1024);
+			boundaryEdges = (int *)ScratchRealloc(boundaryEdges, sizeof(int)*boundaryMax, sizeof(int)*newMax);
+			boundaryMax = newMax;
+		}
+		boundaryEdges[boundaryNum++] = n;
+		boundaryEdges[boundaryNum++] = p;
+	}
+
+	gtype Solve(const gtype *newBgUnaries, const gtype *newFgUnaries)
+	{
+		int i, n;
+		for(n = 0; n < nodeNum; n++)
+		{
+			i = pixels[n];
+			gtype unaryUpdateBg = newBgUnaries[i]-bgUnaries[i];
+			gtype unaryUpdateFg = newFgUnaries[i]-fgUnaries[i];
+			bgUnaries[i] = newBgUnaries[i];
+			fgUnaries[i] = newFgUnaries[i];
+			if(unaryUpdateBg || unaryUpdateFg)
+			{
+				graph.add_tweights(n, unaryUpdateFg, unaryUpdateBg);
+				
+				if(maxflowWasCalled)
+					graph.mark_node(n);
+			}
+		}
+
+		gtype flow = graph.maxflow(maxflowWasCalled);
+		maxflowWasCalled = true;
+		return flow;
+	}
+
+	//the pixels outside the region are background
+	int Label(int i) { return nodes[i] >= 0 ? (int)graph.what_segment(nodes[i]) : 0; }
+
+	void GetSegmentation(int *segmentation, PackedMask *packed)
+	{
+		int i, imsize = imWidth*imHeight;
+		if(segmentation)
+			for(i = 0; i < imsize; i++)
+				segmentation[i] = Label(i);
+		if(packed)
+		{
+			packed->Resize(imWidth, imHeight);
+			for(i = 0; i < imsize; i += 32)
+			{
+				unsigned int word = 0;
+				for(int k = 0; k < 32 && i+k < imsize; k++)
+					word |= (unsigned int)Label(i+k) << k;
+				packed->bits[i >> 5] = word;
+			}
+		}
+	}
+};
+
+//graph of the superpixels of the image (see PrepareSuperpixelGraph): a node for every superpixel with the sums of the
+//unaries of its pixels, and an edge between every two touching superpixels with the sum of the pairwise terms of the
+//pixel edges between them. It is small, so it is simply rebuilt for every run
+template <class G, int N> class SuperpixelGraphT : public FlowGraph
+{
+public:
+	G *graph;
+	const int *superpixels; //superpixel of each pixel (the copy kept by the pool)
+	int count;
+	std::vector<int> edgeEnds; //the two superpixels of each edge
+	std::vector<int> pixelEdges; //pairs: index in the pairwise array and edge of each pixel edge between superpixels
+	std::vector<gtype> bgUnaries, fgUnaries; //unaries of the superpixels that are currently in the graph
+	std::vector<gtype> bgSums, fgSums;
+	bool maxflowWasCalled;
+	bool built;
+
+	enum { EDGES = Neighbours<N>::EDGES };
+
+	SuperpixelGraphT(const int *superpixels_, int count_)
+		: superpixels(superpixels_), count(count_), bgUnaries(count_), fgUnaries(count_), bgSums(count_), fgSums(count_),
+		  maxflowWasCalled(false), built(false)
+	{
+		int x,y,i,k;
+		std::map<std::pair<int,int>, int> edges;
+		for(y = 0; y < imHeight; y++)
+			for(x = 0; x < imWidth; x++)
+			{
+				i = y*imWidth+x;
+				for(k = 0; k < EDGES; k++)
+				{
+					int x2 = x+Neighbours<N>::dx[k], y2 = y+Neighbours<N>::dy[k];
+					if(x2 < 0 || x2 >= imWidth || y2 < 0 || y2 >= imHeight)
+						continue;
+					int a = superpixels[i], b = superpixels[y2*imWidth+x2];
+					if(a == b)
+						continue;
+					std::pair<int,int> key(std::min(a, b), std::max(a, b));
+					std::map<std::pair<int,int>, int>::iterator e = edges.find(key);
+					if(e == edges.end())
+					{
+						e = edges.insert(std::make_pair(key, (int)edgeEnds.size()/2)).first;
+						edgeEnds.push_back(key.first);
+						edgeEnds.push_back(key.second);
+					}
+					pixelEdges.push_back(i*EDGES+k);
+					pixelEdges.push_back(e->second);
+				}
+			}
+		graph = new G(count, (int)edgeEnds.size()/2);
+	}
+	~SuperpixelGraphT()
+	{
+		delete graph;
+	}
+
+	void Reset(gtype *pairwise, gtype *commonUnaries, bool keepFlow)
+	{
+		int i,k;
+		if(keepFlow && built)
+			return;
+
+		std::vector<gtype> caps(edgeEnds.size()/2, 0);
+		for(k = 0; k < (int)pixelEdges.size(); k += 2)
+			caps[pixelEdges[k+1]] += pairwise[pixelEdges[k]];
+		graph->reset();
+		graph->add_node(count);
+		for(k = 0; k < (int)caps.size(); k++)
+			graph->add_edge(edgeEnds[2*k], edgeEnds[2*k+1], caps[k], caps[k]);
+
+		if(commonUnaries)
+		{
+			std::vector<gtype> sums(count, 0);
+			for(i = 0; i < imWidth*imHeight; i++)
+				sums[superpixels[i]] += commonUnaries[i];
+			for(k = 0; k < count; k++)
+				if(sums[k] > 0)
+					graph->add_tweights(k, sums[k], 0);
 				else
-					graph->add_tweights(i, 0, -commonUnaries[i]);
+					graph->add_tweights(k, 0, -sums[k]);
+		}
+
+		std::fill(bgUnaries.begin(), bgUnaries.end(), 0);
+		std::fill(fgUnaries.begin(), fgUnaries.end(), 0);
+		maxflowWasCalled = false;
+		built = true;
+	}
+
+	gtype Solve(const gtype *newBgUnaries, const gtype *newFgUnaries)
+	{
+		int i, k;
+		std::fill(bgSums.begin(), bgSums.end(), 0);
+		std::fill(fgSums.begin(), fgSums.end(), 0);
+		for(i = 0; i < imWidth*imHeight; i++)
+		{
+			bgSums[superpixels[i]] += newBgUnaries[i];
+			fgSums[superpixels[i]] += newFgUnaries[i];
+		}
+		for(k = 0; k < count; k++)
+		{
+			gtype unaryUpdateBg = bgSums[k]-bgUnaries[k];
+			gtype unaryUpdateFg = fgSums[k]-fgUnaries[k];
+			bgUnaries[k] = bgSums[k];
+			fgUnaries[k] = fgSums[k];
+			if(unaryUpdateBg || unaryUpdateFg)
+			{
+				graph->add_tweights(k, unaryUpdateFg, unaryUpdateBg);
+				if(maxflowWasCalled)
+					graph->mark_node(k);
 			}
+		}
 
-		for(y = 0, i = 0; y < imHeight; y++)
-			for(x = 0; x < imWidth; x++, i++)
+		gtype flow = graph->maxflow(maxflowWasCalled);
+		maxflowWasCalled = true;
+		return flow;
+	}
+
+	void GetSegmentation(int *segmentation, PackedMask *packed)
+	{
+		int i, imsize = imWidth*imHeight;
+		if(segmentation)
+			for(i = 0; i < imsize; i++)
+				segmentation[i] = (int)graph->what_segment(superpixels[i]);
+		if(packed)
+		{
+			packed->Resize(imWidth, imHeight);
+			for(i = 0; i < imsize; i += 32)
 			{
-				if(y && x < imWidth-1)	graph->add_edge(i, i-imWidth+1, pairwise[i*4], pairwise[i*4]);
-				if(x < imWidth-1)	graph->add_edge(i, i+1, pairwise[i*4+1], pairwise[i*4+1]);
-				if(y < imHeight-1 && x < imWidth-1)	graph->add_edge(i, i+imWidth+1, pairwise[i*4+2], pairwise[i*4+2]);
-				if(y < imHeight-1)	graph->add_edge(i, i+imWidth, pairwise[i*4+3], pairwise[i*4+3]);
+				unsigned int word = 0;
+				for(int k = 0; k < 32 && i+k < imsize; k++)
+					word |= (unsigned int)graph->what_segment(superpixels[i+k]) << k;
+				packed->bits[i >> 5] = word;
 			}
+		}
+	}
+};
+
+//graph of a volume (see PrepareVolumeGraph). The voxels are in the order of the image of the slices, the grid keeps
+//no copy of the capacities: Reset sets them again from the pairwise terms
+class VolumeGraph : public FlowGraph
+{
+public:
+	GridGraph<gtype,gtype,gtype> graph;
+	int width, height, depth, edges;
+	int dx[13], dy[13], dz[13];
+	gtype *bgUnaries; //unaries that are currently in the graph
+	gtype *fgUnaries;
+	bool built; //Reset was called
+	bool maxflowWasCalled;
+
+	VolumeGraph(int width_, int height_, int depth_, int edges_, const int *dx_, const int *dy_, const int *dz_)
+		: graph(width_, height_, depth_, edges_, dx_, dy_, dz_), width(width_), height(height_), depth(depth_),
+		edges(edges_), built(false), maxflowWasCalled(false)
+	{
+		memcpy(dx, dx_, sizeof(int)*edges);
+		memcpy(dy, dy_, sizeof(int)*edges);
+		memcpy(dz, dz_, sizeof(int)*edges);
+		bgUnaries = (gtype *)ScratchAlloc(sizeof(gtype)*imWidth*imHeight);
+		fgUnaries = (gtype *)ScratchAlloc(sizeof(gtype)*imWidth*imHeight);
+	}
+	~VolumeGraph()
+	{
+		ScratchFree(bgUnaries);
+		ScratchFree(fgUnaries);
+	}
+
+	void Reset(gtype *pairwise, gtype *commonUnaries, bool keepFlow)
+	{
+		int x, y, z, k, i = 0;
+		if(keepFlow && built)
+			return;
+
+		graph.reset();
+		for(z = 0; z < depth; z++)
+			for(y = 0; y < height; y++)
+			{
+				int n = graph.voxel(0, y, z);
+				for(x = 0; x < width; x++, i++, n++)
+				{
+					for(k = 0; k < edges; k++)
+					{
+						int x2 = x+dx[k], y2 = y+dy[k], z2 = z+dz[k];
+						if(x2 >= 0 && x2 < width && y2 >= 0 && y2 < height && z2 < depth)
+							graph.set_edge(n, k, pairwise[i*edges+k], pairwise[i*edges+k]);
+					}
+					if(commonUnaries)
+					{
+						if(commonUnaries[i] > 0)
+							graph.add_tweights(n, commonUnaries[i], 0);
+						else
+							graph.add_tweights(n, 0, -commonUnaries[i]);
+					}
+				}
+			}
+		built = true;
+		maxflowWasCalled = false;
 		memset(fgUnaries, 0, sizeof(gtype)*imWidth*imHeight);
 		memset(bgUnaries, 0, sizeof(gtype)*imWidth*imHeight);
 	}
-} reusable;
 
-void PrepareGraph(int imwidth, int imheight)
+	gtype Solve(const gtype *newBgUnaries, const gtype *newFgUnaries)
+	{
+		int x, y, z, i = 0;
+		for(z = 0; z < depth; z++)
+			for(y = 0; y < height; y++)
+			{
+				int n = graph.voxel(0, y, z);
+				for(x = 0; x < width; x++, i++, n++)
+				{
+					gtype unaryUpdateBg = newBgUnaries[i]-bgUnaries[i];
+					gtype unaryUpdateFg = newFgUnaries[i]-fgUnaries[i];
+					bgUnaries[i] = newBgUnaries[i];
+					fgUnaries[i] = newFgUnaries[i];
+					if(unaryUpdateBg || unaryUpdateFg)
+					{
+						graph.add_tweights(n, unaryUpdateFg, unaryUpdateBg);
+						if(maxflowWasCalled)
+							graph.mark_node(n);
+					}
+				}
+			}
+
+		gtype flow = graph.maxflow(maxflowWasCalled);
+		maxflowWasCalled = true;
+		return flow;
+	}
+
+	void GetSegmentation(int *segmentation, PackedMask *packed)
+	{
+		int x, y, z, i = 0;
+		if(packed)
+			packed->Resize(imWidth, imHeight);
+		for(z = 0; z < depth; z++)
+			for(y = 0; y < height; y++)
+			{
+				int n = graph.voxel(0, y, z);
+				for(x = 0; x < width; x++, i++, n++)
+				{
+					int label = (int)graph.what_segment(n);
+					if(segmentation)
+						segmentation[i] = label;
+					if(packed)
+						packed->bits[i >> 5] |= (unsigned int)label << (i & 31);
+				}
+			}
+	}
+};
+
+//graphs kept by PrepareGraph, the most recently used first
+struct PooledGraph
 {
-	imWidth = imwidth;
-	imHeight = imheight;
+	FlowGraph *graph;
+	int width, height; //of the image, for a volume of its slices
+	int depth; //slices of a volume, 1 for an image
+	MaxflowType maxflowType;
+	NodeOrder nodeOrder;
+	Neighbourhood neighbourhood;
+	unsigned char *region; //copy of the region, NULL for the whole image
+	RegionBoundary boundary;
+	int *superpixels; //copy of the superpixels for a superpixel graph, NULL for a pixel graph
+};
+static PooledGraph graphPool[GRAPH_POOL];
+static int graphPoolSize = 0;
+static FlowGraph *reusable = NULL; //graph of the current image, the first one of the pool
+
+#pragma omp threadprivate(graphPool, graphPoolSize, reusable)
+
+template <int N> FlowGraph *NewFlowGraph(MaxflowType maxflowType, NodeOrder nodeOrder, const unsigned char *region,
+										  RegionBoundary boundary)
+{
+	if(maxflowType == MAXFLOW_PUSH_RELABEL)
+		return new FlowGraphT<PushRelabelGraph<gtype,gtype,gtype>, N>(nodeOrder, region, boundary);
+	else if(maxflowType == MAXFLOW_IBFS)
+		return new FlowGraphT<IBFSGraph<gtype,gtype,gtype>, N>(nodeOrder, region, boundary);
+	else
+		return new FlowGraphT<GraphT, N>(nodeOrder, region, boundary);
+}
+
+static void ReleasePooledGraph(PooledGraph& p)
+{
+	delete p.graph;
+	delete[] p.region;
+	delete[] p.superpixels;
+}
+
+static bool SameTopology(const PooledGraph& p, const PooledGraph& key)
+{
+	int n = key.width*key.height;
+	return p.width == key.width && p.height == key.height && p.depth == key.depth && p.maxflowType == key.maxflowType &&
+		p.nodeOrder == key.nodeOrder && p.neighbourhood == key.neighbourhood && p.boundary == key.boundary &&
+		!p.region == !key.region && (!key.region || !memcmp(p.region, key.region, n)) &&
+		!p.superpixels == !key.superpixels && (!key.superpixels || !memcmp(p.superpixels, key.superpixels, sizeof(int)*n));
+}
+
+//moves the pooled graph with the topology of key to the front, or a new entry (with copies of the region and the
+//superpixels of key and no graph yet) if there is none
+static PooledGraph& FrontPooledGraph(const PooledGraph& key)
+{
+	int k, n = key.width*key.height;
+	imWidth = key.width;
+	imHeight = key.height;
+
+	//a graph of an earlier run is kept if it has the same topology
+	for(k = 0; k < graphPoolSize; k++)
+		if(SameTopology(graphPool[k], key))
+			break;
+	if(k == graphPoolSize)
+	{
+		//replacing the least recently used graph if the pool is full
+		if(graphPoolSize == GRAPH_POOL)
+			ReleasePooledGraph(graphPool[--k]);
+		else
+			graphPoolSize++;
+
+		PooledGraph& p = graphPool[k];
+		p = key;
+		p.graph = NULL;
+		if(key.region)
+		{
+			p.region = new unsigned char[n];
+			memcpy(p.region, key.region, n);
+		}
+		if(key.superpixels)
+		{
+			p.superpixels = new int[n];
+			memcpy(p.superpixels, key.superpixels, sizeof(int)*n);
+		}
+	}
 
-	reusable.graph = new GraphT(imwidth*imheight, imwidth*imheight*4);
-	reusable.bgUnaries = new gtype[imwidth*imheight];
-	reusable.fgUnaries = new gtype[imwidth*imheight];
+	PooledGraph used = graphPool[k];
+	for(; k > 0; k--)
+		graphPool[k] = graphPool[k-1];
+	graphPool[0] = used;
+	return graphPool[0];
+}
+
+void PrepareGraph(int imwidth, int imheight, MaxflowType maxflowType, NodeOrder nodeOrder, Neighbourhood neighbourhood,
+				  const unsigned char *region, RegionBoundary boundary)
+{
+	PooledGraph key;
+	key.width = imwidth;
+	key.height = imheight;
+	key.depth = 1;
+	key.maxflowType = maxflowType;
+	key.nodeOrder = nodeOrder;
+	key.neighbourhood = neighbourhood;
+	key.region = (unsigned char *)region;
+	key.boundary = region ? boundary : REGION_BOUNDARY_FREE;
+	key.superpixels = NULL;
+
+	PooledGraph& p = FrontPooledGraph(key);
+	if(!p.graph)
+	{
+		if(neighbourhood == NEIGHBOURHOOD_4)
+			p.graph = NewFlowGraph<4>(maxflowType, nodeOrder, p.region, p.boundary);
+		else if(neighbourhood == NEIGHBOURHOOD_16)
+			p.graph = NewFlowGraph<16>(maxflowType, nodeOrder, p.region, p.boundary);
+		else
+			p.graph = NewFlowGraph<8>(maxflowType, nodeOrder, p.region, p.boundary);
+	}
+	reusable = p.graph;
+}
+
+template <int N> FlowGraph *NewSuperpixelGraph(MaxflowType maxflowType, const int *superpixels, int count)
+{
+	if(maxflowType == MAXFLOW_PUSH_RELABEL)
+		return new SuperpixelGraphT<PushRelabelGraph<gtype,gtype,gtype>, N>(superpixels, count);
+	else if(maxflowType == MAXFLOW_IBFS)
+		return new SuperpixelGraphT<IBFSGraph<gtype,gtype,gtype>, N>(superpixels, count);
+	else
+		return new SuperpixelGraphT<GraphT, N>(superpixels, count);
+}
+
+void PrepareSuperpixelGraph(int imwidth, int imheight, const int *superpixels, MaxflowType maxflowType,
+							Neighbourhood neighbourhood)
+{
+	PooledGraph key;
+	key.width = imwidth;
+	key.height = imheight;
+	key.depth = 1;
+	key.maxflowType = maxflowType;
+	key.nodeOrder = NODE_ORDER_ROWS;
+	key.neighbourhood = neighbourhood;
+	key.region = NULL;
+	key.boundary = REGION_BOUNDARY_FREE;
+	key.superpixels = (int *)superpixels;
+
+	PooledGraph& p = FrontPooledGraph(key);
+	if(!p.graph)
+	{
+		int count = 1+*std::max_element(p.superpixels, p.superpixels+imwidth*imheight);
+		if(neighbourhood == NEIGHBOURHOOD_4)
+			p.graph = NewSuperpixelGraph<4>(maxflowType, p.superpixels, count);
+		else if(neighbourhood == NEIGHBOURHOOD_16)
+			p.graph = NewSuperpixelGraph<16>(maxflowType, p.superpixels, count);
+		else
+			p.graph = NewSuperpixelGraph<8>(maxflowType, p.superpixels, count);
+	}
+	reusable = p.graph;
+}
+
+void PrepareVolumeGraph(int width, int height, int depth, Neighbourhood neighbourhood)
+{
+	PooledGraph key;
+	key.width = width;
+	key.height = height*depth;
+	key.depth = depth;
+	key.maxflowType = MAXFLOW_BK;
+	key.nodeOrder = NODE_ORDER_ROWS;
+	key.neighbourhood = neighbourhood;
+	key.region = NULL;
+	key.boundary = REGION_BOUNDARY_FREE;
+	key.superpixels = NULL;
+
+	PooledGraph& p = FrontPooledGraph(key);
+	if(!p.graph)
+	{
+		int k, edges = NeighbourEdges(neighbourhood), dx[13], dy[13], dz[13];
+		for(k = 0; k < edges; k++)
+			GetNeighbourOffset(neighbourhood, k, &dx[k], &dy[k], &dz[k]);
+		p.graph = new VolumeGraph(width, height, depth, edges, dx, dy, dz);
+	}
+	reusable = p.graph;
 }
 
 void ReleaseGraph()
 {
-	delete reusable.graph;
-	delete reusable.bgUnaries;
-	delete reusable.fgUnaries;
+	for(int k = 0; k < graphPoolSize; k++)
+		ReleasePooledGraph(graphPool[k]);
+	graphPoolSize = 0;
+	reusable = NULL;
 }
 //////////////////////////////////////////
 
 //STL stuff
 
+struct Contraction;
+
 struct BranchWrapper
 {
 	Branch *br;
-	BranchWrapper(Branch *b): br(b) {}
+	Contraction *contraction; //graph the branch is evaluated in, NULL for the full graph
+	int depth; //in the search tree, 0 for the root
+	int checked; //depth of the last branch above whose persistency was computed
+	BranchWrapper(Branch *b, Contraction *c = NULL, int d = 0, int ch = -CONTRACTION_DEPTHS): br(b), contraction(c), depth(d), checked(ch) {}
 };
 
 using namespace std;
@@ -114,50 +921,323 @@ bool operator>(const BranchWrapper& a, const BranchWrapper& b)
 }
 typedef std::priority_queue<BranchWrapper, vector<BranchWrapper>, greater<vector<BranchWrapper>::value_type>> FRONT_QUEUE;
 
-FRONT_QUEUE frontQueue;
-
 ///////////////////////////////////////////////
 
 
 ///////////////////////////////////////////////////////
 
-gtype *currentBgUnaries = NULL;
-gtype *currentFgUnaries = NULL;
+static gtype *currentBgUnaries = NULL;
+static gtype *currentFgUnaries = NULL;
+//pixels with hard constraints (in a BranchAndMincutSession), NULL otherwise
+static const std::vector<int> *hardForeground = NULL;
+static const std::vector<int> *hardBackground = NULL;
+
+#pragma omp threadprivate(currentBgUnaries, currentFgUnaries, hardForeground, hardBackground)
 
 ////////////////////////////////////////////
 
-bool BestFirstSearch();
-void DepthFirstSearch(Branch *br);
-gtype EvaluateBound(Branch *br);
+//persistency-based contraction
 
-Branch *BranchAndMincut(int imwidth, int imheight, 
-					  Branch *root, int *segmentation, 
+//the pixels that have the same label in all the optimal segmentations of the leaves of a subtree (fixed pixels),
+//and a graph of the other pixels, where the edges to the fixed ones became terminal links.
+//Shared by the branches of the subtree. The arrays are scratch storage like the graph
+struct Contraction
+{
+	int refs;
+	signed char *labels; //1 for the fixed foreground, 0 for the fixed background, -1 for the nodes,
+						//-2 outside the region of the graph
+	int *pixels; //image index of each node
+	int nodeNum;
+	gtype fixedCost; //common unaries of the fixed pixels and the pairwise terms between them
+	GraphT *graph; //NULL if all the pixels are fixed
+	gtype *bgUnaries, *fgUnaries; //branch unaries of the nodes that are currently in the graph
+	bool maxflowWasCalled;
+};
+
+static bool contractionEnabled = false;
+static int contractionPeriod = 3;
+static gtype *searchPairwise = NULL; //terms of the current run, the contractions are built from them
+static gtype *searchCommonUnaries = NULL;
+static Contraction *fullContraction = NULL; //graph without fixed pixels for the first contraction, built when needed
+static int statContractions[CONTRACTION_DEPTHS]; //persistency computations at each depth
+static double statFixed[CONTRACTION_DEPTHS]; //sum of their fractions of fixed pixels
+static int statContractionFlows; //maxflows of the persistency computations
+
+#pragma omp threadprivate(contractionEnabled, contractionPeriod, searchPairwise, searchCommonUnaries, fullContraction, \
+	statContractions, statFixed, statContractionFlows)
+
+//the contraction takes the labels (ScratchAlloc) over
+static Contraction *NewContraction(signed char *labels)
+{
+	Neighbourhood nb = graphPool[0].neighbourhood;
+	int edges = NeighbourEdges(nb), imsize = imWidth*imHeight;
+	int i, k, x, y, dx[16], dy[16];
+	for(k = 0; k < edges; k++)
+		GetNeighbourOffset(nb, k, &dx[k], &dy[k]);
+	//label of the pixels outside the region at the edges, -2 if they have no edges
+	RegionBoundary boundary = graphPool[0].boundary;
+	int outside = boundary == REGION_BOUNDARY_FOREGROUND ? 1 : boundary == REGION_BOUNDARY_BACKGROUND ? 0 : -2;
+
+	Contraction *c = new Contraction;
+	c->refs = 1;
+	c->labels = labels;
+	c->fixedCost = 0;
+	c->maxflowWasCalled = false;
+	int *nodes = (int *)ScratchAlloc(sizeof(int)*imsize);
+	int nodeNum = 0;
+	for(i = 0; i < imsize; i++)
+		nodes[i] = labels[i] == -1 ? nodeNum++ : -1;
+	c->nodeNum = nodeNum;
+	c->pixels = (int *)ScratchAlloc(sizeof(int)*std::max(nodeNum, 1));
+	for(i = 0; i < imsize; i++)
+		if(nodes[i] >= 0)
+			c->pixels[nodes[i]] = i;
+	//when every pixel is fixed there is no graph, its flow is 0
+	c->graph = nodeNum ? new GraphT(nodeNum, std::max(nodeNum*edges, 1)) : NULL;
+	if(nodeNum)
+		c->graph->add_node(nodeNum);
+	c->bgUnaries = (gtype *)ScratchAlloc(sizeof(gtype)*std::max(nodeNum, 1));
+	c->fgUnaries = (gtype *)ScratchAlloc(sizeof(gtype)*std::max(nodeNum, 1));
+	memset(c->bgUnaries, 0, sizeof(gtype)*nodeNum);
+	memset(c->fgUnaries, 0, sizeof(gtype)*nodeNum);
+
+	for(i = 0; i < imsize; i++)
+	{
+		gtype common = searchCommonUnaries ? searchCommonUnaries[i] : 0;
+		if(nodes[i] >= 0)
+		{
+			if(common > 0)
+				c->graph->add_tweights(nodes[i], common, 0);
+			else
+				c->graph->add_tweights(nodes[i], 0, -common);
+		}
+		else if(labels[i] == 1 && common > 0)
+			c->fixedCost += common;
+		else if(labels[i] == 0 && common < 0)
+			c->fixedCost -= common;
+
+		y = i/imWidth;
+		x = i-y*imWidth;
+		for(k = 0; k < edges; k++)
+		{
+			if(x+dx[k] < 0 || x+dx[k] >= imWidth || y+dy[k] < 0 || y+dy[k] >= imHeight)
+				continue;
+			int j = i+dy[k]*imWidth+dx[k];
+			int li = labels[i] == -2 ? outside : labels[i], lj = labels[j] == -2 ? outside : labels[j];
+			gtype w = searchPairwise[i*edges+k];
+			if(li == -2 || lj == -2)
+				continue;
+			if(li < 0 && lj < 0)
+				c->graph->add_edge(nodes[i], nodes[j], w, w);
+			else if(li < 0 || lj < 0)
+			{
+				//the edge to a fixed pixel is cut if the node takes the other label
+				if(li < 0 ? lj : li)
+					c->graph->add_tweights(li < 0 ? nodes[i] : nodes[j], 0, w);
+				else
+					c->graph->add_tweights(li < 0 ? nodes[i] : nodes[j], w, 0);
+			}
+			else if(li != lj)
+				c->fixedCost += w;
+		}
+	}
+	ScratchFree(nodes);
+	return c;
+}
+
+static Contraction *AcquireContraction(Contraction *c)
+{
+	if(c)
+		c->refs++;
+	return c;
+}
+
+static void ReleaseContraction(Contraction *c)
+{
+	if(c && --c->refs == 0)
+	{
+		delete c->graph;
+		ScratchFree(c->labels);
+		ScratchFree(c->pixels);
+		ScratchFree(c->bgUnaries);
+		ScratchFree(c->fgUnaries);
+		delete c;
+	}
+}
+
+//sets the branch unaries of the nodes and returns the maxflow of the contracted graph
+static gtype SolveContraction(Contraction *c, const gtype *bgUnaries, const gtype *fgUnaries)
+{
+	if(!c->graph)
+		return 0;
+	for(int n = 0; n < c->nodeNum; n++)
+	{
+		int i = c->pixels[n];
+		gtype unaryUpdateBg = bgUnaries[i]-c->bgUnaries[n];
+		gtype unaryUpdateFg = fgUnaries[i]-c->fgUnaries[n];
+		if(unaryUpdateBg || unaryUpdateFg)
+		{
+			c->bgUnaries[n] = bgUnaries[i];
+			c->fgUnaries[n] = fgUnaries[i];
+			c->graph->add_tweights(n, unaryUpdateFg, unaryUpdateBg);
+			if(c->maxflowWasCalled)
+				c->graph->mark_node(n);
+		}
+	}
+	gtype flow = c->graph->maxflow(c->maxflowWasCalled);
+	c->maxflowWasCalled = true;
+	return flow;
+}
+
+//the unaries of the leaf with the difference fgUnaries-bgUnaries = diff
+static void SolveDifference(Contraction *c, const gtype *diff, gtype *bg, gtype *fg)
+{
+	for(int i = 0; i < imWidth*imHeight; i++)
+	{
+		bg[i] = diff[i] < 0 ? -diff[i] : 0;
+		fg[i] = diff[i] > 0 ? diff[i] : 0;
+	}
+	SolveContraction(c, bg, fg);
+	statContractionFlows++;
+}
+
+//contraction for the children of the branch br at the given depth, which was evaluated in parent (one reference is
+//returned). By the submodularity, the optimal foregrounds of all the leaves below br contain the smallest optimal
+//foreground of the leaf with the largest differences (the pixels that can reach the sink in its residual graph) and
+//are contained in the largest one of the leaf with the smallest differences (the pixels that the source cannot reach).
+//The contraction is only kept if it fixes at least CONTRACTION_GAIN of the nodes of the parent
+static Contraction *Contract(Branch *br, Contraction *parent, int depth)
+{
+	int n, imsize = imWidth*imHeight;
+	//the temporaries are as large as the graph, so they are scratch storage too
+	gtype *minDiff = (gtype *)ScratchAlloc(sizeof(gtype)*imsize), *maxDiff = (gtype *)ScratchAlloc(sizeof(gtype)*imsize);
+	if(!br->GetUnaryRange(minDiff, maxDiff))
+	{
+		ScratchFree(minDiff);
+		ScratchFree(maxDiff);
+		return AcquireContraction(parent);
+	}
+
+	Contraction *c = parent;
+	if(!c)
+	{
+		if(!fullContraction)
+		{
+			signed char *labels = (signed char *)ScratchAlloc(imsize);
+			const unsigned char *region = graphPool[0].region;
+			for(int i = 0; i < imsize; i++)
+				labels[i] = region && !region[i] ? -2 : -1;
+			fullContraction = NewContraction(labels);
+		}
+		c = fullContraction;
+	}
+	signed char *labels = (signed char *)ScratchAlloc(imsize);
+	memcpy(labels, c->labels, imsize);
+	gtype *bg = (gtype *)ScratchAlloc(sizeof(gtype)*imsize), *fg = (gtype *)ScratchAlloc(sizeof(gtype)*imsize);
+	int nodeNum = c->nodeNum;
+	int regionSize = imsize-(int)std::count(labels, labels+imsize, -2), fixed = regionSize-nodeNum;
+
+	SolveDifference(c, minDiff, bg, fg);
+	for(n = 0; n < nodeNum; n++)
+		if(c->graph->what_segment(n, GraphT::SINK) == GraphT::SOURCE)
+		{
+			labels[c->pixels[n]] = 0;
+			fixed++;
+		}
+	SolveDifference(c, maxDiff, bg, fg);
+	for(n = 0; n < nodeNum; n++)
+		if(c->graph->what_segment(n, GraphT::SOURCE) == GraphT::SINK)
+		{
+			labels[c->pixels[n]] = 1;
+			fixed++;
+		}
+	ScratchFree(minDiff);
+	ScratchFree(maxDiff);
+	ScratchFree(bg);
+	ScratchFree(fg);
+
+	int d = std::min(depth, CONTRACTION_DEPTHS-1);
+	statContractions[d]++;
+	if(fixed-(regionSize-nodeNum) < CONTRACTION_GAIN*nodeNum)
+	{
+		statFixed[d] += double(regionSize-nodeNum)/regionSize;
+		ScratchFree(labels);
+		return AcquireContraction(parent);
+	}
+	statFixed[d] += double(fixed)/regionSize;
+	return NewContraction(labels);
+}
+
+//one reference to the contraction for the children of a branch that is split
+static Contraction *ChildContraction(const BranchWrapper& w, int *checked)
+{
+	*checked = w.checked;
+	//the contractions are graphs of pixels
+	if(!contractionEnabled || graphPool[0].superpixels || graphPool[0].depth > 1 || w.depth-w.checked < contractionPeriod)
+		return AcquireContraction(w.contraction);
+	*checked = w.depth;
+	return Contract(w.br, w.contraction, w.depth);
+}
+
+void SetContraction(bool enable, int period)
+{
+	contractionEnabled = enable;
+	contractionPeriod = std::max(period, 1);
+}
+
+int GetContractionStats(int *counts, double *ratios, int maxDepth)
+{
+	int depths = 0;
+	for(int d = 0; d < maxDepth; d++)
+	{
+		counts[d] = d < CONTRACTION_DEPTHS ? statContractions[d] : 0;
+		ratios[d] = counts[d] ? statFixed[d]/counts[d] : 0;
+		if(counts[d])
+			depths = d+1;
+	}
+	return depths;
+}
+
+////////////////////////////////////////////
+
+bool BestFirstSearch(FRONT_QUEUE& frontQueue);
+void DepthFirstSearch(const BranchWrapper& w);
+gtype EvaluateBound(Branch *br, bool *solved = NULL, Contraction *contraction = NULL);
+gtype SolveBranchGraph(Branch *br, Contraction *contraction = NULL);
+
+//the segmentation is extracted only once, after the search: incumbent updates just keep the branch
+static Branch *RunBranchAndMincut(Branch *root, int *segmentation, PackedMask *packed,
 					  bool bestFirst, Branch *initialGuess, 
 					  gtype *pairwise, 
 					  gtype *commonUnaries,
-					  int *nCalls)
+					  int *nCalls, bool reuseFlow)
 {
-	assert(imwidth == imWidth && imheight == imHeight);
 	clock_t start = clock();
 
-	bestSegm = segmentation;
 	bestBranch = NULL;
+	bestInGraph = false;
 
 	statFlowCalls = 0;
+	statContractionFlows = 0;
+	memset(statContractions, 0, sizeof(statContractions));
+	memset(statFixed, 0, sizeof(statFixed));
+	searchPairwise = pairwise;
+	searchCommonUnaries = commonUnaries;
 
-	if(currentBgUnaries)
-		delete currentBgUnaries;
-	if(currentFgUnaries)
-		delete currentFgUnaries;
+	ScratchFree(currentBgUnaries);
+	ScratchFree(currentFgUnaries);
 
-	currentBgUnaries = new gtype[imWidth*imHeight];
-	currentFgUnaries = new gtype[imWidth*imHeight];
+	currentBgUnaries = (gtype *)ScratchAlloc(sizeof(gtype)*imWidth*imHeight);
+	currentFgUnaries = (gtype *)ScratchAlloc(sizeof(gtype)*imWidth*imHeight);
 
-	reusable.Reset(pairwise, commonUnaries);
+	reusable->Reset(pairwise, commonUnaries, reuseFlow);
+	clock_t searchStart = clock();
+	statGraphTime += double(searchStart-start)/CLOCKS_PER_SEC;
 
 	upperBound = INFTY;
 
-	if(!bestFirst && initialGuess)
+	//the initial guess is the first incumbent: every branch with a bound above it is pruned
+	if(initialGuess)
 		upperBound = EvaluateBound(initialGuess);
 
 	Branch *root_;
@@ -167,21 +1247,29 @@ Branch *BranchAndMincut(int imwidth, int imheight,
 
 	if(bestFirst)
 	{
+		FRONT_QUEUE frontQueue;
 		frontQueue.push(BranchWrapper(root_));
-		while(BestFirstSearch());
+		while(BestFirstSearch(frontQueue));
 		while(!frontQueue.empty())
 		{
-			Branch *br = frontQueue.top().br;
-			delete br;
+			delete frontQueue.top().br;
+			ReleaseContraction(frontQueue.top().contraction);
 			frontQueue.pop();
 		}
 	}
 	else
-		DepthFirstSearch(root_);
+		DepthFirstSearch(BranchWrapper(root_));
+	ReleaseContraction(fullContraction);
+	fullContraction = NULL;
+
+	//restoring the cut of the optimal leaf if other branches were evaluated after it
+	if((segmentation || packed) && !bestInGraph)
+		SolveBranchGraph(bestBranch);
 
+	reusable->GetSegmentation(segmentation, packed);
 
-	delete currentBgUnaries;
-	delete currentFgUnaries;
+	ScratchFree(currentBgUnaries);
+	ScratchFree(currentFgUnaries);
 	currentBgUnaries = NULL;
 	currentFgUnaries = NULL;
 
@@ -190,17 +1278,158 @@ Branch *BranchAndMincut(int imwidth, int imheight,
 	if(nCalls)
 		*nCalls = statFlowCalls;
 
+	statSearchTime += double(clock()-searchStart)/CLOCKS_PER_SEC;
+
 //	printf("Time spent in Branch-And-Mincut is %lf sec\n", double(clock()-start)/CLOCKS_PER_SEC);
 	return bestBranch;
 }
 
+Branch *BranchAndMincut(int imwidth, int imheight, 
+					  Branch *root, int *segmentation, 
+					  bool bestFirst, Branch *initialGuess, 
+					  gtype *pairwise, 
+					  gtype *commonUnaries,
+					  int *nCalls, bool reuseFlow)
+{
+	assert(imwidth == imWidth && imheight == imHeight);
+	return RunBranchAndMincut(root, segmentation, NULL, bestFirst, initialGuess, pairwise, commonUnaries, nCalls, reuseFlow);
+}
+
+//state of a parametric sweep
+struct SweepState
+{
+	Branch *br;
+	const gtype *offsets;
+	gtype *bgUnaries, *fgUnaries, *branchFgUnaries;
+	int *segmentation;
+	int *level;
+	gtype *energies;
+	std::vector<int> fgCount; //size of the foreground for the solved offsets, -1 for the others
+	int nFlows;
+};
+
+static void SolveSweepOffset(SweepState& s, int k)
+{
+	int i, count = 0, imsize = imWidth*imHeight;
+	for(i = 0; i < imsize; i++)
+		s.fgUnaries[i] = s.branchFgUnaries[i]+s.offsets[k];
+	s.energies[k] = reusable->Solve(s.bgUnaries, s.fgUnaries)+s.br->GetConstant();
+	s.nFlows++;
+
+	reusable->GetSegmentation(s.segmentation, NULL);
+	for(i = 0; i < imsize; i++)
+		if(s.segmentation[i])
+		{
+			count++;
+			if(s.level[i] < k+1)
+				s.level[i] = k+1;
+		}
+	s.fgCount[k] = count;
+}
+
+//the offsets lo and hi are solved. Nested segmentations of the same size are equal,
+//then the segmentation and the energy (linear in the offset) are known for all offsets between them
+static void SweepRange(SweepState& s, int lo, int hi)
+{
+	if(hi-lo < 2)
+		return;
+	if(s.fgCount[lo] == s.fgCount[hi])
+	{
+		for(int k = lo+1; k < hi; k++)
+			s.energies[k] = s.energies[lo]+(s.offsets[k]-s.offsets[lo])*s.fgCount[lo];
+		return;
+	}
+	int mid = (lo+hi)/2;
+	SolveSweepOffset(s, mid);
+	SweepRange(s, lo, mid);
+	SweepRange(s, mid, hi);
+}
+
+int ParametricSweep(Branch *br, const gtype *offsets, int count, int *level, gtype *energies)
+{
+	int imsize = imWidth*imHeight;
+	SweepState s;
+	s.br = br;
+	s.offsets = offsets;
+	s.bgUnaries = new gtype[imsize];
+	s.fgUnaries = new gtype[imsize];
+	s.branchFgUnaries = new gtype[imsize];
+	s.segmentation = new int[imsize];
+	s.level = level;
+	s.energies = energies;
+	s.fgCount.assign(count, -1);
+	s.nFlows = 0;
+
+	br->GetUnaries(imWidth, imHeight, s.bgUnaries, s.branchFgUnaries);
+	memset(level, 0, sizeof(int)*imsize);
+	if(count > 0)
+	{
+		SolveSweepOffset(s, 0);
+		if(count > 1)
+			SolveSweepOffset(s, count-1);
+		SweepRange(s, 0, count-1);
+	}
+	bestInGraph = false;
+
+	delete[] s.bgUnaries;
+	delete[] s.fgUnaries;
+	delete[] s.branchFgUnaries;
+	delete[] s.segmentation;
+	return s.nFlows;
+}
+
+void GetBranchAndMincutTimes(double *graphTime, double *searchTime)
+{
+	*graphTime = statGraphTime;
+	*searchTime = statSearchTime;
+}
+
+Branch *BranchAndMincut(int imwidth, int imheight, Branch *root, PackedMask& segmentation,
+					  bool bestFirst, Branch *initialGuess, gtype *pairwise, gtype *commonUnaries, int *nCalls, bool reuseFlow)
+{
+	assert(imwidth == imWidth && imheight == imHeight);
+	return RunBranchAndMincut(root, NULL, &segmentation, bestFirst, initialGuess, pairwise, commonUnaries, nCalls, reuseFlow);
+}
+
 ////////////////////////////////////////////
 
 
-gtype EvaluateBound(Branch *br)
+//sets the unary terms of the branch in the graph (the full one or the contracted one) and computes the maxflow
+//(without the constant term)
+gtype SolveBranchGraph(Branch *br, Contraction *contraction)
+{
+//updating unary terms in the graph
+	br->GetUnaries(imWidth, imHeight, currentBgUnaries, currentFgUnaries);
+	if(hardForeground)
+	{
+		size_t k;
+		for(k = 0; k < hardForeground->size(); k++)
+			currentBgUnaries[(*hardForeground)[k]] += HARD_CONSTRAINT;
+		for(k = 0; k < hardBackground->size(); k++)
+			currentFgUnaries[(*hardBackground)[k]] += HARD_CONSTRAINT;
+	}
+
+//evaluating lower bound by pushing flow
+	gtype flow;
+	if(contraction)
+	{
+		flow = SolveContraction(contraction, currentBgUnaries, currentFgUnaries)+contraction->fixedCost;
+		for(int i = 0; i < imWidth*imHeight; i++)
+			if(contraction->labels[i] >= 0)
+				flow += contraction->labels[i] ? currentFgUnaries[i] : currentBgUnaries[i];
+	}
+	else
+		flow = reusable->Solve(currentBgUnaries, currentFgUnaries);
+	bestInGraph = false;
+	return flow;
+}
+
+//solved is set to true if the bound was computed by a maxflow (then the graph holds its cut)
+gtype EvaluateBound(Branch *br, bool *solved, Contraction *contraction)
 {
 	statFlowCalls++;
-	int i, x, y, imsize = imWidth*imHeight;
+	if(solved)
+		*solved = false;
 
 	if(br->SkipEvaluation())
 	{
@@ -219,39 +1448,20 @@ gtype EvaluateBound(Branch *br)
 		return upperBound+EPSILON;
 	}
 
-//updating unary terms in the graph
-	br->GetUnaries(currentBgUnaries, currentFgUnaries);
-	
-	for(y = 0, i = 0; y < imHeight; y++)
-		for(x = 0; x < imWidth; x++,i++)
-		{
-			gtype unaryUpdateBg = currentBgUnaries[i]-reusable.bgUnaries[i];
-			gtype unaryUpdateFg = currentFgUnaries[i]-reusable.fgUnaries[i];
-			reusable.bgUnaries[i] = currentBgUnaries[i];
-			reusable.fgUnaries[i] = currentFgUnaries[i];
-			if(unaryUpdateBg || unaryUpdateFg)
-			{
-				reusable.graph->add_tweights(i, unaryUpdateFg, unaryUpdateBg);
-				
-				if(reusable.maxflowWasCalled)
-					reusable.graph->mark_node(i);
-			}
-		}
-
-//evaluating lower bound by pushing flow
-	boundVal = reusable.graph->maxflow(reusable.maxflowWasCalled, NULL)+constant;
-	reusable.maxflowWasCalled = true;
+	boundVal = SolveBranchGraph(br, contraction)+constant;
 	br->bound = boundVal;
+	if(solved)
+		*solved = true;
 	
 	if(br->IsLeaf() && boundVal < upperBound)
 	{
-		//the new candidate for a global minimum
+		//the new candidate for a global minimum. The segmentation is not copied here,
+		//it is recovered from the graph (or a single extra maxflow) when the search ends
 		upperBound = boundVal;
 		if(bestBranch)
 			delete bestBranch;
 		br->Clone(&bestBranch);
-		for(i = 0; i < imsize; i++)
-			bestSegm[i] = (int)reusable.graph->what_segment(i);
+		bestInGraph = !contraction; //a contracted graph has no cut of the whole image
 //		printf("Bound value = %lf\n", double(boundVal));
 	}
 
@@ -260,64 +1470,385 @@ gtype EvaluateBound(Branch *br)
 
 //////////////////////////////////////////////
 
-bool BestFirstSearch()
+bool BestFirstSearch(FRONT_QUEUE& frontQueue)
 {
-	Branch *br = frontQueue.top().br;
+	if(frontQueue.empty())
+		return false;
+
+	BranchWrapper w = frontQueue.top();
+	Branch *br = w.br;
 //	printf("%d\t%d\n", br->bound, frontQueue.size());
-	frontQueue.pop();
 
-	if(br->IsLeaf())
+	//a leaf on top has the lowest bound, no branch can have a leaf below the incumbent
+	if(br->IsLeaf() || br->bound >= upperBound)
 	{
 //		printf("Minimum found!\n");
 		return false;
 	}
+	frontQueue.pop();
 	
+	int checked;
+	Contraction *contraction = ChildContraction(w, &checked);
 	Branch *br1, *br2;
 	br->BranchFurther(&br1, &br2);
 	delete br;
+	ReleaseContraction(w.contraction);
 
-	EvaluateBound(br1);
-	frontQueue.push(BranchWrapper(br1));
+	//branches that cannot improve on the incumbent are not queued
+	EvaluateBound(br1, NULL, contraction);
+	if(br1->bound < upperBound)
+		frontQueue.push(BranchWrapper(br1, AcquireContraction(contraction), w.depth+1, checked));
+	else
+		delete br1;
 
-	EvaluateBound(br2);
-	frontQueue.push(BranchWrapper(br2));
+	EvaluateBound(br2, NULL, contraction);
+	if(br2->bound < upperBound)
+		frontQueue.push(BranchWrapper(br2, AcquireContraction(contraction), w.depth+1, checked));
+	else
+		delete br2;
 
+	ReleaseContraction(contraction);
 	return true;
 }
 
 
 
-void DepthFirstSearch(Branch *br)
+void DepthFirstSearch(const BranchWrapper& w)
 {
-	if(br->IsLeaf())
+	if(w.br->IsLeaf())
+	{
+		ReleaseContraction(w.contraction);
 		return;
+	}
 
+	int checked;
+	Contraction *contraction = ChildContraction(w, &checked);
 	Branch *br1, *br2;
-	br->BranchFurther(&br1, &br2);
+	w.br->BranchFurther(&br1, &br2);
 
-	delete br;
+	delete w.br;
+	ReleaseContraction(w.contraction);
 	
-	EvaluateBound(br1);
-	EvaluateBound(br2);
+	EvaluateBound(br1, NULL, contraction);
+	EvaluateBound(br2, NULL, contraction);
+	BranchWrapper w1(br1, AcquireContraction(contraction), w.depth+1, checked);
+	BranchWrapper w2(br2, AcquireContraction(contraction), w.depth+1, checked);
+	ReleaseContraction(contraction);
+
+	//the branch with the lower bound first, the upper bound may have dropped below the other one then
+	const BranchWrapper& first = br1->bound < br2->bound ? w1 : w2;
+	const BranchWrapper& second = br1->bound < br2->bound ? w2 : w1;
+	if(first.br->bound < upperBound)
+		DepthFirstSearch(first);
+	else
+	{
+		delete first.br;
+		ReleaseContraction(first.contraction);
+	}
+	if(second.br->bound < upperBound)
+		DepthFirstSearch(second);
+	else
+	{
+		delete second.br;
+		ReleaseContraction(second.contraction);
+	}
+}
+
 
-	if(br1->bound < br2->bound)
+//////////////////////////////////////////////
+
+//interactive sessions
+
+//a frontier branch of a session
+struct SessionEntry
+{
+	Branch *br;
+	PackedMask *cut; //cut of the bound evaluation, NULL if there was no maxflow or the cut was dropped
+	int version; //version of the constraints the bound was computed for
+	int solved; //version of the constraints of the maxflow that gave the bound, -1 if the bound needed no maxflow
+};
+
+struct SessionEntryGreater
+{
+	bool operator()(const SessionEntry& a, const SessionEntry& b) const { return a.br->bound > b.br->bound; }
+};
+
+typedef std::priority_queue<SessionEntry, std::vector<SessionEntry>, SessionEntryGreater> SESSION_QUEUE;
+
+struct BranchAndMincutSession::State
+{
+	int width, height;
+	FlowGraph *graph;
+	Branch *root;
+	SESSION_QUEUE frontier;
+	Branch *best; //optimum of the last Solve, NULL before the first one
+	std::vector<signed char> labels; //constraint of each pixel, -1 for none
+	std::vector<int> foreground, background; //pixels with the constraints
+	std::vector<int> slot; //index of each constrained pixel in foreground or background
+	std::vector<int> setVersion; //version at which the constraint of each pixel was set
+	std::vector<std::pair<int,int> > removed; //[set, removed) versions of the constraints removed since the last Solve
+	int version; //incremented by every edit
+	int bestVersion; //version of the constraints best->bound was computed for
+	double cutMargin; //the cuts of the branches above the optimum by more than this fraction of it are dropped
+	bool restart; //the frontier has to be built (before the first Solve)
+	gtype *bgUnaries, *fgUnaries;
+};
+
+static void EvaluateEntry(SessionEntry& e, int version)
+{
+	bool solved;
+	EvaluateBound(e.br, &solved);
+	if(solved)
 	{
-		if(br1->bound < upperBound)
-		{
-			DepthFirstSearch(br1);
-			if(br2->bound < upperBound)
-				DepthFirstSearch(br2);
-		}
+		if(!e.cut)
+			e.cut = new PackedMask;
+		reusable->GetSegmentation(NULL, e.cut);
+		e.solved = version;
 	}
 	else
 	{
-		if(br2->bound < upperBound)
+		delete e.cut;
+		e.cut = NULL;
+		e.solved = -1;
+	}
+	e.version = version;
+}
+
+//the bound of a branch can be lowered by the removal of a constraint only if the constraint was there when its cut
+//was computed. removed holds the merged, sorted [set, removed) intervals of the removed constraints
+static bool CutUsedRemoved(const SessionEntry& e, const std::vector<std::pair<int,int> >& removed)
+{
+	if(e.solved < 0)
+		return false; //the bound did not need a maxflow, it does not depend on the constraints
+	std::vector<std::pair<int,int> >::const_iterator k =
+		std::upper_bound(removed.begin(), removed.end(), std::make_pair(e.solved, INT_MAX));
+	return k != removed.begin() && e.solved < (k-1)->second;
+}
+
+//the bound of a branch does not change with new constraints if its cut satisfies them
+static bool SatisfiesConstraints(const PackedMask& cut, const std::vector<int>& foreground, const std::vector<int>& background)
+{
+	size_t k;
+	for(k = 0; k < foreground.size(); k++)
+		if(!cut.Get(foreground[k]))
+			return false;
+	for(k = 0; k < background.size(); k++)
+		if(cut.Get(background[k]))
+			return false;
+	return true;
+}
+
+//drops the cuts of the frontier branches with bounds above limit. Such a branch is only evaluated again if the
+//optimum rises above its bound after new constraints (or its bound may have been lowered by a removed constraint,
+//which its solved version still tells), so the frontier does not keep a mask for every pruned branch
+static void DropCuts(SESSION_QUEUE& frontier, gtype limit)
+{
+	std::vector<SessionEntry> entries;
+	for(; !frontier.empty(); frontier.pop())
+		entries.push_back(frontier.top());
+	for(size_t k = 0; k < entries.size(); k++)
+	{
+		SessionEntry& e = entries[k];
+		if(e.cut && e.br->bound > limit)
 		{
-			DepthFirstSearch(br2);
-			if(br1->bound < upperBound)
-				DepthFirstSearch(br1);
+			delete e.cut;
+			e.cut = NULL;
 		}
-	}	
+		frontier.push(e);
+	}
 }
 
+static void ClearFrontier(SESSION_QUEUE& frontier)
+{
+	while(!frontier.empty())
+	{
+		SessionEntry e = frontier.top();
+		frontier.pop();
+		delete e.br;
+		delete e.cut;
+	}
+}
 
+BranchAndMincutSession::BranchAndMincutSession(int imwidth, int imheight, Branch *root, gtype *pairwise, gtype *commonUnaries,
+											   double cutMargin)
+{
+	assert(imwidth == imWidth && imheight == imHeight && reusable);
+	clock_t start = clock();
+
+	state = new State;
+	State& s = *state;
+	s.width = imwidth;
+	s.height = imheight;
+	s.graph = reusable;
+	root->Clone(&s.root);
+	s.best = NULL;
+	s.labels.assign(imwidth*imheight, -1);
+	s.slot.resize(imwidth*imheight);
+	s.setVersion.resize(imwidth*imheight);
+	s.version = 0;
+	s.bestVersion = -1;
+	s.cutMargin = cutMargin;
+	s.restart = true;
+	s.bgUnaries = new gtype[imwidth*imheight];
+	s.fgUnaries = new gtype[imwidth*imheight];
+
+	reusable->Reset(pairwise, commonUnaries, false);
+	statGraphTime += double(clock()-start)/CLOCKS_PER_SEC;
+}
+
+BranchAndMincutSession::~BranchAndMincutSession()
+{
+	ClearFrontier(state->frontier);
+	delete state->root;
+	delete state->best;
+	delete[] state->bgUnaries;
+	delete[] state->fgUnaries;
+	delete state;
+}
+
+void BranchAndMincutSession::SetHardConstraint(int i, int label)
+{
+	State& s = *state;
+	assert(i >= 0 && i < s.width*s.height && label >= -1 && label <= 1);
+	if(s.labels[i] == label)
+		return;
+
+	s.version++;
+	if(s.labels[i] >= 0)
+	{
+		//the last pixel of the list takes the place of i
+		std::vector<int>& pixels = s.labels[i] ? s.foreground : s.background;
+		pixels[s.slot[i]] = pixels.back();
+		s.slot[pixels.back()] = s.slot[i];
+		pixels.pop_back();
+		s.removed.push_back(std::make_pair(s.setVersion[i], s.version));
+	}
+	if(label >= 0)
+	{
+		std::vector<int>& pixels = label ? s.foreground : s.background;
+		s.slot[i] = (int)pixels.size();
+		pixels.push_back(i);
+		s.setVersion[i] = s.version;
+	}
+	s.labels[i] = (signed char)label;
+}
+
+Branch *BranchAndMincutSession::Solve(PackedMask& segmentation, int *nCalls)
+{
+	State& s = *state;
+	assert(reusable == s.graph);
+	clock_t start = clock();
+
+	imWidth = s.width;
+	imHeight = s.height;
+	currentBgUnaries = s.bgUnaries;
+	currentFgUnaries = s.fgUnaries;
+	hardForeground = &s.foreground;
+	hardBackground = &s.background;
+	statFlowCalls = 0;
+
+	//the previous optimum is the first incumbent, with its energy for the current constraints
+	bestBranch = NULL;
+	upperBound = INFTY;
+	if(s.best && s.bestVersion == s.version)
+	{
+		bestBranch = s.best;
+		upperBound = s.best->bound;
+	}
+	else if(s.best)
+	{
+		EvaluateBound(s.best);
+		delete s.best;
+	}
+	s.best = NULL;
+
+	if(s.restart)
+	{
+		ClearFrontier(s.frontier);
+		SessionEntry e;
+		s.root->Clone(&e.br);
+		e.cut = NULL;
+		EvaluateEntry(e, s.version);
+		s.frontier.push(e);
+		s.restart = false;
+	}
+	else if(!s.removed.empty())
+	{
+		//removed constraints can lower the bounds of the branches whose cut was computed with them; these are
+		//evaluated again now, the others keep their bounds
+		std::sort(s.removed.begin(), s.removed.end());
+		size_t k, merged = 0;
+		for(k = 1; k < s.removed.size(); k++)
+			if(s.removed[k].first <= s.removed[merged].second)
+				s.removed[merged].second = std::max(s.removed[merged].second, s.removed[k].second);
+			else
+				s.removed[++merged] = s.removed[k];
+		s.removed.resize(merged+1);
+
+		std::vector<SessionEntry> entries;
+		for(; !s.frontier.empty(); s.frontier.pop())
+			entries.push_back(s.frontier.top());
+		for(k = 0; k < entries.size(); k++)
+		{
+			if(CutUsedRemoved(entries[k], s.removed))
+				EvaluateEntry(entries[k], s.version);
+			s.frontier.push(entries[k]);
+		}
+	}
+	s.removed.clear();
+
+	//best-first search over the kept frontier. The bounds computed for older constraints are still lower bounds
+	//(constraints were only added since), they are brought up to date when they get to the top
+	for(;;)
+	{
+		SessionEntry e = s.frontier.top();
+		if(e.version != s.version)
+		{
+			s.frontier.pop();
+			if(e.cut && SatisfiesConstraints(*e.cut, s.foreground, s.background))
+				e.version = s.version;
+			else
+				EvaluateEntry(e, s.version);
+			s.frontier.push(e);
+			continue;
+		}
+		if(e.br->IsLeaf() || e.br->bound >= upperBound)
+		{
+			//a leaf whose bound was kept is not the incumbent yet
+			if(e.br->IsLeaf() && e.br->bound < upperBound)
+			{
+				delete bestBranch;
+				e.br->Clone(&bestBranch);
+				upperBound = e.br->bound;
+			}
+			break;
+		}
+		s.frontier.pop();
+
+		//all the branches are kept, the ones above the incumbent may be needed after the next edits
+		SessionEntry e1, e2;
+		e.br->BranchFurther(&e1.br, &e2.br);
+		delete e.br;
+		delete e.cut;
+		e1.cut = e2.cut = NULL;
+		EvaluateEntry(e1, s.version);
+		s.frontier.push(e1);
+		EvaluateEntry(e2, s.version);
+		s.frontier.push(e2);
+	}
+
+	SolveBranchGraph(bestBranch);
+	reusable->GetSegmentation(NULL, &segmentation);
+	bestBranch->bound = upperBound;
+	s.best = bestBranch;
+	s.bestVersion = s.version;
+	DropCuts(s.frontier, upperBound + gtype(s.cutMargin*abs(upperBound)));
+
+	bestBranch = NULL;
+	currentBgUnaries = currentFgUnaries = NULL;
+	hardForeground = hardBackground = NULL;
+	if(nCalls)
+		*nCalls = statFlowCalls;
+	statSearchTime += double(clock()-start)/CLOCKS_PER_SEC;
+	return s.best;
+}
@@ -19,9 +19,11 @@ Implemented by Victor Lempitsky, 2008
 typedef int gtype; //working type, can be int, double or integer
 const gtype INFTY = 1 << 29; //a large value
 const gtype EPSILON = 1; //a small value
+const gtype HARD_CONSTRAINT = INFTY; //unary cost of violating a hard constraint
 typedef Graph<gtype,gtype,gtype> GraphT;
 
 extern int imWidth, imHeight; //global variables corresponding to image dimensions
+#pragma omp threadprivate(imWidth, imHeight) //like all the state of the search, they are separate for each thread
 
 
 //main class, implements a branch, i.e. a node in the tree
@@ -30,6 +32,8 @@ class Branch
 public:
 	gtype bound;
 
+	virtual ~Branch() {} //the branches are deleted through Branch pointers
+
 	virtual bool IsLeaf() = 0; //needs to be defined. Should return true if the node
 	
 	virtual void BranchFurther(Branch **br1_, Branch **br2_) = 0; //needs to be defined. Should return two branches of teh same type corresponding to the subtrees
@@ -40,12 +44,122 @@ public:
 
 	virtual bool SkipEvaluation() { return false; } //can be redefined. If returns true, the bound is not evaluated and is assumed -infinity
 	
-	virtual void GetUnaries(gtype *bgUnaries, gtype *fgUnaries) = 0; //needs to be defined. Should fill in the arrays of aggregated unary potentials
-																	//for the background and for the foreground
+	virtual void GetUnaries(int imwidth, int imheight, gtype *bgUnaries, gtype *fgUnaries) = 0; //needs to be defined. Should fill in the
+																	//arrays of aggregated unary potentials for the background and for the foreground of the imwidth x imheight pixels
+
+	virtual bool GetUnaryRange(gtype *, gtype *) { return false; } //can be redefined. Should fill in the smallest (minDiff) and the largest
+																	//(maxDiff) difference fgUnaries-bgUnaries of each pixel over all the leaves of the branch
+																	//(needed for the contraction, see SetContraction)
+};
+
+//binary segmentation stored with one bit per pixel: pixel i (row-major) is bit (i & 31) of bits[i >> 5]
+class PackedMask
+{
+public:
+	int width;
+	int height;
+	unsigned int *bits;
+
+	PackedMask(): width(0), height(0), bits(NULL) {}
+	~PackedMask() { delete[] bits; }
+
+	int WordCount() const { return (width*height+31) >> 5; }
+	void Resize(int w, int h) //all pixels are set to background
+	{
+		if((w*h+31) >> 5 != WordCount())
+		{
+			delete[] bits;
+			bits = new unsigned int[(w*h+31) >> 5];
+		}
+		width = w;
+		height = h;
+		memset(bits, 0, sizeof(unsigned int)*WordCount());
+	}
+	int Get(int i) const { return (bits[i >> 5] >> (i & 31)) & 1; }
+
+private:
+	PackedMask(const PackedMask&);
+	PackedMask& operator=(const PackedMask&);
+};
+
+//maxflow algorithm used for the bound evaluations
+enum MaxflowType
+{
+	MAXFLOW_BK,				//Boykov-Kolmogorov augmenting paths with search tree reuse (maxflow\graph.h)
+	MAXFLOW_PUSH_RELABEL,	//highest-label push-relabel, the preflow is kept between evaluations (PushRelabel.h)
+	MAXFLOW_IBFS			//incremental breadth-first search with search tree reuse (IBFS.h)
+};
+
+//order in which the pixels are stored as graph nodes (the arcs are laid out in the same order).
+//Only the memory layout of the graph changes, the unaries and the segmentation stay in the image order.
+enum NodeOrder
+{
+	NODE_ORDER_ROWS,	//row by row, neighbours in the next row are a full row apart
+	NODE_ORDER_TILES,	//NODE_TILE*NODE_TILE tiles, row by row inside and between the tiles
+	NODE_ORDER_MORTON	//Z-order curve
+};
+#define NODE_TILE 16
+
+#define GRAPH_POOL 2 //graphs kept for reuse by PrepareGraph in each thread (e.g. for a thumbnail and the full image)
+
+//pixel neighbourhood of the graph. Every undirected edge is stored once in the pairwise array, at the pixel
+//it starts from; the edges of a pixel go to (x+dx, y+dy) for the offsets given by GetNeighbourOffset:
+//4-connected: right, bottom
+//8-connected: top-right, right, bottom-right, bottom
+//16-connected: the 8-connected ones, then (1,-2), (2,-1), (2,1), (1,2)
+//The volume neighbourhoods (see PrepareVolumeGraph) go to (x+dx, y+dy, z+dz):
+//6-connected: right, bottom, next slice
+//18-connected: the 8-connected ones in the slice, then (0,0,1), (1,0,1), (-1,0,1), (0,1,1), (0,-1,1)
+//26-connected: the 8-connected ones in the slice, then the 9 voxels of the next slice row by row, (-1,-1,1) to (1,1,1)
+enum Neighbourhood
+{
+	NEIGHBOURHOOD_4 = 4,
+	NEIGHBOURHOOD_8 = 8,
+	NEIGHBOURHOOD_16 = 16,
+	NEIGHBOURHOOD_6 = 6,
+	NEIGHBOURHOOD_18 = 18,
+	NEIGHBOURHOOD_26 = 26
+};
+int NeighbourEdges(Neighbourhood nb); //number of pairwise values per pixel
+bool IsVolumeNeighbourhood(Neighbourhood nb);
+void GetNeighbourOffset(Neighbourhood nb, int k, int *dx, int *dy, int *dz = NULL); //dz is 0 for the image neighbourhoods
+//weight of the k-th edge for the Euclidean boundary length (Cauchy-Crofton formula as in Boykov, Kolmogorov,
+//"Computing Geodesics and Minimal Surfaces via Graph Cuts", ICCV 2003), 1 for a horizontal edge of the 8-connected grid.
+//For the volume neighbourhoods it is the weight for the surface area, 1 for an axis edge of the 26-connected grid
+double EuclideanEdgeWeight(Neighbourhood nb, int k);
+
+//edges between the region of the graph and the pixels outside of it (see PrepareGraph)
+enum RegionBoundary
+{
+	REGION_BOUNDARY_FREE,		//are dropped, the segmentation can meet the border of the region at no cost
+	REGION_BOUNDARY_BACKGROUND,	//are cut if the pixel inside is foreground, as if the pixels outside were background
+	REGION_BOUNDARY_FOREGROUND	//are cut if the pixel inside is background
 };
 
-//these two functions should be called before and after all procedures (or in the case if the image size changes)
-void PrepareGraph(int imwidth, int imheight);
+//these two functions should be called before and after all procedures (or in the case if the image size changes).
+//PrepareGraph keeps the graphs of the last GRAPH_POOL different sizes (and algorithms, orders, neighbourhoods, regions);
+//for one of them the next runs only copy back the initial capacities (with the pairwise terms that changed) instead of rebuilding it.
+//Every thread has its own graphs and search state, so different threads can segment different images at once;
+//ReleaseGraph frees the graphs of the calling thread.
+//region (imwidth*imheight bytes, NULL for all the pixels) restricts the graph to its nonzero pixels: the others get no
+//nodes, their unaries are ignored and they are background in the segmentations. To make the graph and the time scale with
+//a small region, crop the image to the bounding box of the region first (with a margin of 2 pixels for a fixed boundary)
+void PrepareGraph(int imwidth, int imheight, MaxflowType maxflowType = MAXFLOW_BK, NodeOrder nodeOrder = NODE_ORDER_ROWS,
+				  Neighbourhood neighbourhood = NEIGHBOURHOOD_8, const unsigned char *region = NULL,
+				  RegionBoundary boundary = REGION_BOUNDARY_FREE);
+//approximate graph of superpixels (for previews): superpixels[imwidth*imheight] gives 0..count-1 for every pixel (e.g. from
+//ComputeSuperpixels). Each superpixel is one node taking the sum of the unaries of its pixels, and two touching superpixels
+//are joined by one edge with the sum of the pairwise terms between their pixels. The segmentations are returned per pixel
+//as usual and the energies are exact for them, but only segmentations made of whole superpixels are searched.
+//The graph is pooled like the others; the persistency contractions (SetContraction) are not used on it
+void PrepareSuperpixelGraph(int imwidth, int imheight, const int *superpixels, MaxflowType maxflowType = MAXFLOW_BK,
+							Neighbourhood neighbourhood = NEIGHBOURHOOD_8);
+//graph of a width x height x depth volume, stored (for the unaries, the pairwise terms and the segmentations) as the
+//image of its slices one below the other: imwidth = width, imheight = height*depth, and the pairwise terms of a voxel
+//follow the volume neighbourhood. The graph is a Boykov-Kolmogorov maxflow on the grid with implicit neighbours
+//(GridGraph.h), which takes about a seventh of the memory of the arc lists in the 26-connected grid, whatever
+//maxflowType the other graphs use. It is pooled like the others; the persistency contractions are not used on it
+void PrepareVolumeGraph(int width, int height, int depth, Neighbourhood neighbourhood = NEIGHBOURHOOD_6);
 void ReleaseGraph();
 
 //main function
@@ -53,11 +167,85 @@ void ReleaseGraph();
 Branch * //output - globally optimal branch(node) of the tree. Should be deleted afterwards.
 	BranchAndMincut(int imwidth, int imheight, //input image sizes (should be the same as in the call to PrepareGraphs
 					  Branch *root, //root branch
-					  int *segmentation,  //output: globally optimal segmentation. For each pixel either 1(foreground) or 0(background).
-					  bool bestFirst, Branch *initialGuess, //branch-and-bound variations bestFirst/depthFirst, initialGuess needed only if the bestFirst=false
-					  gtype *pairwise, //pairwise terms. For each pixel (including boundary) - 4 edge-strength values: top-right, right, bottom-right, bottom. Edges going outside the grid are simply ignored.
+					  int *segmentation,  //output: globally optimal segmentation. For each pixel either 1(foreground) or 0(background). Can be NULL.
+					  bool bestFirst, Branch *initialGuess, //branch-and-bound variations bestFirst/depthFirst. initialGuess (a leaf or NULL) is the first incumbent, e.g. the optimum for similar parameters; branches with bounds above its energy are pruned
+					  gtype *pairwise, //pairwise terms. For each pixel (including boundary) - NeighbourEdges edge-strength values in the order of GetNeighbourOffset (for the 8-neighbourhood: top-right, right, bottom-right, bottom). Edges going outside the grid are simply ignored.
 					  gtype *commonUnaries,//foreground unaries independent on the branch. For each pixel - a value.
-					  int *nCalls //output: number of calls to the lower bound evaluation (including leaf branch-nodes)
+					  int *nCalls, //output: number of calls to the lower bound evaluation (including leaf branch-nodes)
+					  bool reuseFlow = false //keep the flow of the previous call instead of starting from the initial capacities, see below
 					  ); 
 
+//same as above, but the segmentation is returned as a packed bitmask (resized to the image)
+Branch *BranchAndMincut(int imwidth, int imheight, Branch *root, PackedMask& segmentation,
+					  bool bestFirst, Branch *initialGuess, gtype *pairwise, gtype *commonUnaries, int *nCalls, bool reuseFlow = false);
+
+//reuseFlow is only allowed if the previous call used the same graph (size and PrepareGraph options), pairwise terms and
+//commonUnaries, e.g. for the next frame of a video. The graph then keeps the residual capacities and the search trees of the
+//last evaluation of that call, and the first evaluation only revisits the pixels whose unaries differ from it (for a leaf
+//initialGuess with the same parameters, the pixels whose intensity changed).
+
+//Parametric sweep for a leaf branch br (normally the one returned by the last BranchAndMincut call, which must have
+//left the graph prepared). The increasing values offsets[0..count-1] are added in turn to the foreground unary of every
+//pixel; the optimal segmentations are then nested (the foreground shrinks), so they are described by
+//level[i] = the number of offsets for which pixel i is foreground (it is foreground for offsets[0..level[i]-1]).
+//energies[k] is the optimal energy for offsets[k]. The search bisects the range between the offsets with different
+//segmentations, so only O(breakpoints*log(count)) maxflows are computed, each starting from the flow of the previous one.
+//Returns the number of maxflows.
+int ParametricSweep(Branch *br, const gtype *offsets, int count, int *level, gtype *energies);
+
+//total time in seconds spent by all BranchAndMincut calls of the calling thread in building (or restoring) the graph and in the search
+void GetBranchAndMincutTimes(double *graphTime, double *searchTime);
+
+//Persistency-based graph contraction for the BranchAndMincut calls of the calling thread (off by default).
+//The unary terms of all the leaves below a branch lie between those of two extreme leaves, the one most biased to the
+//foreground and the one most biased to the background (see Branch::GetUnaryRange). When a branch is split, these two
+//are solved: the pixels outside the largest optimal foreground of the first one are background and the pixels inside
+//the smallest optimal foreground of the second one are foreground in every optimal segmentation of every leaf below.
+//They are contracted into the terminals, and the subtree is evaluated on a smaller Boykov-Kolmogorov graph of the other
+//pixels (whatever maxflow PrepareGraph selected). The bounds only get tighter and the leaf energies stay exact.
+//The contraction is redone every period levels below the last one, and kept only if it fixes enough new pixels
+void SetContraction(bool enable, int period = 3);
+
+//contractions of the last BranchAndMincut call of the calling thread: counts[d] were computed for branches at depth d
+//(the root is at depth 0) and fixed ratios[d] of the pixels on average. Fills maxDepth entries and returns the
+//number of depths with contractions
+int GetContractionStats(int *counts, double *ratios, int maxDepth);
+
+//Interactive segmentation with hard constraints (e.g. scribbles). The session keeps the graph with its flow and search trees,
+//the incumbent and the whole frontier of the best-first search between the calls to Solve, which then continues the search.
+//A new constraint makes a HARD_CONSTRAINT t-link of the pixel, so it only changes the maxflows at the marked pixels, and it can
+//only raise the bounds: the frontier branches near the optimum keep the cut of their evaluation, and only the branches whose
+//cut violates one of the constraints (or was dropped, see below) are re-evaluated, when they get to the top of the queue. Removing or changing a constraint can only lower
+//the bounds of the branches whose cut was computed while the constraint was there; the next Solve re-evaluates these
+//(including the pruned ones, all the frontier is kept) before it continues, and keeps the other bounds. An erase right
+//after its stroke costs about as many evaluations as the stroke did, but erasing an old constraint that most of the
+//frontier was computed with re-evaluates most of the frontier, which can come close to a fresh search.
+//The session uses the graph of the calling thread prepared by PrepareGraph for this image, nothing else may use the graph
+//while the session exists. A frontier branch stores its cut in imwidth*imheight/8 bytes only while its bound is within
+//cutMargin (a fraction of the optimum) above the optimum; the others keep the version of their evaluation, so they are
+//evaluated again if a stroke raises the optimum above them or an erase may have lowered their bound. The frontier itself
+//is bounded by the search tree of the root. Updates that move the optimum take 55-90% of the evaluations of a fresh
+//search (about 200 ms on a 132x102 image), so the session is not interactive in general.
+class BranchAndMincutSession
+{
+public:
+	//same arguments as BranchAndMincut (best-first search), nothing is solved yet
+	BranchAndMincutSession(int imwidth, int imheight, Branch *root, gtype *pairwise, gtype *commonUnaries,
+						   double cutMargin = 0.01);
+	~BranchAndMincutSession();
+
+	//label 1 forces the pixel i (row-major) to the foreground, 0 to the background, -1 removes its constraint
+	void SetHardConstraint(int i, int label);
+
+	//globally optimal leaf under the current constraints (owned by the session, valid until the next call)
+	Branch *Solve(PackedMask& segmentation, int *nCalls = NULL);
+
+private:
+	struct State;
+	State *state;
+
+	BranchAndMincutSession(const BranchAndMincutSession&);
+	BranchAndMincutSession& operator=(const BranchAndMincutSession&);
+};
+
 #endif
\ No newline at end of file
@@ -13,15 +13,45 @@ Implemented by Victor Lempitsky, 2008
 
 
 #include "ChanVeseSegmentation.h"
+#include "imageio.h"
+#include "SegmentationOutput.h"
+#include "BatchSegmentation.h"
+#include "Superpixels.h"
+#include "TiledMincut.h"
+#include "ScratchStorage.h"
+#ifndef NO_OPENCV
 #include "image.h"
+#endif
 #include <math.h>
 #include <algorithm>
 #include <time.h>
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 gtype ChanVeseBranch::mu; //bias
 gtype ChanVeseBranch::lambda; //smoothness
 
+static MaxflowType maxflowType = MAXFLOW_BK; //maxflow algorithm for all runs
+static NodeOrder nodeOrder = NODE_ORDER_ROWS; //memory layout of the graph for all runs
+static Neighbourhood neighbourhood = NEIGHBOURHOOD_8; //pixel neighbourhood for all runs
+static const unsigned char *segRegion = NULL; //region of the image being segmented by SegmentChanVeseRegion, NULL for all
+static RegionBoundary segBoundary = REGION_BOUNDARY_FREE;
+static const int *segSuperpixels = NULL; //superpixels of the image being segmented by SegmentChanVeseSuperpixels
+static int segDepth = 0; //slices of the volume being segmented by SegmentChanVeseVolume, 0 for an image
+static Neighbourhood segVolumeNeighbourhood = NEIGHBOURHOOD_6;
+static int segEnergyShift = 0; //the unaries, lambda and mu of the volume are divided by 2^segEnergyShift
+#pragma omp threadprivate(segRegion, segBoundary, segSuperpixels, segDepth, segVolumeNeighbourhood, segEnergyShift)
+
+//neighbourhood of the graph of the current run
+static Neighbourhood graphNeighbourhood() {
+	return segDepth ? segVolumeNeighbourhood : neighbourhood;
+}
+
 //splitting the branch
 void ChanVeseBranch::BranchFurther(Branch **br1_, Branch **br2_)
 {
@@ -38,14 +68,21 @@ void ChanVeseBranch::BranchFurther(Branch **br1_, Branch **br2_)
 	br2->maxb = maxb;
 	br1->image = image;
 	br2->image = image;
+	br1->image8 = image8;
+	br2->image8 = image8;
+	br1->image16 = image16;
+	br2->image16 = image16;
+	br1->step = br2->step = step;
+	br1->unaryShift = br2->unaryShift = unaryShift;
+	//the halves end and start on the lattice of the means
 	if(maxf-minf > maxb-minb) {
-		br1->maxf = (maxf+minf)/2;
-		br2->minf = br1->maxf+1;
+		br1->maxf = minf+(maxf-minf)/step/2*step;
+		br2->minf = br1->maxf+step;
 		br1->maxb = maxb;
 		br2->minb = minb;
 	} else {
-		br1->maxb = (maxb+minb)/2;
-		br2->minb = br1->maxb+1;
+		br1->maxb = minb+(maxb-minb)/step/2*step;
+		br2->minb = br1->maxb+step;
 		br1->maxf = maxf;
 		br2->minf = minf;
 	}
@@ -60,96 +97,350 @@ inline gtype dist2segment(gtype val, gtype minSegm, gtype maxSegm)
 	return val-maxSegm;
 }
 
-//computing aggregated unary potentials for each pixel
-void ChanVeseBranch::GetUnaries(gtype *bgUnaries, gtype *fgUnaries)
+//squared difference, divided by 2^shift (rounded) for deep images
+inline gtype scaledSquare(gtype d, int shift)
+{
+	if(!shift) return d*d;
+	return (gtype)(((long long)d*d+(1LL << (shift-1))) >> shift);
+}
+
+//computing aggregated unary potentials for each pixel, T is the pixel storage type
+template<class T> void ChanVeseUnaries(const T* image, int size, int minb, int maxb, int minf, int maxf, int shift,
+										 gtype *bgUnaries, gtype *fgUnaries)
+{
+	for(int i = 0; i < size; i++)
+	{
+		bgUnaries[i] = scaledSquare(dist2segment(image[i], minb, maxb), shift);
+		fgUnaries[i] = scaledSquare(dist2segment(image[i], minf, maxf), shift);
+	}
+}
+
+void ChanVeseBranch::GetUnaries(int imwidth, int imheight, gtype *bgUnaries, gtype *fgUnaries)
+{
+	if(image8)
+		ChanVeseUnaries(image8, imwidth*imheight, minb, maxb, minf, maxf, unaryShift, bgUnaries, fgUnaries);
+	else if(image16)
+		ChanVeseUnaries(image16, imwidth*imheight, minb, maxb, minf, maxf, unaryShift, bgUnaries, fgUnaries);
+	else
+		ChanVeseUnaries(image, imwidth*imheight, minb, maxb, minf, maxf, unaryShift, bgUnaries, fgUnaries);
+}
+
+//the foreground unary of a leaf is (I-c_f)^2 and the background one (I-c_b)^2, the difference is the smallest for
+//the closest c_f and the farthest c_b
+template<class T> void ChanVeseUnaryRange(const T* image, int minb, int maxb, int minf, int maxf, int shift,
+										   gtype *minDiff, gtype *maxDiff)
 {
 	for(int i = 0; i < imWidth*imHeight; i++)
 	{
-		bgUnaries[i] = dist2segment(image[i], minb, maxb);
-		bgUnaries[i] *= bgUnaries[i];
-		fgUnaries[i] = dist2segment(image[i], minf, maxf);
-		fgUnaries[i] *= fgUnaries[i];
+		gtype val = image[i];
+		gtype nearb = dist2segment(val, minb, maxb), farb = std::max(abs(val-minb), abs(val-maxb));
+		gtype nearf = dist2segment(val, minf, maxf), farf = std::max(abs(val-minf), abs(val-maxf));
+		minDiff[i] = scaledSquare(nearf, shift)-scaledSquare(farb, shift);
+		maxDiff[i] = scaledSquare(farf, shift)-scaledSquare(nearb, shift);
 	}
 }
 
-double calcMean(int* image, int w, int h) {
-	double total = 0;
-	for (int i = 0;i < w; ++i){
-		for (int j = 0; j < h; ++j){
-			total += image[i*h+j];
+bool ChanVeseBranch::GetUnaryRange(gtype *minDiff, gtype *maxDiff)
+{
+	if(image8)
+		ChanVeseUnaryRange(image8, minb, maxb, minf, maxf, unaryShift, minDiff, maxDiff);
+	else if(image16)
+		ChanVeseUnaryRange(image16, minb, maxb, minf, maxf, unaryShift, minDiff, maxDiff);
+	else
+		ChanVeseUnaryRange(image, minb, maxb, minf, maxf, unaryShift, minDiff, maxDiff);
+	return true;
+}
+
+void MakeColourTable(const unsigned char *bgr, int w, int h, int bits, ColourTable& table)
+{
+	int n = w*h, i, c;
+	table.shift = 8-std::max(1, std::min(8, bits));
+	//bins of the quantised colours, numbered in the order of the first pixel
+	std::vector<int> bin(1 << (3*(8-table.shift)), -1);
+	std::vector<double> sums;
+	table.counts.clear();
+	table.index.resize(n);
+	for(i = 0; i < n; i++)
+	{
+		const unsigned char *p = bgr+3*i;
+		int key = 0;
+		for(c = 2; c >= 0; c--)
+			key = key << (8-table.shift) | p[c] >> table.shift;
+		if(bin[key] < 0)
+		{
+			bin[key] = table.Size();
+			table.counts.push_back(0);
+			sums.resize(sums.size()+3, 0);
+		}
+		table.index[i] = bin[key];
+		table.counts[bin[key]]++;
+		for(c = 0; c < 3; c++)
+			sums[3*bin[key]+c] += p[c];
+	}
+	table.colours.resize(3*table.Size());
+	for(i = 0; i < table.Size(); i++)
+		for(c = 0; c < 3; c++)
+			table.colours[3*i+c] = (unsigned char)(sums[3*i+c]/table.counts[i]+0.5);
+}
+
+void ColourChanVeseBranch::GetBox(int *lowb, int *highb, int *lowf, int *highf)
+{
+	int half = (1 << colours->shift) >> 1;
+	for(int c = 0; c < 3; c++)
+	{
+		lowb[c] = (minb[c] << colours->shift)+half;
+		highb[c] = (maxb[c] << colours->shift)+half;
+		lowf[c] = (minf[c] << colours->shift)+half;
+		highf[c] = (maxf[c] << colours->shift)+half;
+	}
+}
+
+//the squared distances of the colours to the boxes
+void ColourChanVeseBranch::GetUnaries(int imwidth, int imheight, gtype *bgUnaries, gtype *fgUnaries)
+{
+	int k, c, nColours = colours->Size();
+	int lowb[3], highb[3], lowf[3], highf[3];
+	GetBox(lowb, highb, lowf, highf);
+	std::vector<gtype> bg(nColours), fg(nColours);
+	for(k = 0; k < nColours; k++)
+	{
+		const unsigned char *colour = &colours->colours[3*k];
+		bg[k] = fg[k] = 0;
+		for(c = 0; c < 3; c++)
+		{
+			gtype db = dist2segment(colour[c], lowb[c], highb[c]), df = dist2segment(colour[c], lowf[c], highf[c]);
+			bg[k] += db*db;
+			fg[k] += df*df;
+		}
+	}
+	const int *index = &colours->index[0];
+	for(int i = 0; i < imwidth*imheight; i++)
+	{
+		bgUnaries[i] = bg[index[i]];
+		fgUnaries[i] = fg[index[i]];
+	}
+}
+
+//as ChanVeseUnaryRange, with the nearest and the farthest point of the box in every channel
+bool ColourChanVeseBranch::GetUnaryRange(gtype *minDiff, gtype *maxDiff)
+{
+	int k, c, nColours = colours->Size();
+	int lowb[3], highb[3], lowf[3], highf[3];
+	GetBox(lowb, highb, lowf, highf);
+	std::vector<gtype> lower(nColours), upper(nColours);
+	for(k = 0; k < nColours; k++)
+	{
+		const unsigned char *colour = &colours->colours[3*k];
+		lower[k] = upper[k] = 0;
+		for(c = 0; c < 3; c++)
+		{
+			gtype val = colour[c];
+			gtype nearb = dist2segment(val, lowb[c], highb[c]), farb = std::max(abs(val-lowb[c]), abs(val-highb[c]));
+			gtype nearf = dist2segment(val, lowf[c], highf[c]), farf = std::max(abs(val-lowf[c]), abs(val-highf[c]));
+			lower[k] += nearf*nearf-farb*farb;
+			upper[k] += farf*farf-nearb*nearb;
 		}
 	}
-	return total / (w*h);
+	const int *index = &colours->index[0];
+	for(int i = 0; i < imWidth*imHeight; i++)
+	{
+		minDiff[i] = lower[index[i]];
+		maxDiff[i] = upper[index[i]];
+	}
+	return true;
 }
 
-ChanVeseBranch* runBranchAndMincut(int* image, int w, int h, gtype lambda, gtype mu, 
-								   int** segm, ChanVeseBranch root) {
-	int* segment = new int[w*h];
+//The widest of the six ranges is halved (as ChanVeseBranch does with two). This replaced splitting the range that
+//tightens the bound the most, which kept halving the same narrow ranges and left the others wide; that bound is now
+//only the tie-break among the ranges of the same width: the bound without the pairwise terms (every colour takes
+//the cheaper label) is computed for both halves, and the range whose worse half has the largest such bound wins
+void ColourChanVeseBranch::BranchFurther(Branch **br1_, Branch **br2_)
+{
+	int k, c, s, nColours = colours->Size(), half = (1 << colours->shift) >> 1;
+	int lowb[3], highb[3], lowf[3], highf[3];
+	GetBox(lowb, highb, lowf, highf);
+	//squared distances to the box per colour and channel
+	std::vector<gtype> db(3*nColours), df(3*nColours);
+	for(k = 0; k < nColours; k++)
+		for(c = 0; c < 3; c++)
+		{
+			gtype val = colours->colours[3*k+c];
+			db[3*k+c] = dist2segment(val, lowb[c], highb[c]);
+			db[3*k+c] *= db[3*k+c];
+			df[3*k+c] = dist2segment(val, lowf[c], highf[c]);
+			df[3*k+c] *= df[3*k+c];
+		}
+
+	int bestSide = 0, bestChannel = 0, bestWidth = 0;
+	double bestBound = -1;
+	for(s = 0; s < 2; s++)
+		for(c = 0; c < 3; c++)
+		{
+			int lo = s ? minf[c] : minb[c], hi = s ? maxf[c] : maxb[c], mid = (lo+hi)/2;
+			if(hi-lo < bestWidth || lo >= hi)
+				continue;
+			//the halves in colour units
+			gtype end1 = (mid << colours->shift)+half, start2 = ((mid+1) << colours->shift)+half;
+			gtype low = (lo << colours->shift)+half, high = (hi << colours->shift)+half;
+			double bound1 = 0, bound2 = 0;
+			for(k = 0; k < nColours; k++)
+			{
+				gtype val = colours->colours[3*k+c];
+				gtype bg = db[3*k]+db[3*k+1]+db[3*k+2], fg = df[3*k]+df[3*k+1]+df[3*k+2]+ChanVeseBranch::mu;
+				gtype d1 = dist2segment(val, low, end1), d2 = dist2segment(val, start2, high);
+				if(s)
+				{
+					fg -= df[3*k+c];
+					bound1 += double(colours->counts[k])*std::min(bg, fg+d1*d1);
+					bound2 += double(colours->counts[k])*std::min(bg, fg+d2*d2);
+				}
+				else
+				{
+					bg -= db[3*k+c];
+					bound1 += double(colours->counts[k])*std::min(bg+d1*d1, fg);
+					bound2 += double(colours->counts[k])*std::min(bg+d2*d2, fg);
+				}
+			}
+			double bound = std::min(bound1, bound2);
+			if(hi-lo > bestWidth || bound > bestBound)
+			{
+				bestBound = bound;
+				bestSide = s;
+				bestChannel = c;
+				bestWidth = hi-lo;
+			}
+		}
 
-	ChanVeseBranch::lambda = lambda; //smoothness in the Chan-Vese functional
-	ChanVeseBranch::mu = mu; //bias in the Chan-Vese functional 
+	ColourChanVeseBranch *br1 = new ColourChanVeseBranch(*this);
+	ColourChanVeseBranch *br2 = new ColourChanVeseBranch(*this);
+	*br1_ = br1;
+	*br2_ = br2;
+	int *max1 = bestSide ? br1->maxf : br1->maxb, *min2 = bestSide ? br2->minf : br2->minb;
+	max1[bestChannel] = ((bestSide ? minf : minb)[bestChannel]+(bestSide ? maxf : maxb)[bestChannel])/2;
+	min2[bestChannel] = max1[bestChannel]+1;
+}
+
+//mean over the pixels of the region (nonzero), all the pixels for NULL
+template<class T> double calcMean(T* image, int w, int h, const unsigned char* region = NULL) {
+	double total = 0;
+	int count = 0;
+	for (int i = 0; i < w*h; ++i){
+		if (!region || region[i]) {
+			total += image[i];
+			++count;
+		}
+	}
+	return count ? total / count : 0;
+}
 
-	gtype *unaries = new gtype[w*h]; //array for branch independent unary terms
-	gtype *pairwise = new gtype[w*h*4]; //array for pairwise terms
+//branch independent terms of the functional: mu as the foreground unary and the edge weights of the boundary length
+static void makeTerms(int w, int h, gtype lambda, gtype mu, gtype *unaries, gtype *pairwise) {
+	Neighbourhood nb = graphNeighbourhood();
+	int k, edges = NeighbourEdges(nb);
+	gtype weights[16];
 
+	//creating contrast-independent (Euclidean-regularization) edge links. The 8-neighbourhood keeps the truncated
+	//weights of the original code (lambda and lambda/sqrt(2)), the other neighbourhoods are rounded
+	for(k = 0; k < edges; k++)
+	{
+		double weight = lambda*EuclideanEdgeWeight(nb, k)/(1 << segEnergyShift);
+		weights[k] = gtype(nb == NEIGHBOURHOOD_8 ? weight : weight+0.5);
+	}
+	gtype bias = gtype(floor(double(mu)/(1 << segEnergyShift)+0.5));
 	for(int i = 0; i < w*h; i++)
 	{
-		unaries[i] = gtype(ChanVeseBranch::mu);
-		//creating contrast-independent (Euclidean-regularization) edge links
-		pairwise[4*i] = pairwise[4*i+2] = gtype(ChanVeseBranch::lambda); //horizonta and vertical edges
-		pairwise[4*i+1] = pairwise[4*i+3] = gtype(ChanVeseBranch::lambda/sqrt(2.0)); //diagonal edges
+		unaries[i] = bias;
+		for(k = 0; k < edges; k++)
+			pairwise[edges*i+k] = weights[k];
 	}
-	PrepareGraph(w, h);
-	int nCalls;
-	ChanVeseBranch *resultLeaf = (ChanVeseBranch *)BranchAndMincut(
-		w, h, &root, segment, true, NULL, pairwise, unaries, &nCalls); //main function call
-	delete[] pairwise;
-	delete[] unaries;
+}
 
+//segm can be NULL if only the optimal (c_b, c_f) is needed, then no segmentation is extracted.
+//initialGuess is a leaf for the same image (e.g. the optimum for a close lambda) or NULL.
+//reuseFlow continues from the graph of the previous run, which must have had the same size, lambda and mu.
+//B is the branch type (ChanVeseBranch or ColourChanVeseBranch), root carries the pixels
+template<class B> B* runBranchAndMincut(int w, int h, gtype lambda, gtype mu, 
+								   PackedMask* segm, B root, B* initialGuess = NULL,
+								   bool reuseFlow = false) {
+	//arrays for branch independent unary terms and for pairwise terms (scratch storage, as large as the graph)
+	gtype *unaries = (gtype *)ScratchAlloc(sizeof(gtype)*w*h);
+	gtype *pairwise = (gtype *)ScratchAlloc(sizeof(gtype)*w*h*NeighbourEdges(graphNeighbourhood()));
+	makeTerms(w, h, lambda, mu, unaries, pairwise);
+	if (segDepth)
+		PrepareVolumeGraph(w, h/segDepth, segDepth, segVolumeNeighbourhood);
+	else if (segSuperpixels)
+		PrepareSuperpixelGraph(w, h, segSuperpixels, maxflowType, neighbourhood);
+	else
+		PrepareGraph(w, h, maxflowType, nodeOrder, neighbourhood, segRegion, segBoundary);
+	int nCalls;
+	B *resultLeaf;
 	if (segm == NULL) {
-		delete[] segment;
+		resultLeaf = (B *)BranchAndMincut(
+			w, h, &root, (int *)NULL, true, initialGuess, pairwise, unaries, &nCalls, reuseFlow); //main function call
 	} else {
-		*segm = segment;
+		resultLeaf = (B *)BranchAndMincut(
+			w, h, &root, *segm, true, initialGuess, pairwise, unaries, &nCalls, reuseFlow);
 	}
+	ScratchFree(pairwise);
+	ScratchFree(unaries);
 	return resultLeaf;
 }
 
-ChanVeseBranch* thumbsnailEstimate(const char* path, gtype lambda, gtype mu, int** segm = NULL) {
-	int* image;
-	int w, h;
-	image = LoadImage8bpp<gtype>(path, w, h); 
-	if(!image)
-	{
-		puts("Invalid path to the test image!");
-		return NULL;
+//loads an 8-bit grayscale image. 8-bit PGM files are memory mapped and used in place,
+//other formats are decoded into an aligned buffer. The image stays alive until the program exits.
+const unsigned char* loadGray8(const char* path, int& w, int& h) {
+	MappedImage mapped;
+	if (MapImage(path, mapped)) {
+		w = mapped.width;
+		h = mapped.height;
+		return mapped.pixels;
 	}
-	double mean = calcMean(image,w,h);
+	return LoadImageAligned<unsigned char>(path, w, h);
+}
+
+ChanVeseBranch* thumbsnailEstimate(const unsigned char* image, int w, int h, gtype lambda, gtype mu, PackedMask* segm = NULL) {
+	double mean = calcMean(image,w,h,segRegion);
 	ChanVeseBranch root;
+	root.bound = 0;
 	root.minb = 0;
 	root.maxb = (int)mean;
 	root.minf = (int)mean + 1;
 	root.maxf = 255;
-	root.image = image;
-	return runBranchAndMincut(image, w, h, lambda/2, mu, segm, root);
+	root.image8 = image;
+	return runBranchAndMincut(w, h, lambda/2, mu, segm, root);
 }
 
-bool calcSSD(int* image, int w, int h, int b, int f, int bound){
+ChanVeseBranch* thumbsnailEstimate(const char* path, gtype lambda, gtype mu, PackedMask* segm = NULL) {
+	const unsigned char* image;
+	int w, h;
+	image = loadGray8(path, w, h); 
+	if(!image)
+	{
+		puts("Invalid path to the test image!");
+		return NULL;
+	}
+	return thumbsnailEstimate(image, w, h, lambda, mu, segm);
+}
+
+template<class T> bool calcSSD(T* image, int w, int h, int b, int f, int bound){
 	int total = 0;
 	for (int i = 0; i < w*h; ++i){
-		if (abs(image[i] - f) > abs(image[i] - b)) {
-			total += (image[i] - b) * (image[i] - b);
+		int v = image[i];
+		if (abs(v - f) > abs(v - b)) {
+			total += (v - b) * (v - b);
 		} else {
-			total += (image[i] - f) * (image[i] - f);
+			total += (v - f) * (v - f);
 		}
 		if (total >= bound) return false;
 	}
 	return true;
 }
 
-ChanVeseBranch* calcFeasibleRegion(int* image, int w, int h, int bound) {
+ChanVeseBranch* calcFeasibleRegion(const unsigned char* image, int w, int h, int bound) {
 	double mean = calcMean(image, w, h);
 	ChanVeseBranch root;
-	root.image = image;
+	root.bound = 0;
+	root.image8 = image;
 	root.minb = -1;
 	root.maxb = -1;
 	root.minf = -1;
@@ -193,27 +484,20 @@ ChanVeseBranch* calcFeasibleRegion(int* image, int w, int h, int bound) {
 	return &root;
 }
 
-ChanVeseBranch* origImageSeg(const char* path, int lambda, int mu, int** segm,
+ChanVeseBranch* origImageSeg(const unsigned char* image, int w, int h, int lambda, int mu, PackedMask* segm,
 							 int est_cf, int est_cb){
-	int* image;
-	int w, h;
-	image = LoadImage8bpp<gtype>(path, w, h); 
-	if(!image)
-	{
-		puts("Invalid path to the test image!");
-		return NULL;
-	}
 	ChanVeseBranch root;
+	root.bound = 0;
 	root.maxb = std::min(est_cb + 10, 255);
 	root.minb = std::max(0, est_cb - 10);
 	root.maxf = std::min(255, est_cf + 10);
 	root.minf = std::max(0, est_cf - 10);
-	root.image = image;
+	root.image8 = image;
 /*
 	printf("Estimating lower bound...");
 
 	ChanVeseBranch* resultLeaf = runBranchAndMincut(
-								image, w, h, lambda, mu, segm, root);
+								w, h, lambda, mu, segm, root);
 	int bound = resultLeaf->bound;
 
 	printf("done.\nLower bound = %d.\n\n", bound);
@@ -225,59 +509,1078 @@ ChanVeseBranch* origImageSeg(const char* path, int lambda, int mu, int** segm,
 	printf("Feasible region: c_b in [%d, %d], c_f in [%d, %d].\n\n",
 		root.minb, root.maxb, root.minf, root.maxf);
 */
-	ChanVeseBranch* resultLeaf = runBranchAndMincut(image, w, h, lambda, mu, segm, root);
+	ChanVeseBranch* resultLeaf = runBranchAndMincut(w, h, lambda, mu, segm, root);
+	return resultLeaf;
+}
+
+ChanVeseBranch* origImageSeg(const char* path, int lambda, int mu, PackedMask* segm,
+							 int est_cf, int est_cb){
+	const unsigned char* image;
+	int w, h;
+	image = loadGray8(path, w, h); 
+	if(!image)
+	{
+		puts("Invalid path to the test image!");
+		return NULL;
+	}
+	return origImageSeg(image, w, h, lambda, mu, segm, est_cf, est_cb);
+}
+
+//replays a scribble file on a BranchAndMincutSession for the image, with the search window of origImageSeg.
+//Every line "f x y r" or "b x y r" constrains the pixels within the radius r of (x, y) to the foreground or the background,
+//"e x y r" erases the constraints there. The segmentation is updated after every stroke, segm gets the last one
+ChanVeseBranch* scribbleSession(const char* path, const char* scribbleFile, int lambda, int mu, PackedMask* segm,
+								int est_cf, int est_cb) {
+	int w, h;
+	const unsigned char* image = loadGray8(path, w, h);
+	FILE* file = fopen(scribbleFile, "r");
+	if (!image || !file) {
+		puts(image ? "Cannot read the scribble file!" : "Invalid path to the test image!");
+		if (file)
+			fclose(file);
+		return NULL;
+	}
+	ChanVeseBranch root;
+	root.bound = 0;
+	root.maxb = std::min(est_cb + 10, 255);
+	root.minb = std::max(0, est_cb - 10);
+	root.maxf = std::min(255, est_cf + 10);
+	root.minf = std::max(0, est_cf - 10);
+	root.image8 = image;
+
+	gtype *unaries = new gtype[w*h];
+	gtype *pairwise = new gtype[w*h*NeighbourEdges(neighbourhood)];
+	makeTerms(w, h, lambda, mu, unaries, pairwise);
+	PrepareGraph(w, h, maxflowType, nodeOrder, neighbourhood);
+
+	ChanVeseBranch* resultLeaf = NULL;
+	{
+		BranchAndMincutSession session(w, h, &root, pairwise, unaries);
+		int nCalls;
+		double time = -clock();
+		resultLeaf = (ChanVeseBranch *)session.Solve(*segm, &nCalls);
+		time = (time+clock())/CLOCKS_PER_SEC;
+		printf("\nstroke\tpixels\tenergy\t\tc_b\tc_f\tevaluations\tmsec\n");
+		printf("-\t0\t%d\t%d\t%d\t%d\t\t%.1lf\n", resultLeaf->bound, resultLeaf->minb, resultLeaf->minf, nCalls, 1000*time);
+
+		char type;
+		int cx, cy, r, stroke = 0;
+		while (fscanf(file, " %c %d %d %d", &type, &cx, &cy, &r) == 4) {
+			int label = type == 'f' ? 1 : type == 'b' ? 0 : -1, pixels = 0;
+			for (int y = std::max(0, cy - r); y <= std::min(h - 1, cy + r); ++y)
+				for (int x = std::max(0, cx - r); x <= std::min(w - 1, cx + r); ++x)
+					if ((x-cx)*(x-cx) + (y-cy)*(y-cy) <= r*r) {
+						session.SetHardConstraint(y*w+x, label);
+						++pixels;
+					}
+			time = -clock();
+			resultLeaf = (ChanVeseBranch *)session.Solve(*segm, &nCalls);
+			time = (time+clock())/CLOCKS_PER_SEC;
+			printf("%c%d\t%d\t%d\t%d\t%d\t%d\t\t%.1lf\n", type, ++stroke, pixels, resultLeaf->bound, resultLeaf->minb,
+				resultLeaf->minf, nCalls, 1000*time);
+		}
+		ChanVeseBranch* leaf = resultLeaf;
+		leaf->Clone((Branch **)&resultLeaf);
+	}
+	fclose(file);
+	delete[] pairwise;
+	delete[] unaries;
+	return resultLeaf;
+}
+
+ChanVeseBranch* SegmentChanVese(const unsigned char* image, int w, int h, int lambda, int mu, PackedMask* segm) {
+	ChanVeseBranch* estimate = thumbsnailEstimate(image, w, h, lambda, mu);
+	ChanVeseBranch* resultLeaf = origImageSeg(image, w, h, lambda, mu, segm, estimate->maxf, estimate->maxb);
+	delete estimate;
+	return resultLeaf;
+}
+
+ChanVeseBranch* SegmentChanVeseRegion(const unsigned char* image, int w, int h, const unsigned char* region,
+									  RegionBoundary boundary, int lambda, int mu, PackedMask* segm) {
+	//bounding box of the region, with the pixels outside of it that have edges to it for a fixed boundary
+	int x, y, x0 = w, y0 = h, x1 = -1, y1 = -1;
+	for (y = 0; y < h; ++y)
+		for (x = 0; x < w; ++x)
+			if (region[y*w+x]) {
+				x0 = std::min(x0, x);
+				x1 = std::max(x1, x);
+				y0 = std::min(y0, y);
+				y1 = std::max(y1, y);
+			}
+	if (x1 < 0)
+		return NULL;
+	if (boundary != REGION_BOUNDARY_FREE) {
+		x0 = std::max(0, x0 - 2);
+		y0 = std::max(0, y0 - 2);
+		x1 = std::min(w - 1, x1 + 2);
+		y1 = std::min(h - 1, y1 + 2);
+	}
+	int cw = x1 - x0 + 1, ch = y1 - y0 + 1;
+	unsigned char* crop = new unsigned char[cw*ch];
+	unsigned char* cropRegion = new unsigned char[cw*ch];
+	bool whole = true;
+	for (y = 0; y < ch; ++y)
+		for (x = 0; x < cw; ++x) {
+			crop[y*cw+x] = image[(y0+y)*w+x0+x];
+			cropRegion[y*cw+x] = region[(y0+y)*w+x0+x] != 0;
+			whole = whole && cropRegion[y*cw+x];
+		}
+
+	PackedMask cropSegm;
+	segRegion = whole ? NULL : cropRegion;
+	segBoundary = boundary;
+	ChanVeseBranch* resultLeaf = SegmentChanVese(crop, cw, ch, lambda, mu, segm ? &cropSegm : NULL);
+	segRegion = NULL;
+	segBoundary = REGION_BOUNDARY_FREE;
+	resultLeaf->image8 = NULL;
+
+	if (segm) {
+		segm->Resize(w, h);
+		for (y = 0; y < ch; ++y)
+			for (x = 0; x < cw; ++x)
+				if (cropSegm.Get(y*cw+x)) {
+					int i = (y0+y)*w+x0+x;
+					segm->bits[i >> 5] |= 1u << (i & 31);
+				}
+	}
+	delete[] crop;
+	delete[] cropRegion;
+	return resultLeaf;
+}
+
+static void setPixels(ChanVeseBranch& br, const unsigned char* image) {
+	br.image8 = image;
+}
+
+static void setPixels(ChanVeseBranch& br, const unsigned short* image) {
+	br.image16 = image;
+}
+
+//the estimate of the means of a volume with half the smoothness, on the volume at half the resolution (the means of
+//2x2x2 voxels). A coarse voxel stands for 8 voxels and its faces for 4 faces, so lambda/2 there keeps the balance of
+//the unaries and the boundary, and the estimate uses lambda/4
+template<class T> static ChanVeseBranch* volumeEstimate(const T* volume, int w, int h, int lambda, int mu, ChanVeseBranch root) {
+	int depth = segDepth, sh = h/depth, cw = (w+1)/2, ch = (sh+1)/2, cd = (depth+1)/2, x, y, z;
+	std::vector<T> coarse((size_t)cw*ch*cd);
+	for (z = 0; z < cd; ++z)
+		for (y = 0; y < ch; ++y)
+			for (x = 0; x < cw; ++x) {
+				int sum = 0, count = 0;
+				for (int k = 0; k < 8; ++k) {
+					int vx = 2*x + (k & 1), vy = 2*y + ((k >> 1) & 1), vz = 2*z + (k >> 2);
+					if (vx < w && vy < sh && vz < depth) {
+						sum += volume[((size_t)vz*sh + vy)*w + vx];
+						++count;
+					}
+				}
+				coarse[((size_t)z*ch + y)*cw + x] = (T)((sum + count/2) / count);
+			}
+	setPixels(root, &coarse[0]);
+	segDepth = cd;
+	ChanVeseBranch* estimate = runBranchAndMincut(cw, ch*cd, lambda/4, mu, (PackedMask*)NULL, root);
+	segDepth = depth;
+	return estimate;
+}
+
+//the search of SegmentChanVeseDeep for 8 or 16-bit pixels. With energyShift (for volumes) the unaries, lambda and mu
+//are also divided by the smallest power of 2 that keeps every cut below INFTY, which is returned
+template<class T> static ChanVeseBranch* segmentLattice(const T* image, int w, int h, int step, int lambda, int mu,
+														 PackedMask* segm, int* energyShift) {
+	int low = *std::min_element(image, image + w*h), high = *std::max_element(image, image + w*h);
+	int defaultStep = std::max(1, (high - low + 256) / 256);
+	if (step <= 0)
+		step = defaultStep;
+	//the lattice of the means covers low..high
+	int levels = (high - low + step - 1) / step;
+	ChanVeseBranch root;
+	root.bound = 0;
+	setPixels(root, image);
+	root.step = step;
+	while ((high - low) >> (root.unaryShift / 2) > 255)
+		root.unaryShift += 2;
+	if (energyShift) {
+		//no cut is above the cut with all the pixels in the background, whose unaries are the largest for c_b = low or
+		//c_b = high (they are convex in c_b): these cuts (plus INFTY for the branches with c_b > c_f) must not overflow.
+		//The optimum is not above the cut for c_b = mean, which has to stay well below INFTY
+		double mean = calcMean(image, w, h), lowSum = 0, highSum = 0, meanSum = 0, bias = std::max(0, -mu);
+		for (int i = 0; i < w*h; ++i) {
+			lowSum += scaledSquare(image[i] - low, root.unaryShift) + bias;
+			highSum += scaledSquare(image[i] - high, root.unaryShift) + bias;
+			meanSum += scaledSquare(image[i] - (int)(mean + 0.5), root.unaryShift) + bias;
+		}
+		*energyShift = 0;
+		while (*energyShift < 30 && (std::max(lowSum, highSum)/(1 << *energyShift) + 0.5*w*h > 2.0*INFTY ||
+									 meanSum/(1 << *energyShift) + 0.5*w*h > INFTY/2))
+			++*energyShift;
+		root.unaryShift += *energyShift;
+		segEnergyShift = *energyShift;
+	}
+
+	//c_b below and c_f above the mean, as in thumbsnailEstimate
+	int split = std::min(std::max(levels - 1, 0), (int)(calcMean(image, w, h) - low) / step);
+	root.minb = low;
+	root.maxb = low + split*step;
+	root.minf = levels ? root.maxb + step : low;
+	root.maxf = low + levels*step;
+	ChanVeseBranch* estimate = segDepth ? volumeEstimate(image, w, h, lambda, mu, root) :
+		runBranchAndMincut(w, h, lambda/2, mu, (PackedMask*)NULL, root);
+	//the estimate is at half the smoothness (and for a volume on the averaged voxels), so it is only good to about a
+	//step of 256 levels: a finer step still searches that window, in whole steps so that it stays on the lattice from low
+	int radius = (10*std::max(step, defaultStep) + step - 1) / step * step;
+	root.minb = std::max(low, estimate->minb - radius);
+	root.maxb = std::min(low + levels*step, estimate->minb + radius);
+	root.minf = std::max(low, estimate->minf - radius);
+	root.maxf = std::min(low + levels*step, estimate->minf + radius);
+	delete estimate;
+	ChanVeseBranch* resultLeaf = runBranchAndMincut(w, h, lambda, mu, segm, root);
+	segEnergyShift = 0;
+	return resultLeaf;
+}
+
+ChanVeseBranch* SegmentChanVeseDeep(const unsigned short* image, int w, int h, int step, int lambda, int mu,
+									PackedMask* segm) {
+	return segmentLattice(image, w, h, step, lambda, mu, segm, NULL);
+}
+
+ChanVeseBranch* SegmentChanVeseVolume(const unsigned char* volume, int w, int h, int depth, Neighbourhood nb,
+									  int lambda, int mu, PackedMask* segm, int* energyShift) {
+	int shift;
+	segDepth = depth;
+	segVolumeNeighbourhood = IsVolumeNeighbourhood(nb) ? nb : NEIGHBOURHOOD_6;
+	ChanVeseBranch* resultLeaf = segmentLattice(volume, w, h*depth, 1, lambda, mu, segm, energyShift ? energyShift : &shift);
+	segDepth = 0;
+	return resultLeaf;
+}
+
+ChanVeseBranch* SegmentChanVeseVolume(const unsigned short* volume, int w, int h, int depth, Neighbourhood nb,
+									  int step, int lambda, int mu, PackedMask* segm, int* energyShift) {
+	int shift;
+	segDepth = depth;
+	segVolumeNeighbourhood = IsVolumeNeighbourhood(nb) ? nb : NEIGHBOURHOOD_6;
+	ChanVeseBranch* resultLeaf = segmentLattice(volume, w, h*depth, step, lambda, mu, segm, energyShift ? energyShift : &shift);
+	segDepth = 0;
+	return resultLeaf;
+}
+
+//the mean colours of the background and of the foreground of segm in a leaf for the exact colours
+static void regionMeans(const unsigned char* bgr, int w, int h, const PackedMask& segm, ColourChanVeseBranch* leaf) {
+	double sums[2][3] = {{0, 0, 0}, {0, 0, 0}};
+	int counts[2] = {0, 0};
+	for (int i = 0; i < w*h; ++i) {
+		int label = segm.Get(i) ? 1 : 0;
+		counts[label]++;
+		for (int c = 0; c < 3; ++c)
+			sums[label][c] += bgr[3*i+c];
+	}
+	for (int c = 0; c < 3; ++c) {
+		leaf->minb[c] = leaf->maxb[c] = counts[0] ? (int)(sums[0][c]/counts[0]+0.5) : 0;
+		leaf->minf[c] = leaf->maxf[c] = counts[1] ? (int)(sums[1][c]/counts[1]+0.5) : 255;
+	}
+}
+
+ColourChanVeseBranch* SegmentChanVeseColour(const unsigned char* bgr, int w, int h, int bits, int lambda, int mu,
+											PackedMask* segm) {
+	ColourTable table, exact;
+	MakeColourTable(bgr, w, h, bits, table);
+	ColourChanVeseBranch root;
+	root.bound = 0;
+	root.colours = &table;
+	for (int c = 0; c < 3; ++c) {
+		root.minb[c] = root.minf[c] = 0;
+		root.maxb[c] = root.maxf[c] = 255 >> table.shift;
+	}
+	PackedMask local, next;
+	PackedMask* current = segm ? segm : &local;
+	ColourChanVeseBranch* resultLeaf = runBranchAndMincut(w, h, lambda, mu, current, root);
+
+	//Chan-Vese alternation on the exact colours: the means of the two regions, then the cut for them,
+	//while the energy decreases
+	MakeColourTable(bgr, w, h, 8, exact);
+	for (int iteration = 0; iteration < 10; ++iteration) {
+		ColourChanVeseBranch leaf;
+		leaf.bound = 0;
+		leaf.colours = &exact;
+		regionMeans(bgr, w, h, *current, &leaf);
+		ColourChanVeseBranch* polished = runBranchAndMincut(w, h, lambda, mu, &next, leaf);
+		if (iteration > 0 && polished->bound >= resultLeaf->bound) {
+			delete polished;
+			break;
+		}
+		delete resultLeaf;
+		resultLeaf = polished;
+		std::swap(current->bits, next.bits);
+	}
+	resultLeaf->colours = NULL;
+	return resultLeaf;
+}
+
+//the pixel segmentation for the means of the leaf (which is deleted): a leaf root takes a single maxflow
+static ChanVeseBranch* leafImageSeg(const unsigned char* image, int w, int h, int lambda, int mu, PackedMask* segm,
+									ChanVeseBranch* leaf) {
+	ChanVeseBranch root;
+	root.bound = 0;
+	root.minb = root.maxb = leaf->minb;
+	root.minf = root.maxf = leaf->minf;
+	root.image8 = image;
+	delete leaf;
+	return runBranchAndMincut(w, h, lambda, mu, segm, root);
+}
+
+ChanVeseBranch* SegmentChanVeseSuperpixels(const unsigned char* image, int w, int h, const int* superpixels, bool refine,
+										   int lambda, int mu, PackedMask* segm) {
+	segSuperpixels = superpixels;
+	ChanVeseBranch* resultLeaf = SegmentChanVese(image, w, h, lambda, mu, refine ? NULL : segm);
+	segSuperpixels = NULL;
+	return refine ? leafImageSeg(image, w, h, lambda, mu, segm, resultLeaf) : resultLeaf;
+}
+
+//preview of the image on superpixels (see SegmentChanVeseSuperpixels); reports the reduction of the graph nodes and,
+//with compare, the energy lost against the exact segmentation
+ChanVeseBranch* superpixelImageSeg(const char* path, int scale, int minSize, bool refine, bool compare,
+								   int lambda, int mu, PackedMask* segm) {
+	int w, h;
+	const unsigned char* image = loadGray8(path, w, h);
+	if (!image) {
+		puts("Invalid path to the test image!");
+		return NULL;
+	}
+	double time = -clock();
+	std::vector<int> superpixels(w*h);
+	int count = ComputeSuperpixels(image, w, h, scale, minSize, &superpixels[0]);
+	double superpixelTime = (time+clock())/CLOCKS_PER_SEC;
+	ChanVeseBranch* resultLeaf = SegmentChanVeseSuperpixels(image, w, h, &superpixels[0], false, lambda, mu,
+		refine ? NULL : segm);
+	time = (time+clock())/CLOCKS_PER_SEC;
+	printf("done.\n%d superpixels for %d pixels (%.1lfx fewer nodes), %.3lf sec (superpixels %.3lf sec).\n",
+		count, w*h, double(w*h)/count, time, superpixelTime);
+	printf("Superpixel energy = %d, c_b = %d, c_f = %d\n", resultLeaf->bound, resultLeaf->minb, resultLeaf->minf);
+
+	gtype superpixelEnergy = resultLeaf->bound;
+	if (refine) {
+		double refineTime = -clock();
+		resultLeaf = leafImageSeg(image, w, h, lambda, mu, segm, resultLeaf);
+		refineTime = (refineTime+clock())/CLOCKS_PER_SEC;
+		printf("Refined energy = %d, %.3lf sec.\n", resultLeaf->bound, refineTime);
+	}
+	if (compare) {
+		double exactTime = -clock();
+		ChanVeseBranch* exact = SegmentChanVese(image, w, h, lambda, mu, NULL);
+		exactTime = (exactTime+clock())/CLOCKS_PER_SEC;
+		double scale = 100.0/std::max(1, abs(exact->bound));
+		printf("Exact energy = %d, c_b = %d, c_f = %d, %.3lf sec; energy loss %.3lf%%", exact->bound, exact->minb,
+			exact->minf, exactTime, scale*(resultLeaf->bound-exact->bound));
+		if (refine)
+			printf(" (%.3lf%% before the refinement)", scale*(superpixelEnergy-exact->bound));
+		printf(".\n");
+		delete exact;
+	}
+	return resultLeaf;
+}
+
+//seconds of wall time (clock() adds up the times of all the threads)
+static double wallTime() {
+#ifdef _OPENMP
+	return omp_get_wtime();
+#else
+	return double(clock())/CLOCKS_PER_SEC;
+#endif
+}
+
+//the means of the foreground and of the background of segm, rounded (as the nearest integers minimize the unaries),
+//the means of the leaf for an empty region
+static void grayMeans(const unsigned char* image, int w, int h, const PackedMask& segm, ChanVeseBranch* leaf) {
+	double sums[2] = {0, 0};
+	int counts[2] = {0, 0};
+	for (int i = 0; i < w*h; ++i) {
+		int label = segm.Get(i);
+		counts[label]++;
+		sums[label] += image[i];
+	}
+	if (counts[0])
+		leaf->minb = leaf->maxb = (int)(sums[0]/counts[0]+0.5);
+	if (counts[1])
+		leaf->minf = leaf->maxf = (int)(sums[1]/counts[1]+0.5);
+}
+
+//the image at half the resolution, the means of 2x2 pixels
+static void halfResolution(const unsigned char* image, int w, int h, std::vector<unsigned char>& coarse) {
+	int cw = (w+1)/2, ch = (h+1)/2, x, y;
+	coarse.resize((size_t)cw*ch);
+	for (y = 0; y < ch; ++y)
+		for (x = 0; x < cw; ++x) {
+			int sum = 0, count = 0;
+			for (int k = 0; k < 4; ++k) {
+				int vx = 2*x + (k & 1), vy = 2*y + (k >> 1);
+				if (vx < w && vy < h) {
+					sum += image[(size_t)vy*w + vx];
+					++count;
+				}
+			}
+			coarse[(size_t)y*cw + x] = (unsigned char)((sum + count/2) / count);
+		}
+}
+
+//largest coarse image of tiledImageSeg: its search stays fast and its bounds stay below INFTY for 8-bit images
+static const int maxCoarsePixels = 512*512;
+
+//segmentation without a graph of the whole image: the search of SegmentChanVese on the image halved in resolution
+//until it has at most maxCoarsePixels pixels (a coarse pixel stands for 4 pixels and its edges for 2 edges, so lambda/2
+//per halving keeps the balance of the unaries and the boundary), then the Chan-Vese alternation at full resolution
+//with the cuts of TiledMincut: the means of the two regions, then the cut for them, while the energy decreases.
+//Neither the coarse means nor the tiled cuts are guaranteed to be optimal for the image. With verify the search and
+//the cut of the whole image for the means found are computed as well and compared (the search of SegmentChanVese is
+//only exact within its window around the thumbnail estimate, so it can be the higher one)
+ChanVeseBranch* tiledImageSeg(const char* path, int lambda, int mu, PackedMask* segm,
+							  int tileSize, int overlap, int seam, bool verify) {
+	int w, h;
+	const unsigned char* image = loadGray8(path, w, h);
+	if (!image) {
+		puts("Invalid path to the test image!");
+		return NULL;
+	}
+	std::vector<unsigned char> coarse, half;
+	const unsigned char* pixels = image;
+	int cw = w, ch = h, coarseLambda = lambda;
+	do {
+		halfResolution(pixels, cw, ch, half);
+		coarse.swap(half);
+		pixels = &coarse[0];
+		cw = (cw+1)/2;
+		ch = (ch+1)/2;
+		coarseLambda /= 2;
+	} while (cw*ch > maxCoarsePixels);
+	double coarseTime = -wallTime();
+	ChanVeseBranch* resultLeaf = SegmentChanVese(pixels, cw, ch, coarseLambda, mu, NULL);
+	coarseTime += wallTime();
+	resultLeaf->image8 = image;
+	printf("done.\nCoarse search (%dx%d): c_b = %d, c_f = %d, %.3lf sec.\n", cw, ch, resultLeaf->minb, resultLeaf->minf,
+		coarseTime);
+
+	gtype *unaries = (gtype *)ScratchAlloc(sizeof(gtype)*w*h);
+	gtype *pairwise = (gtype *)ScratchAlloc(sizeof(gtype)*w*h*NeighbourEdges(neighbourhood));
+	makeTerms(w, h, lambda, mu, unaries, pairwise);
+	double time = -wallTime();
+	gtype energy = TiledMincut(w, h, resultLeaf, pairwise, unaries, *segm, neighbourhood, tileSize, overlap, seam);
+	int cuts = 1;
+	PackedMask next;
+	for (; cuts < 10; ++cuts) {
+		ChanVeseBranch leaf = *resultLeaf;
+		grayMeans(image, w, h, *segm, &leaf);
+		if (leaf.minb == resultLeaf->minb && leaf.minf == resultLeaf->minf)
+			break;
+		gtype polished = TiledMincut(w, h, &leaf, pairwise, unaries, next, neighbourhood, tileSize, overlap, seam);
+		if (polished >= energy)
+			break;
+		energy = polished;
+		*resultLeaf = leaf;
+		std::swap(segm->bits, next.bits);
+	}
+	time += wallTime();
+	resultLeaf->bound = energy;
+	printf("Tiled cuts: %dx%d tiles, %d cuts, energy %d, c_b = %d, c_f = %d, %.3lf sec.\n", (w+tileSize-1)/tileSize,
+		(h+tileSize-1)/tileSize, cuts, energy, resultLeaf->minb, resultLeaf->minf, time);
+	ScratchFree(pairwise);
+	ScratchFree(unaries);
+
+	if (verify) {
+		PackedMask global;
+		ChanVeseBranch* copy;
+		resultLeaf->Clone((Branch **)&copy);
+		double globalTime = -wallTime();
+		copy = leafImageSeg(image, w, h, lambda, mu, &global, copy);
+		globalTime += wallTime();
+		int diff = 0;
+		for (int i = 0; i < w*h; ++i)
+			diff += segm->Get(i) != global.Get(i);
+		printf("Global cut for these means: energy %d, %.3lf sec; %s, %d pixels differ.\n", copy->bound, globalTime,
+			copy->bound == energy ? "exact" : "NOT exact", diff);
+		delete copy;
+		double exactTime = -wallTime();
+		ChanVeseBranch* exact = SegmentChanVese(image, w, h, lambda, mu, NULL);
+		exactTime += wallTime();
+		printf("Search of the whole image: energy %d, c_b = %d, c_f = %d, %.3lf sec; the tiled energy is %+.3lf%% off.\n",
+			exact->bound, exact->minb, exact->minf, exactTime, 100.0*(energy-exact->bound)/std::max(1, abs(exact->bound)));
+		delete exact;
+	}
+	return resultLeaf;
+}
+
+//largest -colour bits: with more the search does not finish in minutes even on small images (see performace_record.txt)
+static const int maxColourBits = 4;
+
+//segments the colours of the image (see SegmentChanVeseColour) and reports the number of distinct colours
+ColourChanVeseBranch* colourImageSeg(const char* path, int bits, int lambda, int mu, PackedMask* segm) {
+	int w, h;
+	if (!ReadImageSize(path, w, h)) {
+		puts("Invalid path to the test image!");
+		return NULL;
+	}
+	unsigned char* bgr = (unsigned char*)AllocAligned(3*w*h);
+	if (!DecodeImage(path, bgr, 3*w, PIXEL_BGR24)) {
+		FreeAligned(bgr);
+		puts("Invalid path to the test image!");
+		return NULL;
+	}
+	ColourTable table;
+	MakeColourTable(bgr, w, h, bits, table);
+	printf("%d colours (%d bits per channel) for %d pixels...", table.Size(), bits, w*h);
+	ColourChanVeseBranch* resultLeaf = SegmentChanVeseColour(bgr, w, h, bits, lambda, mu, segm);
+	FreeAligned(bgr);
 	return resultLeaf;
 }
 
-void visualize(const char* path, int* segm){
+//bit depth of the image file, 0 if it cannot be read
+static int imageDepth(const char* path) {
+	int w, h, depth;
+	return ReadImageSize(path, w, h, &depth) ? depth : 0;
+}
+
+//segments a deep gray image at its full depth (see SegmentChanVeseDeep). The image stays alive until the program
+//exits, as the leaf refers to it
+ChanVeseBranch* deepImageSeg(const char* path, int step, int lambda, int mu, PackedMask* segm) {
+	int w, h;
+	unsigned short* image = LoadImageAligned<unsigned short>(path, w, h);
+	if (!image) {
+		puts("Invalid path to the test image!");
+		return NULL;
+	}
+	printf("intensities %d..%d...", *std::min_element(image, image + w*h), *std::max_element(image, image + w*h));
+	return SegmentChanVeseDeep(image, w, h, step, lambda, mu, segm);
+}
+
+//segments the volume of the image of its slices (see SegmentChanVeseVolume), at the full depth for deep images.
+//The image stays alive until the program exits, as the leaf refers to it
+ChanVeseBranch* volumeImageSeg(const char* path, int depth, int step, int lambda, int mu, PackedMask* segm) {
+	int w, h;
+	bool deep = imageDepth(path) > 8;
+	const void* image = deep ? (const void*)LoadImageAligned<unsigned short>(path, w, h) : (const void*)loadGray8(path, w, h);
+	if (!image) {
+		puts("Invalid path to the test image!");
+		return NULL;
+	}
+	if (h % depth) {
+		printf("The image height %d is not a multiple of %d slices!\n", h, depth);
+		return NULL;
+	}
+	printf("%d x %d x %d voxels, %d-connected...", w, h/depth, depth, (int)neighbourhood);
+	int shift;
+	ChanVeseBranch* resultLeaf = deep ?
+		SegmentChanVeseVolume((const unsigned short*)image, w, h/depth, depth, neighbourhood, step, lambda, mu, segm, &shift) :
+		SegmentChanVeseVolume((const unsigned char*)image, w, h/depth, depth, neighbourhood, lambda, mu, segm, &shift);
+	if (shift)
+		printf("the energy is divided by 2^%d...", shift);
+	return resultLeaf;
+}
+
+//segments the region of the image given by a rectangle (roi[2] > 0) and/or a mask file (nonzero inside)
+ChanVeseBranch* regionImageSeg(const char* path, const int* roi, const char* regionFile, RegionBoundary boundary,
+							   int lambda, int mu, PackedMask* segm) {
+	int w, h, rw, rh, x, y;
+	const unsigned char* image = loadGray8(path, w, h);
+	if (!image) {
+		puts("Invalid path to the test image!");
+		return NULL;
+	}
+	std::vector<unsigned char> region(w*h, 1);
+	if (regionFile) {
+		const unsigned char* mask = loadGray8(regionFile, rw, rh);
+		if (!mask || rw != w || rh != h) {
+			puts("The region mask cannot be read or has another size than the image!");
+			return NULL;
+		}
+		for (int i = 0; i < w*h; ++i)
+			region[i] = mask[i] != 0;
+	}
+	if (roi[2] > 0)
+		for (y = 0; y < h; ++y)
+			for (x = 0; x < w; ++x)
+				if (x < roi[0] || x >= roi[0] + roi[2] || y < roi[1] || y >= roi[1] + roi[3])
+					region[y*w+x] = 0;
+	ChanVeseBranch* resultLeaf = SegmentChanVeseRegion(image, w, h, &region[0], boundary, lambda, mu, segm);
+	if (!resultLeaf)
+		puts("The region is empty!");
+	return resultLeaf;
+}
+
+ChanVeseSequence::ChanVeseSequence(int lambda_, int mu_, int window_)
+	: lambda(lambda_), mu(mu_), window(window_), last(NULL), width(0), height(0), fullSearch(false)
+{
+}
+
+ChanVeseSequence::~ChanVeseSequence()
+{
+	delete last;
+}
+
+ChanVeseBranch* ChanVeseSequence::AddFrame(const unsigned char* frame, int w, int h, PackedMask* segm) {
+	ChanVeseBranch* leaf = NULL;
+	fullSearch = !last || w != width || h != height;
+	if (!fullSearch) {
+		ChanVeseBranch root;
+		root.bound = 0;
+		root.maxb = std::min(last->minb + window, 255);
+		root.minb = std::max(0, last->minb - window);
+		root.maxf = std::min(255, last->minf + window);
+		root.minf = std::max(0, last->minf - window);
+		root.image8 = frame;
+		last->image8 = frame;
+		leaf = runBranchAndMincut(w, h, lambda, mu, segm, root, last, true);
+
+		//an optimum on the border of the window may be beaten by the means outside of it
+		fullSearch = (leaf->minb == root.minb && root.minb > 0) || (leaf->minb == root.maxb && root.maxb < 255) ||
+			(leaf->minf == root.minf && root.minf > 0) || (leaf->minf == root.maxf && root.maxf < 255);
+		if (fullSearch) {
+			delete leaf;
+			leaf = NULL;
+		}
+	}
+	if (!leaf)
+		leaf = SegmentChanVese(frame, w, h, lambda, mu, segm);
+
+	delete last;
+	last = leaf;
+	width = w;
+	height = h;
+	return leaf;
+}
+
+//sweeps mu over muFrom..muTo (with muStep) for the means of the leaf, on the graph of the last run.
+//Prints the ranges of mu with the same segmentation; with maskPrefix their masks are written to <maskPrefix><mu>.png
+void muSweep(ChanVeseBranch *leaf, int muFrom, int muTo, int muStep, const char *maskPrefix, const char *origPath) {
+	std::vector<gtype> offsets, energies;
+	for (int m = muFrom; m <= muTo; m += muStep)
+		offsets.push_back(m-ChanVeseBranch::mu);
+	if (offsets.empty())
+		return;
+	int count = (int)offsets.size(), imsize = imWidth*imHeight;
+	//the energies of the sweep already have the background offset of a negative base mu (see below)
+	gtype baseOffset = ChanVeseBranch::mu < 0 ? -ChanVeseBranch::mu*imsize : 0;
+	std::vector<int> level(imsize), fgCount(count+1, 0);
+	energies.resize(count);
+
+	double time = -clock();
+	int nFlows = ParametricSweep(leaf, &offsets[0], count, &level[0], &energies[0]);
+	time = (time+clock())/CLOCKS_PER_SEC;
+
+	//the pixel i is foreground for the first level[i] values
+	for (int i = 0; i < imsize; ++i)
+		fgCount[level[i]]++;
+	for (int k = count-1; k >= 0; --k)
+		fgCount[k] += fgCount[k+1];
+
+	printf("mu sweep for c_b = %d, c_f = %d: %d values, %d maxflows, %lf sec.\n", leaf->minb, leaf->minf, count, nFlows, time);
+	printf("mu from\tmu to\tforeground\tenergy at mu from\n");
+	std::vector<int> segm(imsize);
+	for (int k = 0; k < count; ) {
+		int end = k+1;
+		while (end < count && fgCount[end+1] == fgCount[k+1])
+			++end;
+		int mu = ChanVeseBranch::mu+offsets[k];
+		//same convention as the main run, which puts a negative mu on the background pixels
+		gtype energy = energies[k]-baseOffset+(mu < 0 ? -mu*imsize : 0);
+		printf("%d\t%d\t%d\t\t%d\n", mu, ChanVeseBranch::mu+offsets[end-1], fgCount[k+1], energy);
+		if (maskPrefix) {
+			char name[1024];
+			sprintf(name, "%s%d.png", maskPrefix, mu);
+			for (int i = 0; i < imsize; ++i)
+				segm[i] = level[i] > k;
+			if (!WriteSegmentation(&segm[0], imWidth, imHeight, origPath, name, NULL))
+				puts("Failed to write the results!");
+		}
+		k = end;
+	}
+}
+
+//segments the image for each smoothness value of the list in turn. Only the first value gets a thumbnail estimate,
+//the search for every next one is centred at the optimal means of the previous value and starts with the previous
+//optimum as the incumbent; the graph is kept and only its edge capacities are changed.
+//With compare, every value is also segmented on its own (thumbnail estimate and full search) to report the time saved
+void lambdaSweep(const char* thumbPath, const char* origPath, const std::vector<int>& lambdas, int mu, bool compare) {
+	int w, h;
+	const unsigned char* image = loadGray8(origPath, w, h);
+	if (!image) {
+		puts("Invalid path to the test image!");
+		return;
+	}
+
+	double totalTime = -clock();
+	ChanVeseBranch* leaf = thumbsnailEstimate(thumbPath, lambdas[0], mu);
+	if (!leaf)
+		return;
+	printf("Estimated c_b = %d, c_f = %d.\n\n", leaf->minb, leaf->minf);
+
+	std::vector<gtype> energies;
+	printf("lambda\tenergy\t\tc_b\tc_f\ttime\n");
+	for (size_t k = 0; k < lambdas.size(); ++k) {
+		double time = -clock();
+		ChanVeseBranch root;
+		root.bound = 0;
+		root.maxb = std::min(leaf->minb + 10, 255);
+		root.minb = std::max(0, leaf->minb - 10);
+		root.maxf = std::min(255, leaf->minf + 10);
+		root.minf = std::max(0, leaf->minf - 10);
+		root.image8 = image;
+		//the previous optimum (the thumbnail estimate for the first value) is evaluated on this image
+		leaf->image8 = image;
+		ChanVeseBranch* next = runBranchAndMincut(w, h, lambdas[k], mu, NULL, root, leaf);
+		time = (time+clock())/CLOCKS_PER_SEC;
+		delete leaf;
+		leaf = next;
+		energies.push_back(leaf->bound);
+		printf("%d\t%d\t%d\t%d\t%lf\n", lambdas[k], leaf->bound, leaf->minb, leaf->minf, time);
+	}
+	delete leaf;
+	totalTime = (totalTime+clock())/CLOCKS_PER_SEC;
+	printf("Total Time = %lf.\n", totalTime);
+
+	if (!compare)
+		return;
+	double independentTime = -clock();
+	for (size_t k = 0; k < lambdas.size(); ++k) {
+		ChanVeseBranch* est = thumbsnailEstimate(thumbPath, lambdas[k], mu);
+		ChanVeseBranch* single = origImageSeg(origPath, lambdas[k], mu, NULL, est->minf, est->minb);
+		if (single->bound != energies[k])
+			printf("lambda %d: independent run energy %d, c_b = %d, c_f = %d\n", lambdas[k], single->bound, single->minb, single->minf);
+		delete est;
+		delete single;
+	}
+	independentTime = (independentTime+clock())/CLOCKS_PER_SEC;
+	printf("Independent runs: %lf sec, saved %lf sec (%.1lf%%).\n", independentTime, independentTime-totalTime,
+		100*(independentTime-totalTime)/independentTime);
+}
+
+#ifndef NO_OPENCV
+void visualize(const char* path, const PackedMask& segm){
 	int w,h;
-	double *imageColor = LoadImage24bpp<double>(path, w, h);
-	DrawSegmentation24bpp<double,int>(imageColor, segm, w, h);
-	ShowImage24bpp<double>(imageColor, w, h, 0, "result");
+	if (!ReadImageSize(path, w, h) || w != segm.width || h != segm.height) return;
+	unsigned char *imageColor = new unsigned char[w*h*3];
+	unsigned char *mask = new unsigned char[w*h];
+	DecodeImage(path, imageColor, 3*w, PIXEL_BGR24);
+	SegmentationToMask(segm, mask);
+	DrawBoundary24bpp(imageColor, mask, w, h);
+	ShowImage24bpp<unsigned char>(imageColor, w, h, 0, "result");
+	delete[] mask;
 	delete[] imageColor;
 }
+#endif
+
+//writes the contours, the mask and the overlay that were asked for, or shows the segmentation if none was
+static void saveResults(const PackedMask& segm, const char* origPath, const char* maskFile, const char* overlayFile,
+						const char* contourFile, double tolerance) {
+	if (contourFile) {
+		size_t len = strlen(contourFile);
+		ContourFormat format = len >= 5 && !strcmp(contourFile+len-5, ".json") ? CONTOUR_JSON : CONTOUR_BINARY;
+		if (!WriteContours(segm, contourFile, format, tolerance))
+			puts("Failed to write the contours!");
+	}
+	if ((maskFile || overlayFile) && !WriteSegmentation(segm, origPath, maskFile, overlayFile))
+		puts("Failed to write the results!");
+#ifndef NO_OPENCV
+	if (!maskFile && !overlayFile && !contourFile)
+		visualize(origPath, segm);
+#endif
+}
 
-int main()
+//usage: BranchAndMincut [image] [-mask file] [-overlay file] [-contours file [-simplify tolerance]] [-maxflow bk|pr|ibfs] [-order rows|tiles|morton] [-neighbourhood 4|8|16]
+//                       [-mu value] [-musweep from to step [-sweepmasks prefix]] [-lambdas l1,l2,... [-compare]] [-scribbles file]
+//                       [-persistency period] [-roi x y width height] [-region mask] [-boundary free|bg|fg]
+//                       [-superpixels scale [-minsize pixels] [-refine] [-compare]] [-tiles size [-overlap pixels] [-seam pixels] [-verify]]
+//                       [-scratch directory] [-colour bits] [-step size] [-depth slices [-neighbourhood 6|18|26]]
+//       BranchAndMincut -batch directory|manifest [-outdir dir] [-workers n] [-overlays] [-maxflow ...] [-order ...] [-neighbourhood ...] [-mu value]
+//       BranchAndMincut -frames directory|manifest [-window n] [-outdir dir] [-overlays] [-maxflow ...] [-order ...] [-neighbourhood ...] [-mu value]
+//With -mask, -overlay and/or -contours the results are written to files and no window is opened.
+//Contours are written as JSON for ".json" file names and in the compact binary format otherwise.
+//-maxflow selects Boykov-Kolmogorov (default), push-relabel or IBFS for the bound evaluations.
+//-order selects the order of the pixels in the graph memory (the result does not depend on it).
+//-neighbourhood selects the pixel neighbourhood of the boundary length term (8 by default).
+//-musweep keeps the optimal means found for -mu (0 by default) and gives the optimal segmentations for all the mu values
+//of the range by a parametric maxflow; -sweepmasks writes the mask of each distinct one.
+//-lambdas only reports the optimal energy and means for each of the smoothness values (each search is warm-started
+//from the previous one), -compare also runs them independently.
+//-batch segments all the images of a directory or a manifest file headlessly (see SegmentBatch), -outdir is "." by default.
+//-frames does the same for the frames of a video, each one warm-started from the previous frame (see SegmentSequence).
+//-scribbles replays the hard constraint strokes of a file on an interactive session (see scribbleSession) and
+//prints the time of every update.
+//-persistency contracts the pixels with persistent labels into the terminals every period levels of the search
+//(see SetContraction) and prints the fraction of the pixels fixed at each depth of the search for the original image.
+//-roi and/or -region (nonzero pixels of a mask image of the same size) segment only a part of the image (see
+//SegmentChanVeseRegion), -boundary sets how the segmentation meets the border of the part (free by default).
+//-superpixels segments a preview on the superpixels of ComputeSuperpixels with the given scale (larger scales give fewer,
+//larger superpixels; -minsize merges smaller ones, 20 pixels by default), -refine solves the pixel graph at the means
+//found, and -compare also runs the exact search to report the energy lost (see superpixelImageSeg).
+//-tiles segments without a graph of the whole image: the means are searched at half the resolution and refined at full
+//resolution with cuts on size x size tiles in parallel (see tiledImageSeg and TiledMincut, the overlap is 32 and the seam
+//16 pixels by default). It is not guaranteed to be optimal; -verify compares it with the search of the whole image.
+//-scratch keeps the graphs and the per-pixel terms in memory-mapped files in the directory, for images larger than the
+//memory (see ScratchStorage.h). The nodes are then in the tiles order unless -order is given; give a .pgm -mask (and an
+//8-bit PGM image, which is mapped too) so that no buffer of the image size is needed.
+//-colour segments the colour image by its mean colours (see SegmentChanVeseColour) with the colours quantised to the given
+//bits per channel (at most maxColourBits): the result is the optimum for the quantised colours and means, polished
+//by a heuristic Chan-Vese alternation on the full colours. It can be combined with the output, maxflow, order and
+//neighbourhood options only.
+//Images deeper than 8 bits are segmented at their full depth (see SegmentChanVeseDeep), with the means quantised
+//to -step (about 256 levels over the intensity range by default); the region, superpixel, tiled, scribble, sweep
+//and batch modes reduce them to 8 bits.
+//-depth segments a volume given as the image of its slices one below the other (see SegmentChanVeseVolume), with the
+//6-connected grid unless -neighbourhood gives a volume neighbourhood (which alone makes the image a volume of one slice).
+//It can be combined with the output, -step and -mu options; the mask and the overlay are the slices one below the
+//other too.
+int main(int argc, char** argv)
 {
 	const char *thumbPath = "lake3_20.png";
 	const char *origPath  = "lake3_20.png";
+	const char *maskFile = NULL;
+	const char *overlayFile = NULL;
+	const char *contourFile = NULL;
+	double tolerance = 0;
 	int lambda = 10000;
 	int mu = 0;
+	bool muSweepOn = false;
+	int muFrom = 0, muTo = 0, muStep = 1;
+	const char *sweepMaskPrefix = NULL;
+	std::vector<int> lambdas;
+	bool compare = false;
+	const char *batchInput = NULL;
+	const char *framesInput = NULL;
+	const char *scribbleFile = NULL;
+	int window = 10;
+	const char *outDir = ".";
+	int workers = 0;
+	bool overlays = false;
+	int contractionPeriod = 0;
+	int roi[4] = {0, 0, 0, 0};
+	const char *regionFile = NULL;
+	RegionBoundary boundary = REGION_BOUNDARY_FREE;
+	int superpixelScale = 0;
+	int minSize = 20;
+	bool refine = false;
+	int tileSize = 0, overlap = 32, seam = 16;
+	bool verify = false;
+	const char *scratchDir = NULL;
+	bool orderSet = false;
+	int colourBits = 0;
+	int quantStep = 0;
+	int volumeDepth = 0;
 
-	int** segm = new (int*);
-	*segm = NULL;
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "-mask") && i+1 < argc) {
+			maskFile = argv[++i];
+		} else if (!strcmp(argv[i], "-overlay") && i+1 < argc) {
+			overlayFile = argv[++i];
+		} else if (!strcmp(argv[i], "-contours") && i+1 < argc) {
+			contourFile = argv[++i];
+		} else if (!strcmp(argv[i], "-simplify") && i+1 < argc) {
+			tolerance = atof(argv[++i]);
+		} else if (!strcmp(argv[i], "-maxflow") && i+1 < argc) {
+			++i;
+			if (!strcmp(argv[i], "pr"))
+				maxflowType = MAXFLOW_PUSH_RELABEL;
+			else if (!strcmp(argv[i], "ibfs"))
+				maxflowType = MAXFLOW_IBFS;
+			else
+				maxflowType = MAXFLOW_BK;
+		} else if (!strcmp(argv[i], "-order") && i+1 < argc) {
+			++i;
+			orderSet = true;
+			if (!strcmp(argv[i], "tiles"))
+				nodeOrder = NODE_ORDER_TILES;
+			else if (!strcmp(argv[i], "morton"))
+				nodeOrder = NODE_ORDER_MORTON;
+			else
+				nodeOrder = NODE_ORDER_ROWS;
+		} else if (!strcmp(argv[i], "-mu") && i+1 < argc) {
+			mu = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "-musweep") && i+3 < argc) {
+			muFrom = atoi(argv[++i]);
+			muTo = atoi(argv[++i]);
+			muStep = std::max(1, atoi(argv[++i]));
+			muSweepOn = true;
+		} else if (!strcmp(argv[i], "-sweepmasks") && i+1 < argc) {
+			sweepMaskPrefix = argv[++i];
+		} else if (!strcmp(argv[i], "-lambdas") && i+1 < argc) {
+			for (const char *s = argv[++i]; *s; ) {
+				lambdas.push_back(atoi(s));
+				s += strcspn(s, ",");
+				if (*s)
+					++s;
+			}
+		} else if (!strcmp(argv[i], "-compare")) {
+			compare = true;
+		} else if (!strcmp(argv[i], "-batch") && i+1 < argc) {
+			batchInput = argv[++i];
+		} else if (!strcmp(argv[i], "-frames") && i+1 < argc) {
+			framesInput = argv[++i];
+		} else if (!strcmp(argv[i], "-scribbles") && i+1 < argc) {
+			scribbleFile = argv[++i];
+		} else if (!strcmp(argv[i], "-persistency") && i+1 < argc) {
+			contractionPeriod = std::max(1, atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "-roi") && i+4 < argc) {
+			for (int k = 0; k < 4; ++k)
+				roi[k] = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "-region") && i+1 < argc) {
+			regionFile = argv[++i];
+		} else if (!strcmp(argv[i], "-boundary") && i+1 < argc) {
+			++i;
+			if (!strcmp(argv[i], "bg"))
+				boundary = REGION_BOUNDARY_BACKGROUND;
+			else if (!strcmp(argv[i], "fg"))
+				boundary = REGION_BOUNDARY_FOREGROUND;
+			else
+				boundary = REGION_BOUNDARY_FREE;
+		} else if (!strcmp(argv[i], "-superpixels") && i+1 < argc) {
+			superpixelScale = std::max(1, atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "-minsize") && i+1 < argc) {
+			minSize = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "-refine")) {
+			refine = true;
+		} else if (!strcmp(argv[i], "-tiles") && i+1 < argc) {
+			tileSize = std::max(1, atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "-overlap") && i+1 < argc) {
+			overlap = std::max(0, atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "-seam") && i+1 < argc) {
+			seam = std::max(0, atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "-verify")) {
+			verify = true;
+		} else if (!strcmp(argv[i], "-scratch") && i+1 < argc) {
+			scratchDir = argv[++i];
+		} else if (!strcmp(argv[i], "-colour") && i+1 < argc) {
+			colourBits = std::max(1, atoi(argv[++i]));
+			if (colourBits > maxColourBits) {
+				printf("%d bits per colour channel do not finish in reasonable time, using %d\n", colourBits, maxColourBits);
+				colourBits = maxColourBits;
+			}
+		} else if (!strcmp(argv[i], "-step") && i+1 < argc) {
+			quantStep = std::max(1, atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "-depth") && i+1 < argc) {
+			volumeDepth = std::max(1, atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "-window") && i+1 < argc) {
+			window = std::max(1, atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "-outdir") && i+1 < argc) {
+			outDir = argv[++i];
+		} else if (!strcmp(argv[i], "-workers") && i+1 < argc) {
+			workers = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "-overlays")) {
+			overlays = true;
+		} else if (!strcmp(argv[i], "-neighbourhood") && i+1 < argc) {
+			int n = atoi(argv[++i]);
+			neighbourhood = n == 4 ? NEIGHBOURHOOD_4 : n == 16 ? NEIGHBOURHOOD_16 : n == 6 ? NEIGHBOURHOOD_6 :
+				n == 18 ? NEIGHBOURHOOD_18 : n == 26 ? NEIGHBOURHOOD_26 : NEIGHBOURHOOD_8;
+		} else {
+			thumbPath = origPath = argv[i];
+		}
+	}
+
+	ChanVeseBranch::lambda = lambda;
+	ChanVeseBranch::mu = mu;
+	if (contractionPeriod)
+		SetContraction(true, contractionPeriod);
+	if (scratchDir) {
+		SetScratchDirectory(scratchDir);
+		//neighbouring nodes and their arcs on the same pages
+		if (!orderSet)
+			nodeOrder = NODE_ORDER_TILES;
+	}
+
+	if (IsVolumeNeighbourhood(neighbourhood) && !volumeDepth)
+		volumeDepth = 1;
+	else if (volumeDepth && !IsVolumeNeighbourhood(neighbourhood))
+		neighbourhood = NEIGHBOURHOOD_6;
+
+	if (batchInput)
+		return SegmentBatch(batchInput, outDir, workers, lambda, mu, overlays) == 0 ? 0 : 1;
+	if (framesInput)
+		return SegmentSequence(framesInput, outDir, lambda, mu, overlays, window) == 0 ? 0 : 1;
+
+	if (!lambdas.empty()) {
+		lambdaSweep(thumbPath, origPath, lambdas, mu, compare);
+		return 0;
+	}
+
+	PackedMask segm;
 
 	double totalTime = -clock();
+	if (colourBits) {
+		printf("Segmenting the colours: ");
+		ColourChanVeseBranch* colourLeaf = colourImageSeg(origPath, colourBits, lambda, mu, &segm);
+		if (!colourLeaf)
+			return 1;
+		totalTime = (totalTime+clock())/CLOCKS_PER_SEC;
+		printf("done.\nTotal Time = %lf.\n", totalTime);
+		printf("Energy = %d, c_b = (%d, %d, %d), c_f = (%d, %d, %d) (R, G, B)\n", colourLeaf->bound, colourLeaf->minb[2],
+			colourLeaf->minb[1], colourLeaf->minb[0], colourLeaf->minf[2], colourLeaf->minf[1], colourLeaf->minf[0]);
+		saveResults(segm, origPath, maskFile, overlayFile, contourFile, tolerance);
+		delete colourLeaf;
+		return 0;
+	}
 
-	printf("Running thumbsnail estimator...");
+	ChanVeseBranch* resultLeaf;
+	bool regionOn = roi[2] > 0 || regionFile;
+	bool deep = !scribbleFile && !tileSize && imageDepth(origPath) > 8;
 
-	ChanVeseBranch* resultLeaf = thumbsnailEstimate(thumbPath, lambda, mu);
+	if (volumeDepth) {
+		printf("Segmenting the volume: ");
+		resultLeaf = volumeImageSeg(origPath, volumeDepth, quantStep, lambda, mu, &segm);
+	} else if (regionOn) {
+		printf("Segmenting the region...");
+		resultLeaf = regionImageSeg(origPath, roi, regionFile, boundary, lambda, mu, &segm);
+	} else if (superpixelScale) {
+		printf("Segmenting the superpixels...");
+		resultLeaf = superpixelImageSeg(origPath, superpixelScale, minSize, refine, compare, lambda, mu, &segm);
+	} else if (deep) {
+		printf("Segmenting the deep image: ");
+		resultLeaf = deepImageSeg(origPath, quantStep, lambda, mu, &segm);
+	} else if (tileSize && !scribbleFile) {
+		printf("Segmenting the tiles...");
+		resultLeaf = tiledImageSeg(origPath, lambda, mu, &segm, tileSize, overlap, seam, verify);
+	} else {
+		printf("Running thumbsnail estimator...");
 
-	printf("done.\n");
+		resultLeaf = thumbsnailEstimate(thumbPath, lambda, mu);
 
-	delete[] *segm;
-	int est_cf = resultLeaf->maxf;
-	int est_cb = resultLeaf->maxb;
-	delete resultLeaf;
+		printf("done.\n");
+
+		int est_cf = resultLeaf->maxf;
+		int est_cb = resultLeaf->maxb;
+		delete resultLeaf;
 
-	printf("Estimated c_b = %d, c_f = %d.\n\n", est_cb, est_cf);
+		printf("Estimated c_b = %d, c_f = %d.\n\n", est_cb, est_cf);
 	
-	printf("Segmenting original image...");
+		printf("Segmenting original image...");
 
-	resultLeaf = origImageSeg(origPath, lambda, mu, segm, est_cf, est_cb);
+		if (scribbleFile)
+			resultLeaf = scribbleSession(origPath, scribbleFile, lambda, mu, &segm, est_cf, est_cb);
+		else
+			resultLeaf = origImageSeg(origPath, lambda, mu, &segm, est_cf, est_cb);
+	}
+	if (!resultLeaf)
+		return 1;
 
 	totalTime += clock();
 	totalTime /= CLOCKS_PER_SEC;
 
 	printf("done.\n");
-	printf("Total Time = %lf.\n", totalTime);
+	double graphTime, searchTime;
+	GetBranchAndMincutTimes(&graphTime, &searchTime);
+	printf("Total Time = %lf (graph construction %lf, search %lf).\n", totalTime, graphTime, searchTime);
 	printf("Energy = %d, c_b = %d, c_f = %d\n", 
 		resultLeaf->bound, resultLeaf->minb, resultLeaf->minf);
+	if (contractionPeriod && !scribbleFile) {
+		int counts[64];
+		double ratios[64];
+		int depths = GetContractionStats(counts, ratios, 64);
+		printf("depth\tcontractions\tfixed pixels\n");
+		for (int d = 0; d < depths; ++d)
+			if (counts[d])
+				printf("%d\t%d\t\t%.1lf%%\n", d, counts[d], 100*ratios[d]);
+	}
+
+	if (muSweepOn && (regionOn || superpixelScale || volumeDepth))
+		puts("-musweep is not supported for a region, superpixels or a volume.");
+	else if (muSweepOn)
+		muSweep(resultLeaf, muFrom, muTo, muStep, sweepMaskPrefix, origPath);
 	
-	visualize(origPath, *segm);
+	saveResults(segm, origPath, maskFile, overlayFile, contourFile, tolerance);
 
 	delete resultLeaf;
-	delete[] *segm;
-	delete	 segm;
 	return 0;
 }
\ No newline at end of file
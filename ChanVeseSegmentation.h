@@ -15,6 +15,7 @@ Implemented by Victor Lempitsky, 2008
 #define CHAN_VESE_SEGMENTATION_H
 
 #include "BranchAndMincut.h"
+#include <vector>
 
 //EXAMPLE(section 5.1 of the paper): segmentation under discretized Chan-Vese functional.
 //Original continuous functional was suggested in:
@@ -31,7 +32,18 @@ public:
 	int maxb;
 	int minf;
 	int maxf;
+	//image intensities, exactly one of the three pointers is expected to be set.
+	//8-bit storage is the default, 16-bit is for deeper formats, int is kept for compatibility
 	int* image;
+	const unsigned char* image8;
+	const unsigned short* image16;
+	//the means are restricted to minb + k*step and minf + k*step (every integer with step 1), so the search on a deep
+	//image can stop at a coarser quantisation. The squared differences are divided by 2^unaryShift (rounded), which
+	//keeps the unaries of a deep image in the range of gtype
+	int step;
+	int unaryShift;
+
+	ChanVeseBranch(): image(NULL), image8(NULL), image16(NULL), step(1), unaryShift(0) {}
 
 	virtual bool IsLeaf()
 	{
@@ -53,6 +65,10 @@ public:
 		br->minf = minf;
 		br->maxf = maxf;
 		br->image = image;
+		br->image8 = image8;
+		br->image16 = image16;
+		br->step = step;
+		br->unaryShift = unaryShift;
 	}
 
 	virtual gtype GetConstant()
@@ -61,7 +77,149 @@ public:
 		return 0;
 	}
 	
-	virtual void GetUnaries(gtype *bgUnaries, gtype *fgUnaries); //see cpp file
+	virtual void GetUnaries(int imwidth, int imheight, gtype *bgUnaries, gtype *fgUnaries); //see cpp file
+
+	virtual bool GetUnaryRange(gtype *minDiff, gtype *maxDiff); //see cpp file
+};
+
+//the distinct colours of a BGR image (three bytes per pixel). With bits < 8 only the top bits of every channel are kept
+//and the pixels of such a bin take the mean colour of the bin, so fewer bits mean fewer colours and a coarser image
+struct ColourTable
+{
+	std::vector<unsigned char> colours; //B, G and R of each colour
+	std::vector<int> counts; //pixels of each colour
+	std::vector<int> index; //colour of each pixel
+	int shift; //8-bits
+
+	int Size() const { return (int)counts.size(); }
+};
+
+void MakeColourTable(const unsigned char *bgr, int w, int h, int bits, ColourTable& table);
+
+//Chan-Vese functional for colour images: the unary of a pixel is the squared euclidean distance between its colour
+//and the mean colour c_b or c_f. The branch is a box of c_b and a box of c_f (a range per channel), its bound uses
+//the squared distance of the colour to the box. The unaries are computed once per colour of the table and then
+//copied to the pixels, so the time of a bound depends on the number of distinct colours more than on the image size.
+//The ranges are in the levels of the table (0..255 >> shift), the level l stands for the centre of its bin
+//(l << shift) + (1 << shift)/2, so the means are as coarse as the colours. ChanVeseBranch::mu is the bias here as well
+class ColourChanVeseBranch: public Branch
+{
+public:
+	int minb[3];
+	int maxb[3];
+	int minf[3];
+	int maxf[3];
+	const ColourTable *colours;
+
+	ColourChanVeseBranch(): colours(NULL) {}
+
+	virtual bool IsLeaf()
+	{
+		for(int c = 0; c < 3; c++)
+			if(minb[c] < maxb[c] || minf[c] < maxf[c])
+				return false;
+		return true;
+	}
+
+	//halves the widest range of c_b or c_f, of equally wide ones the range in the channel that tightens the bound the most
+	virtual void BranchFurther(Branch **br1, Branch **br2);
+
+	virtual void Clone(Branch **br_)
+	{
+		*br_ = new ColourChanVeseBranch(*this);
+	}
+
+	virtual gtype GetConstant()
+	{
+		//c_b <= c_f is broken by the sum of the channels when mu=0 (see ChanVeseBranch)
+		if(!ChanVeseBranch::mu && minb[0]+minb[1]+minb[2] > maxf[0]+maxf[1]+maxf[2]) return INFTY;
+		return 0;
+	}
+
+	virtual void GetUnaries(int imwidth, int imheight, gtype *bgUnaries, gtype *fgUnaries); //see cpp file
+
+	virtual bool GetUnaryRange(gtype *minDiff, gtype *maxDiff); //see cpp file
+
+	//the boxes in colour units
+	void GetBox(int *lowb, int *highb, int *lowf, int *highf);
+};
+
+//segments an 8-bit image the way the command line tool does: (c_b, c_f) are estimated with half the smoothness
+//over all the means first, then the optimum is searched within +-10 of the estimate. ChanVeseBranch::mu should be set to mu.
+//Uses the graphs of the calling thread (see PrepareGraph), segm can be NULL. The returned leaf should be deleted.
+ChanVeseBranch *SegmentChanVese(const unsigned char *image, int w, int h, int lambda, int mu, PackedMask *segm);
+
+//SegmentChanVese for a part of the image: region (w*h bytes) is nonzero for the pixels to segment. The image is cropped to
+//the bounding box of the region, so the graph and the time scale with the region, and the means are estimated from its
+//pixels only (see PrepareGraph for boundary). The pixels outside the region are background in segm.
+//Returns NULL for an empty region, the returned leaf only holds the means and the energy (it has no image) and should be deleted.
+ChanVeseBranch *SegmentChanVeseRegion(const unsigned char *image, int w, int h, const unsigned char *region,
+									  RegionBoundary boundary, int lambda, int mu, PackedMask *segm);
+
+//approximate SegmentChanVese for previews: the search runs on the graph of the superpixels (superpixels as for
+//PrepareSuperpixelGraph, e.g. from ComputeSuperpixels), so segm is made of whole superpixels. With refine the pixel graph
+//is then solved once more at the means found, which makes segm pixel-exact for these means (the means stay approximate).
+//The energy of the returned leaf is that of segm. The returned leaf should be deleted
+ChanVeseBranch *SegmentChanVeseSuperpixels(const unsigned char *image, int w, int h, const int *superpixels, bool refine,
+										   int lambda, int mu, PackedMask *segm);
+
+//Chan-Vese segmentation of a colour image (BGR, three bytes per pixel). Searching six exact means is not tractable
+//(the energy is too flat around the optimum for the bounds to prune), so the search runs over the whole RGB cube with
+//the colours and the means quantised to bits per channel (see ColourTable), 2-3 bits are enough. Its segmentation
+//is then polished on the exact colours by Chan-Vese alternation: the mean colours of the two regions, then the cut for
+//them, while the energy decreases. ChanVeseBranch::mu should be set to mu. The returned leaf holds the exact means
+//(levels of 8 bits) and the exact energy of segm, it has no colour table and should be deleted. segm can be NULL
+ColourChanVeseBranch *SegmentChanVeseColour(const unsigned char *bgr, int w, int h, int bits, int lambda, int mu,
+											PackedMask *segm);
+
+//SegmentChanVese for a deep gray image (up to 16 bits, e.g. 12-bit data stored in 16 bits), as SegmentChanVese: the
+//means are estimated with half the smoothness first, then searched within +-10 steps of the estimate. The range of
+//the means is that of the image intensities, not 0..65535. step is the quantisation of the means (0 picks the
+//step that gives about 256 levels over the range), and the squared differences are scaled as if the range were
+//256 levels, so lambda and mu mean the same as for an 8-bit image. The unaries are still computed per pixel, their
+//cost does not depend on the depth. ChanVeseBranch::mu should be set to mu. The returned leaf keeps image and
+//should be deleted
+ChanVeseBranch *SegmentChanVeseDeep(const unsigned short *image, int w, int h, int step, int lambda, int mu,
+									PackedMask *segm);
+
+//SegmentChanVese for a w x h x depth volume (e.g. CT or MRI), given as the w x (h*depth) image of its slices one below
+//the other; segm is laid out the same way. The means are searched once for the whole volume as in SegmentChanVeseDeep
+//(with step 1 for 8 bits), on a graph with the volume neighbourhood nb (6, 18 or 26-connected, see PrepareVolumeGraph),
+//and lambda weighs the area of the boundary surface (see EuclideanEdgeWeight). The energy of a large volume does not
+//fit into gtype, so the unaries, lambda and mu are divided by 2^energyShift, for the smallest energyShift that keeps
+//every cut below INFTY (0 for small volumes), and the bound of the returned leaf is the energy divided by it.
+//ChanVeseBranch::mu should be set to mu. The returned leaf keeps volume and should be deleted
+ChanVeseBranch *SegmentChanVeseVolume(const unsigned char *volume, int w, int h, int depth, Neighbourhood nb,
+									  int lambda, int mu, PackedMask *segm, int *energyShift = NULL);
+ChanVeseBranch *SegmentChanVeseVolume(const unsigned short *volume, int w, int h, int depth, Neighbourhood nb,
+									  int step, int lambda, int mu, PackedMask *segm, int *energyShift = NULL);
+
+//Segmentation of a sequence of frames (e.g. a video), one frame at a time. The first frame is segmented with SegmentChanVese.
+//For every next frame of the same size the search is restricted to +-window around the optimal (c_b, c_f) of the previous
+//frame, the previous optimum is the first incumbent, and the graph keeps the flow and the search trees of the previous frame
+//(BranchAndMincut with reuseFlow), so the first maxflow only revisits the pixels whose intensity changed. If the optimum is
+//on the border of the window (better means may lie outside), the frame is segmented again with SegmentChanVese.
+//ChanVeseBranch::mu should be set to mu. The graphs of the calling thread are used and nothing else may use them between frames.
+class ChanVeseSequence
+{
+public:
+	ChanVeseSequence(int lambda, int mu, int window = 10);
+	~ChanVeseSequence();
+
+	//segments the next frame (kept by the caller until the next call), segm can be NULL.
+	//The returned leaf is owned by the sequence and stays valid until the next call
+	ChanVeseBranch *AddFrame(const unsigned char *frame, int w, int h, PackedMask *segm);
+
+	bool FullSearch() const { return fullSearch; } //true if the last frame was segmented with SegmentChanVese
+
+private:
+	int lambda, mu, window;
+	ChanVeseBranch *last; //optimum of the previous frame, NULL before the first one
+	int width, height;
+	bool fullSearch;
+
+	ChanVeseSequence(const ChanVeseSequence&);
+	ChanVeseSequence& operator=(const ChanVeseSequence&);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,536 @@
+/*
+This software contains the C++ implementation of the "branch-and-mincut" framework for image segmentation
+with various high-level priors as described in the paper:
+
+V. Lempitsky, A. Blake, C. Rother. Image Segmentation by Branch-and-Mincut.
+In proceedings of European Conference on Computer Vision (ECCV), October 2008.
+
+The software contains the core algorithm and an example of its application (globally-optimal
+segmentations under Chan-Vese functional).
+
+Implemented by Victor Lempitsky, 2008
+*/
+
+#include "GridGraph.h"
+#include "ScratchStorage.h"
+#include <string.h>
+#include <assert.h>
+
+//special values of node::parent, the directions are 0..31
+#define TERMINAL 253
+#define ORPHAN 254
+#define NONE 255
+
+#define INFINITE_D ((int)(((unsigned)-1)/2))
+
+template <typename captype, typename tcaptype, typename flowtype>
+	GridGraph<captype,tcaptype,flowtype>::GridGraph(int _width, int _height, int _depth, int count, const int *dx, const int *dy, const int *dz)
+	: width(_width), height(_height), depth(_depth), dirs(2*count)
+{
+	assert(count <= 16);
+	for(int k = 0; k < count; k++)
+	{
+		offset[k] = (dz[k]*(height+2)+dy[k])*(width+2)+dx[k];
+		offset[k+count] = -offset[k];
+	}
+	nodeNum = (width+2)*(height+2)*(depth+2);
+	nodes = (node *)ScratchAlloc(sizeof(node)*nodeNum);
+	rcap = (captype *)ScratchAlloc(sizeof(captype)*nodeNum*dirs);
+	reset();
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	GridGraph<captype,tcaptype,flowtype>::~GridGraph()
+{
+	ScratchFree(nodes);
+	ScratchFree(rcap);
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void GridGraph<captype,tcaptype,flowtype>::reset()
+{
+	for(int i = 0; i < nodeNum; i++)
+	{
+		nodes[i].tr_cap = 0;
+		nodes[i].next = -1;
+		nodes[i].parent = NONE;
+		nodes[i].is_sink = 0;
+		nodes[i].is_marked = 0;
+	}
+	memset(rcap, 0, sizeof(captype)*nodeNum*dirs);
+	queue_first[1] = queue_last[1] = -1;
+	orphans.clear();
+	flow = 0;
+	maxflow_iteration = 0;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void GridGraph<captype,tcaptype,flowtype>::set_edge(node_id i, int k, captype cap, captype rev_cap)
+{
+	rcap[i*dirs+k] = cap;
+	rcap[(i+offset[k])*dirs+sister(k)] = rev_cap;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void GridGraph<captype,tcaptype,flowtype>::add_tweights(node_id i, tcaptype cap_source, tcaptype cap_sink)
+{
+	tcaptype delta = nodes[i].tr_cap;
+	if (delta > 0) cap_source += delta;
+	else           cap_sink   -= delta;
+	flow += (cap_source < cap_sink) ? cap_source : cap_sink;
+	nodes[i].tr_cap = cap_source - cap_sink;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	typename GridGraph<captype,tcaptype,flowtype>::termtype GridGraph<captype,tcaptype,flowtype>::what_segment(node_id i, termtype default_segm)
+{
+	if (nodes[i].parent != NONE)
+		return nodes[i].is_sink ? SINK : SOURCE;
+	return default_segm;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void GridGraph<captype,tcaptype,flowtype>::mark_node(node_id i)
+{
+	if (nodes[i].next < 0)
+	{
+		if (queue_last[1] >= 0) nodes[queue_last[1]].next = i;
+		else                    queue_first[1]            = i;
+		queue_last[1] = i;
+		nodes[i].next = i;
+	}
+	nodes[i].is_marked = 1;
+}
+
+//////////////////////////////////////////////
+
+//active nodes and orphans, as in Graph
+
+template <typename captype, typename tcaptype, typename flowtype>
+	inline void GridGraph<captype,tcaptype,flowtype>::set_active(int i)
+{
+	if (nodes[i].next < 0)
+	{
+		if (queue_last[1] >= 0) nodes[queue_last[1]].next = i;
+		else                    queue_first[1]            = i;
+		queue_last[1] = i;
+		nodes[i].next = i;
+	}
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	inline int GridGraph<captype,tcaptype,flowtype>::next_active()
+{
+	int i;
+	while (1)
+	{
+		if ((i = queue_first[0]) < 0)
+		{
+			queue_first[0] = i = queue_first[1];
+			queue_last[0]  = queue_last[1];
+			queue_first[1] = queue_last[1] = -1;
+			if (i < 0) return -1;
+		}
+		if (nodes[i].next == i) queue_first[0] = queue_last[0] = -1;
+		else                    queue_first[0] = nodes[i].next;
+		nodes[i].next = -1;
+		if (nodes[i].parent != NONE) return i;
+	}
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	inline void GridGraph<captype,tcaptype,flowtype>::set_orphan_front(int i)
+{
+	nodes[i].parent = ORPHAN;
+	orphans.push_front(i);
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	inline void GridGraph<captype,tcaptype,flowtype>::set_orphan_rear(int i)
+{
+	nodes[i].parent = ORPHAN;
+	orphans.push_back(i);
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void GridGraph<captype,tcaptype,flowtype>::adopt()
+{
+	while (!orphans.empty())
+	{
+		int i = orphans.front();
+		orphans.pop_front();
+		if (nodes[i].is_sink) process_sink_orphan(i);
+		else                  process_source_orphan(i);
+	}
+}
+
+//////////////////////////////////////////////
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void GridGraph<captype,tcaptype,flowtype>::maxflow_init()
+{
+	queue_first[0] = queue_last[0] = -1;
+	queue_first[1] = queue_last[1] = -1;
+	orphans.clear();
+	TIME = 0;
+
+	for (int i = 0; i < nodeNum; i++)
+	{
+		node *n = nodes+i;
+		n->next = -1;
+		n->is_marked = 0;
+		n->TS = TIME;
+		if (n->tr_cap)
+		{
+			n->is_sink = n->tr_cap < 0;
+			n->parent = TERMINAL;
+			set_active(i);
+			n->DIST = 1;
+		}
+		else
+			n->parent = NONE;
+	}
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void GridGraph<captype,tcaptype,flowtype>::maxflow_reuse_trees_init()
+{
+	int i, j, d, queue = queue_first[1];
+
+	queue_first[0] = queue_last[0] = -1;
+	queue_first[1] = queue_last[1] = -1;
+	orphans.clear();
+	TIME++;
+
+	while ((i = queue) >= 0)
+	{
+		node *n = nodes+i;
+		queue = n->next;
+		if (queue == i) queue = -1;
+		n->next = -1;
+		n->is_marked = 0;
+		set_active(i);
+
+		if (n->tr_cap == 0)
+		{
+			if (n->parent != NONE) set_orphan_rear(i);
+			continue;
+		}
+
+		if (n->tr_cap > 0)
+		{
+			if (n->parent == NONE || n->is_sink)
+			{
+				n->is_sink = 0;
+				for (d = 0; d < dirs; d++)
+				{
+					j = i+offset[d];
+					if (!nodes[j].is_marked)
+					{
+						if (nodes[j].parent == sister(d)) set_orphan_rear(j);
+						if (nodes[j].parent != NONE && nodes[j].is_sink && rcap[i*dirs+d] > 0) set_active(j);
+					}
+				}
+			}
+		}
+		else
+		{
+			if (n->parent == NONE || !n->is_sink)
+			{
+				n->is_sink = 1;
+				for (d = 0; d < dirs; d++)
+				{
+					j = i+offset[d];
+					if (!nodes[j].is_marked)
+					{
+						if (nodes[j].parent == sister(d)) set_orphan_rear(j);
+						if (nodes[j].parent != NONE && !nodes[j].is_sink && rcap[j*dirs+sister(d)] > 0) set_active(j);
+					}
+				}
+			}
+		}
+		n->parent = TERMINAL;
+		n->TS = TIME;
+		n->DIST = 1;
+	}
+
+	adopt();
+}
+
+//the arc from the source tree node from in direction d to the sink tree
+template <typename captype, typename tcaptype, typename flowtype>
+	void GridGraph<captype,tcaptype,flowtype>::augment(int from, int d)
+{
+	int i, p, to = from+offset[d];
+	tcaptype bottleneck;
+
+	//1. finding the bottleneck capacity, first in the source tree
+	bottleneck = rcap[from*dirs+d];
+	for (i = from; (p = nodes[i].parent) != TERMINAL; i += offset[p])
+		if (bottleneck > rcap[(i+offset[p])*dirs+sister(p)]) bottleneck = rcap[(i+offset[p])*dirs+sister(p)];
+	if (bottleneck > nodes[i].tr_cap) bottleneck = nodes[i].tr_cap;
+	//then in the sink tree
+	for (i = to; (p = nodes[i].parent) != TERMINAL; i += offset[p])
+		if (bottleneck > rcap[i*dirs+p]) bottleneck = rcap[i*dirs+p];
+	if (bottleneck > -nodes[i].tr_cap) bottleneck = -nodes[i].tr_cap;
+
+	//2. augmenting
+	rcap[to*dirs+sister(d)] += bottleneck;
+	rcap[from*dirs+d] -= bottleneck;
+	for (i = from; (p = nodes[i].parent) != TERMINAL; )
+	{
+		int j = i+offset[p];
+		rcap[i*dirs+p] += bottleneck;
+		if (!(rcap[j*dirs+sister(p)] -= bottleneck)) set_orphan_front(i);
+		i = j;
+	}
+	if (!(nodes[i].tr_cap -= bottleneck)) set_orphan_front(i);
+	for (i = to; (p = nodes[i].parent) != TERMINAL; )
+	{
+		int j = i+offset[p];
+		rcap[j*dirs+sister(p)] += bottleneck;
+		if (!(rcap[i*dirs+p] -= bottleneck)) set_orphan_front(i);
+		i = j;
+	}
+	if (!(nodes[i].tr_cap += bottleneck)) set_orphan_front(i);
+
+	flow += bottleneck;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void GridGraph<captype,tcaptype,flowtype>::process_source_orphan(int i)
+{
+	int d, j, dist, d_min = INFINITE_D, parent = NONE;
+
+	//trying to find a new parent
+	for (d = 0; d < dirs; d++)
+	{
+		j = i+offset[d];
+		if (rcap[j*dirs+sister(d)] && !nodes[j].is_sink && nodes[j].parent != NONE)
+		{
+			//checking the origin of j
+			dist = 0;
+			while (1)
+			{
+				if (nodes[j].TS == TIME)
+				{
+					dist += nodes[j].DIST;
+					break;
+				}
+				int p = nodes[j].parent;
+				dist++;
+				if (p == TERMINAL)
+				{
+					nodes[j].TS = TIME;
+					nodes[j].DIST = 1;
+					break;
+				}
+				if (p == ORPHAN) { dist = INFINITE_D; break; }
+				j += offset[p];
+			}
+			if (dist < INFINITE_D)
+			{
+				if (dist < d_min)
+				{
+					parent = d;
+					d_min = dist;
+				}
+				for (j = i+offset[d]; nodes[j].TS != TIME; j += offset[nodes[j].parent])
+				{
+					nodes[j].TS = TIME;
+					nodes[j].DIST = dist--;
+				}
+			}
+		}
+	}
+
+	if ((nodes[i].parent = (unsigned char)parent) != NONE)
+	{
+		nodes[i].TS = TIME;
+		nodes[i].DIST = d_min+1;
+	}
+	else
+	{
+		//no parent is found, processing the neighbours
+		for (d = 0; d < dirs; d++)
+		{
+			j = i+offset[d];
+			int p = nodes[j].parent;
+			if (!nodes[j].is_sink && p != NONE)
+			{
+				if (rcap[j*dirs+sister(d)]) set_active(j);
+				if (p == sister(d)) set_orphan_rear(j);
+			}
+		}
+	}
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void GridGraph<captype,tcaptype,flowtype>::process_sink_orphan(int i)
+{
+	int d, j, dist, d_min = INFINITE_D, parent = NONE;
+
+	for (d = 0; d < dirs; d++)
+	{
+		j = i+offset[d];
+		if (rcap[i*dirs+d] && nodes[j].is_sink && nodes[j].parent != NONE)
+		{
+			dist = 0;
+			while (1)
+			{
+				if (nodes[j].TS == TIME)
+				{
+					dist += nodes[j].DIST;
+					break;
+				}
+				int p = nodes[j].parent;
+				dist++;
+				if (p == TERMINAL)
+				{
+					nodes[j].TS = TIME;
+					nodes[j].DIST = 1;
+					break;
+				}
+				if (p == ORPHAN) { dist = INFINITE_D; break; }
+				j += offset[p];
+			}
+			if (dist < INFINITE_D)
+			{
+				if (dist < d_min)
+				{
+					parent = d;
+					d_min = dist;
+				}
+				for (j = i+offset[d]; nodes[j].TS != TIME; j += offset[nodes[j].parent])
+				{
+					nodes[j].TS = TIME;
+					nodes[j].DIST = dist--;
+				}
+			}
+		}
+	}
+
+	if ((nodes[i].parent = (unsigned char)parent) != NONE)
+	{
+		nodes[i].TS = TIME;
+		nodes[i].DIST = d_min+1;
+	}
+	else
+	{
+		for (d = 0; d < dirs; d++)
+		{
+			j = i+offset[d];
+			int p = nodes[j].parent;
+			if (nodes[j].is_sink && p != NONE)
+			{
+				if (rcap[i*dirs+d]) set_active(j);
+				if (p == sister(d)) set_orphan_rear(j);
+			}
+		}
+	}
+}
+
+//////////////////////////////////////////////
+
+template <typename captype, typename tcaptype, typename flowtype>
+	flowtype GridGraph<captype,tcaptype,flowtype>::maxflow(bool reuse_trees)
+{
+	int i, j, d, current_node = -1;
+
+	if (reuse_trees && maxflow_iteration > 0) maxflow_reuse_trees_init();
+	else                                      maxflow_init();
+
+	while (1)
+	{
+		if ((i = current_node) >= 0)
+		{
+			nodes[i].next = -1;
+			if (nodes[i].parent == NONE) i = -1;
+		}
+		if (i < 0 && (i = next_active()) < 0)
+			break;
+
+		//growth. from, d is the arc from the source tree to the sink tree, if one is found
+		int from = -1;
+		node *n = nodes+i;
+		if (!n->is_sink)
+		{
+			for (d = 0; d < dirs; d++)
+				if (rcap[i*dirs+d])
+				{
+					j = i+offset[d];
+					node *m = nodes+j;
+					if (m->parent == NONE)
+					{
+						m->is_sink = 0;
+						m->parent = (unsigned char)sister(d);
+						m->TS = n->TS;
+						m->DIST = n->DIST+1;
+						set_active(j);
+					}
+					else if (m->is_sink) { from = i; break; }
+					else if (m->TS <= n->TS && m->DIST > n->DIST)
+					{
+						m->parent = (unsigned char)sister(d);
+						m->TS = n->TS;
+						m->DIST = n->DIST+1;
+					}
+				}
+		}
+		else
+		{
+			for (d = 0; d < dirs; d++)
+			{
+				j = i+offset[d];
+				if (rcap[j*dirs+sister(d)])
+				{
+					node *m = nodes+j;
+					if (m->parent == NONE)
+					{
+						m->is_sink = 1;
+						m->parent = (unsigned char)sister(d);
+						m->TS = n->TS;
+						m->DIST = n->DIST+1;
+						set_active(j);
+					}
+					else if (!m->is_sink) { from = j; d = sister(d); break; }
+					else if (m->TS <= n->TS && m->DIST > n->DIST)
+					{
+						m->parent = (unsigned char)sister(d);
+						m->TS = n->TS;
+						m->DIST = n->DIST+1;
+					}
+				}
+			}
+		}
+
+		TIME++;
+
+		if (from >= 0)
+		{
+			n->next = i;
+			current_node = i;
+
+			augment(from, d);
+
+			//the orphans of the augmentation one by one, each with the orphans it makes
+			pending.swap(orphans);
+			while (!pending.empty())
+			{
+				orphans.push_back(pending.front());
+				pending.pop_front();
+				adopt();
+			}
+		}
+		else current_node = -1;
+	}
+
+	maxflow_iteration++;
+	return flow;
+}
+
+#ifdef _MSC_VER
+#pragma warning(disable: 4661)
+#endif
+
+template class GridGraph<int,int,int>;
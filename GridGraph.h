@@ -0,0 +1,101 @@
+/*
+This software contains the C++ implementation of the "branch-and-mincut" framework for image segmentation
+with various high-level priors as described in the paper:
+
+V. Lempitsky, A. Blake, C. Rother. Image Segmentation by Branch-and-Mincut.
+In proceedings of European Conference on Computer Vision (ECCV), October 2008.
+
+The software contains the core algorithm and an example of its application (globally-optimal
+segmentations under Chan-Vese functional).
+
+Implemented by Victor Lempitsky, 2008
+*/
+
+#ifndef GRID_GRAPH_H
+#define GRID_GRAPH_H
+
+#include <deque>
+
+//Boykov-Kolmogorov maxflow (maxflow\graph.h) for a 3D grid with implicit neighbours, for volumes that are too large
+//for the arc lists of Graph. Every voxel has the same edges, to the voxels at the given offsets (and from the voxels
+//at the opposite offsets), so an arc is only a residual capacity: the node keeps one per direction, and the head and
+//the reverse arc follow from the offset. A node takes 20 bytes plus 4 bytes per direction, e.g. 124 bytes in the
+//26-connected grid, where Graph needs about 900. The grid is padded by one voxel on every side, so the neighbours of
+//a node never have to be checked against the border (the arcs to the padding have no capacity).
+//
+//The interface mirrors Graph: add_tweights can be called at any time, maxflow can be called repeatedly and keeps
+//the flow, and with reuse_trees only the search trees around the nodes given to mark_node are rebuilt.
+//The node ids are those of the padded grid, see voxel().
+template <typename captype, typename tcaptype, typename flowtype> class GridGraph
+{
+public:
+	typedef enum
+	{
+		SOURCE	= 0,
+		SINK	= 1
+	} termtype;
+	typedef int node_id;
+
+	//a width x height x depth grid where the voxel (x, y, z) has edges to (x+dx[k], y+dy[k], z+dz[k]), k < count
+	//(at most 16). All the capacities are 0
+	GridGraph(int width, int height, int depth, int count, const int *dx, const int *dy, const int *dz);
+	~GridGraph();
+
+	node_id voxel(int x, int y, int z) const { return ((z+1)*(height+2)+y+1)*(width+2)+x+1; }
+
+	//capacities of the k-th edge of i and of its reverse arc. The other end has to be in the grid
+	void set_edge(node_id i, int k, captype cap, captype rev_cap);
+	void add_tweights(node_id i, tcaptype cap_source, tcaptype cap_sink);
+
+	flowtype maxflow(bool reuse_trees = false);
+
+	termtype what_segment(node_id i, termtype default_segm = SOURCE);
+
+	void mark_node(node_id i);
+
+	//all the capacities and the flow back to 0
+	void reset();
+
+private:
+	struct node
+	{
+		tcaptype		tr_cap;		//as in Graph: > 0 to the source, < 0 to the sink
+		int				next;		//next active node, the node itself for the last one, -1 if it is not active
+		int				TS;			//timestamp of DIST
+		int				DIST;		//distance to the terminal
+		unsigned char	parent;		//direction of the arc to the parent, or TERMINAL, ORPHAN, NONE
+		unsigned char	is_sink;
+		unsigned char	is_marked;
+	};
+
+	int			width, height, depth;
+	int			dirs;			//2*count directions: the offsets, then the opposite ones
+	int			offset[32];		//node id difference of each direction
+	int			nodeNum;		//of the padded grid
+	node		*nodes;
+	captype		*rcap;			//residual capacity of the arc of node i in direction d at i*dirs+d
+
+	int			queue_first[2], queue_last[2];
+	std::deque<int>	orphans, pending;
+	int			TIME;
+	int			maxflow_iteration;
+	flowtype	flow;
+
+	int sister(int d) const { return d < dirs/2 ? d+dirs/2 : d-dirs/2; }
+
+	void set_active(int i);
+	int next_active();
+	void set_orphan_front(int i);
+	void set_orphan_rear(int i);
+	void maxflow_init();
+	void maxflow_reuse_trees_init();
+	void augment(int from, int d);
+	void process_source_orphan(int i);
+	void process_sink_orphan(int i);
+	void adopt();
+
+	GridGraph(const GridGraph&);
+	GridGraph& operator=(const GridGraph&);
+};
+
+#endif
@@ -0,0 +1,565 @@
+/*
+This software contains the C++ implementation of the "branch-and-mincut" framework for image segmentation
+with various high-level priors as described in the paper:
+
+V. Lempitsky, A. Blake, C. Rother. Image Segmentation by Branch-and-Mincut.
+In proceedings of European Conference on Computer Vision (ECCV), October 2008.
+
+The software contains the core algorithm and an example of its application (globally-optimal
+segmentations under Chan-Vese functional).
+
+Implemented by Victor Lempitsky, 2008
+*/
+
+#include "IBFS.h"
+#include <assert.h>
+
+template <typename captype, typename tcaptype, typename flowtype>
+	IBFSGraph<captype,tcaptype,flowtype>::IBFSGraph(int node_num_max, int edge_num_max)
+{
+	nodes.reserve(node_num_max+1);
+	edges.reserve(edge_num_max);
+	reset();
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void IBFSGraph<captype,tcaptype,flowtype>::reset()
+{
+	node_num = 0;
+	nodes.resize(1);
+	nodes[0].first = 0;
+	arcs.clear();
+	edge_arc.clear();
+	edges.clear();
+	marked.clear();
+	saved_rcap.clear();
+	saved_trcap.clear();
+	arcs_valid = false;
+	flow = 0;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void IBFSGraph<captype,tcaptype,flowtype>::save_capacities()
+{
+	if (!arcs_valid)
+		build_arcs();
+
+	int i;
+	saved_rcap.resize(arcs.size());
+	for(i = 0; i < (int)arcs.size(); i++)
+		saved_rcap[i] = arcs[i].r_cap;
+	saved_trcap.resize(node_num);
+	for(i = 0; i < node_num; i++)
+		saved_trcap[i] = nodes[i].tr_cap;
+	saved_flow = flow;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void IBFSGraph<captype,tcaptype,flowtype>::restore_capacities()
+{
+	assert(saved_rcap.size() == arcs.size() && (int)saved_trcap.size() == node_num);
+
+	int i;
+	for(i = 0; i < (int)arcs.size(); i++)
+		arcs[i].r_cap = saved_rcap[i];
+	for(i = 0; i < node_num; i++)
+		nodes[i].tr_cap = saved_trcap[i];
+	flow = saved_flow;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void IBFSGraph<captype,tcaptype,flowtype>::set_saved_edge(int k, captype cap, captype rev_cap)
+{
+	assert(!saved_rcap.empty());
+	assert(k >= 0 && k < (int)edge_arc.size() && cap >= 0 && rev_cap >= 0);
+
+	int a = edge_arc[k];
+	saved_rcap[a] = cap;
+	saved_rcap[arcs[a].sister] = rev_cap;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	typename IBFSGraph<captype,tcaptype,flowtype>::node_id IBFSGraph<captype,tcaptype,flowtype>::add_node(int num)
+{
+	assert(num > 0);
+
+	node_id first = node_num;
+	node_num += num;
+	nodes.resize(node_num+1);
+	for(int i = first; i <= node_num; i++)
+	{
+		node& n = nodes[i];
+		n.first = 0;
+		n.parent = NONE;
+		n.dist = 0;
+		n.is_sink = n.is_active = n.is_marked = 0;
+		n.tr_cap = 0;
+	}
+	arcs_valid = false;
+	return first;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void IBFSGraph<captype,tcaptype,flowtype>::add_edge(node_id i, node_id j, captype cap, captype rev_cap)
+{
+	assert(i >= 0 && i < node_num);
+	assert(j >= 0 && j < node_num);
+	assert(i != j);
+	assert(cap >= 0);
+	assert(rev_cap >= 0);
+	assert(arcs.empty()); //edges cannot be added after maxflow
+
+	edge e;
+	e.i = i;
+	e.j = j;
+	e.cap = cap;
+	e.rev_cap = rev_cap;
+	edges.push_back(e);
+	arcs_valid = false;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void IBFSGraph<captype,tcaptype,flowtype>::add_tweights(node_id i, tcaptype cap_source, tcaptype cap_sink)
+{
+	assert(i >= 0 && i < node_num);
+
+	tcaptype delta = nodes[i].tr_cap;
+	if (delta > 0) cap_source += delta;
+	else           cap_sink   -= delta;
+	flow += (cap_source < cap_sink) ? cap_source : cap_sink;
+	nodes[i].tr_cap = cap_source - cap_sink;
+}
+
+//forward star: the arcs of a node are contiguous
+template <typename captype, typename tcaptype, typename flowtype>
+	void IBFSGraph<captype,tcaptype,flowtype>::build_arcs()
+{
+	int i, k;
+	std::vector<int> pos(node_num+1, 0);
+	for(k = 0; k < (int)edges.size(); k++)
+	{
+		pos[edges[k].i]++;
+		pos[edges[k].j]++;
+	}
+	int sum = 0;
+	for(i = 0; i <= node_num; i++)
+	{
+		int deg = pos[i];
+		nodes[i].first = pos[i] = sum;
+		sum += deg;
+	}
+	arcs.resize(sum);
+	edge_arc.resize(edges.size());
+	for(k = 0; k < (int)edges.size(); k++)
+	{
+		const edge& e = edges[k];
+		int a = edge_arc[k] = pos[e.i]++;
+		int b = pos[e.j]++;
+		arcs[a].head = e.j;
+		arcs[a].sister = b;
+		arcs[a].r_cap = e.cap;
+		arcs[b].head = e.i;
+		arcs[b].sister = a;
+		arcs[b].r_cap = e.rev_cap;
+	}
+	std::vector<edge>().swap(edges);
+
+	buckets[0].resize(node_num+2);
+	buckets[1].resize(node_num+2);
+	arcs_valid = true;
+}
+
+/***********************************************************************/
+
+//Active nodes are kept in buckets by their distance, so each tree is scanned level by level.
+//A node whose distance or tree changed while it was in a bucket is moved when it is taken out.
+
+template <typename captype, typename tcaptype, typename flowtype>
+	inline void IBFSGraph<captype,tcaptype,flowtype>::set_active(int i)
+{
+	node& n = nodes[i];
+	if (n.is_active) return;
+	n.is_active = 1;
+	n.next = buckets[n.is_sink][n.dist];
+	buckets[n.is_sink][n.dist] = i;
+	active_num[n.is_sink]++;
+	if (n.dist < active_min[n.is_sink]) active_min[n.is_sink] = n.dist;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	int IBFSGraph<captype,tcaptype,flowtype>::next_active(int tree)
+{
+	while (active_num[tree])
+	{
+		int d = active_min[tree];
+		int i = buckets[tree][d];
+		if (i == NONE)
+		{
+			active_min[tree]++;
+			continue;
+		}
+		node& n = nodes[i];
+		buckets[tree][d] = n.next;
+		active_num[tree]--;
+		n.is_active = 0;
+
+		if (n.parent == NONE) continue;
+		if (n.is_sink != tree || n.dist != d)
+		{
+			set_active(i);
+			continue;
+		}
+		return i;
+	}
+	return NONE;
+}
+
+/***********************************************************************/
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void IBFSGraph<captype,tcaptype,flowtype>::maxflow_init()
+{
+	int i;
+	for(int t = 0; t < 2; t++)
+	{
+		for(i = 0; i < node_num+2; i++)
+			buckets[t][i] = NONE;
+		active_num[t] = 0;
+		active_min[t] = 1;
+	}
+	for(i = 0; i < (int)marked.size(); i++)
+		nodes[marked[i]].is_marked = 0;
+	marked.clear();
+
+	for(i = 0; i < node_num; i++)
+	{
+		node& n = nodes[i];
+		n.is_active = 0;
+		if (n.tr_cap != 0)
+		{
+			n.is_sink = n.tr_cap < 0;
+			n.parent = TERMINAL;
+			n.dist = 1;
+			set_active(i);
+		}
+		else
+			n.parent = NONE;
+	}
+}
+
+//the trees of the previous call are kept, only the marked nodes are reconnected to the terminals
+template <typename captype, typename tcaptype, typename flowtype>
+	void IBFSGraph<captype,tcaptype,flowtype>::maxflow_reuse_trees_init()
+{
+	for(int k = 0; k < (int)marked.size(); k++)
+	{
+		int i = marked[k];
+		node& n = nodes[i];
+		n.is_marked = 0;
+
+		if (n.tr_cap == 0)
+		{
+			if (n.parent == TERMINAL) set_orphan(i);
+			continue;
+		}
+
+		unsigned char is_sink = n.tr_cap < 0;
+		if (n.parent != NONE && n.is_sink != is_sink)
+		{
+			//the node moves to the other tree
+			orphan_children(i);
+			n.parent = NONE;
+		}
+		if (n.parent == NONE)
+		{
+			n.is_sink = is_sink;
+			set_active(i);
+		}
+		//attaching to the terminal can only shorten the distance, the children stay valid
+		n.parent = TERMINAL;
+		n.dist = 1;
+	}
+	marked.clear();
+
+	process_orphans();
+}
+
+/***********************************************************************/
+
+template <typename captype, typename tcaptype, typename flowtype>
+	inline void IBFSGraph<captype,tcaptype,flowtype>::set_orphan(int i)
+{
+	nodes[i].parent = ORPHAN;
+	orphans.push(std::make_pair(nodes[i].dist, i));
+}
+
+//the children of i lose their parent
+template <typename captype, typename tcaptype, typename flowtype>
+	void IBFSGraph<captype,tcaptype,flowtype>::orphan_children(int i)
+{
+	node& n = nodes[i];
+	for(int a = n.first; a < nodes[i+1].first; a++)
+	{
+		node& j = nodes[arcs[a].head];
+		if (j.parent == arcs[a].sister && j.is_sink == n.is_sink)
+			set_orphan(arcs[a].head);
+	}
+}
+
+//i leaves its tree. The neighbors that can grow into it are scanned again, so that both trees
+//stay closed (every residual arc leaving the source tree or entering the sink tree is scanned)
+template <typename captype, typename tcaptype, typename flowtype>
+	void IBFSGraph<captype,tcaptype,flowtype>::set_free(int i)
+{
+	node& n = nodes[i];
+	orphan_children(i);
+	n.parent = NONE;
+	for(int a = n.first; a < nodes[i+1].first; a++)
+	{
+		int j = arcs[a].head;
+		node& m = nodes[j];
+		if (m.parent == NONE) continue;
+		if (m.is_sink ? arcs[a].r_cap > 0 : arcs[arcs[a].sister].r_cap > 0)
+			set_active(j);
+	}
+}
+
+//Orphans are processed in the order of their distances. Then every node of the tree with a smaller
+//distance than the current orphan still has a valid path to the terminal, so such a neighbor can be
+//taken as the parent right away. Otherwise the orphan is relabeled to the lowest distance at which
+//it may find a parent and waits for its turn again; its children become orphans.
+template <typename captype, typename tcaptype, typename flowtype>
+	void IBFSGraph<captype,tcaptype,flowtype>::process_orphan(int i)
+{
+	node& n = nodes[i];
+	int a, d = n.dist;
+	int end = nodes[i+1].first;
+
+	if (n.is_sink ? n.tr_cap < 0 : n.tr_cap > 0)
+	{
+		n.parent = TERMINAL;
+		n.dist = 1;
+		return;
+	}
+
+	int a_min = NONE, d_min = 0;
+	for(a = n.first; a < end; a++)
+	{
+		node& j = nodes[arcs[a].head];
+		if (j.parent == NONE || j.parent == ORPHAN || j.is_sink != n.is_sink || j.parent == arcs[a].sister)
+			continue;
+		if (n.is_sink ? arcs[a].r_cap <= 0 : arcs[arcs[a].sister].r_cap <= 0)
+			continue;
+		if (j.dist == d-1)
+		{
+			//adoption at the previous level, the distance stays exact
+			n.parent = a;
+			return;
+		}
+		if (a_min == NONE || j.dist < d_min)
+		{
+			a_min = a;
+			d_min = j.dist;
+		}
+	}
+
+	if (a_min != NONE && d_min < d)
+	{
+		n.parent = a_min;
+		n.dist = d_min+1;
+		return;
+	}
+
+	//a tree path has less than node_num arcs
+	if (a_min == NONE || d_min+1 >= node_num)
+	{
+		set_free(i);
+		return;
+	}
+
+	orphan_children(i);
+	n.dist = d_min+1;
+	orphans.push(std::make_pair(n.dist, i));
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void IBFSGraph<captype,tcaptype,flowtype>::process_orphans()
+{
+	while (!orphans.empty())
+	{
+		int d = orphans.top().first;
+		int i = orphans.top().second;
+		orphans.pop();
+		if (nodes[i].parent == ORPHAN && nodes[i].dist == d)
+			process_orphan(i);
+	}
+}
+
+/***********************************************************************/
+
+//a goes from a node of the source tree to a node of the sink tree
+template <typename captype, typename tcaptype, typename flowtype>
+	void IBFSGraph<captype,tcaptype,flowtype>::augment(int a)
+{
+	int i, p;
+	captype bottleneck = arcs[a].r_cap;
+
+	//finding the bottleneck capacity
+	for(i = arcs[arcs[a].sister].head; ; i = arcs[p].head)
+	{
+		p = nodes[i].parent;
+		if (p == TERMINAL)
+		{
+			if (bottleneck > nodes[i].tr_cap) bottleneck = nodes[i].tr_cap;
+			break;
+		}
+		if (bottleneck > arcs[arcs[p].sister].r_cap) bottleneck = arcs[arcs[p].sister].r_cap;
+	}
+	for(i = arcs[a].head; ; i = arcs[p].head)
+	{
+		p = nodes[i].parent;
+		if (p == TERMINAL)
+		{
+			if (bottleneck > -nodes[i].tr_cap) bottleneck = -nodes[i].tr_cap;
+			break;
+		}
+		if (bottleneck > arcs[p].r_cap) bottleneck = arcs[p].r_cap;
+	}
+
+	//augmenting
+	arcs[a].r_cap -= bottleneck;
+	arcs[arcs[a].sister].r_cap += bottleneck;
+	for(i = arcs[arcs[a].sister].head; ; i = arcs[p].head)
+	{
+		p = nodes[i].parent;
+		if (p == TERMINAL)
+		{
+			nodes[i].tr_cap -= bottleneck;
+			if (!nodes[i].tr_cap) set_orphan(i);
+			break;
+		}
+		arcs[p].r_cap += bottleneck;
+		arcs[arcs[p].sister].r_cap -= bottleneck;
+		if (!arcs[arcs[p].sister].r_cap) set_orphan(i);
+	}
+	for(i = arcs[a].head; ; i = arcs[p].head)
+	{
+		p = nodes[i].parent;
+		if (p == TERMINAL)
+		{
+			nodes[i].tr_cap += bottleneck;
+			if (!nodes[i].tr_cap) set_orphan(i);
+			break;
+		}
+		arcs[arcs[p].sister].r_cap += bottleneck;
+		arcs[p].r_cap -= bottleneck;
+		if (!arcs[p].r_cap) set_orphan(i);
+	}
+
+	flow += bottleneck;
+}
+
+//scans a node of the source tree: free neighbors join the tree at the next level,
+//neighbors in the sink tree give augmenting paths
+template <typename captype, typename tcaptype, typename flowtype>
+	void IBFSGraph<captype,tcaptype,flowtype>::grow_source(int i)
+{
+	node& n = nodes[i];
+	int end = nodes[i+1].first;
+	for(int a = n.first; a < end; a++)
+	{
+		if (arcs[a].r_cap <= 0) continue;
+		int j = arcs[a].head;
+		node& m = nodes[j];
+		if (m.parent == NONE)
+		{
+			m.is_sink = 0;
+			m.parent = arcs[a].sister;
+			m.dist = n.dist+1;
+			set_active(j);
+		}
+		else if (m.is_sink)
+		{
+			augment(a);
+			process_orphans();
+			if (n.parent == NONE) return;
+			a--; //the same arc may still have capacity
+		}
+		else if (m.dist > n.dist+1)
+		{
+			//a shorter path to the source
+			m.parent = arcs[a].sister;
+			m.dist = n.dist+1;
+		}
+	}
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void IBFSGraph<captype,tcaptype,flowtype>::grow_sink(int i)
+{
+	node& n = nodes[i];
+	int end = nodes[i+1].first;
+	for(int a = n.first; a < end; a++)
+	{
+		int b = arcs[a].sister;
+		if (arcs[b].r_cap <= 0) continue;
+		int j = arcs[a].head;
+		node& m = nodes[j];
+		if (m.parent == NONE)
+		{
+			m.is_sink = 1;
+			m.parent = b;
+			m.dist = n.dist+1;
+			set_active(j);
+		}
+		else if (!m.is_sink)
+		{
+			augment(b);
+			process_orphans();
+			if (n.parent == NONE) return;
+			a--;
+		}
+		else if (m.dist > n.dist+1)
+		{
+			m.parent = b;
+			m.dist = n.dist+1;
+		}
+	}
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	flowtype IBFSGraph<captype,tcaptype,flowtype>::maxflow(bool reuse_trees)
+{
+	if (!arcs_valid)
+	{
+		build_arcs();
+		reuse_trees = false;
+	}
+
+	if (reuse_trees) maxflow_reuse_trees_init();
+	else             maxflow_init();
+
+	//the tree with the lower frontier grows first, so both are grown in breadth-first order;
+	//the search goes on until both trees are closed, which gives the same cut as Graph
+	while (active_num[0] || active_num[1])
+	{
+		int tree;
+		if (!active_num[0])      tree = 1;
+		else if (!active_num[1]) tree = 0;
+		else tree = (active_min[1] < active_min[0] ||
+			(active_min[1] == active_min[0] && active_num[1] < active_num[0])) ? 1 : 0;
+
+		int i = next_active(tree);
+		if (i == NONE) continue;
+		if (tree) grow_sink(i);
+		else      grow_source(i);
+	}
+
+	return flow;
+}
+
+#ifdef _MSC_VER
+#pragma warning(disable: 4661)
+#endif
+
+template class IBFSGraph<int,int,int>;
@@ -0,0 +1,148 @@
+/*
+This software contains the C++ implementation of the "branch-and-mincut" framework for image segmentation
+with various high-level priors as described in the paper:
+
+V. Lempitsky, A. Blake, C. Rother. Image Segmentation by Branch-and-Mincut.
+In proceedings of European Conference on Computer Vision (ECCV), October 2008.
+
+The software contains the core algorithm and an example of its application (globally-optimal
+segmentations under Chan-Vese functional).
+
+Implemented by Victor Lempitsky, 2008
+*/
+
+#ifndef IBFS_H
+#define IBFS_H
+
+#include <vector>
+#include <queue>
+#include <functional>
+
+//Incremental breadth-first search maxflow (Goldberg, Hed, Kaplan, Tarjan, Werneck,
+//"Maximum Flows by Incremental Breadth-First Search", ESA 2011).
+//Like the Boykov-Kolmogorov algorithm it grows a source and a sink search tree and augments along
+//the paths where they meet, but the trees are grown in breadth-first order and every node keeps its
+//distance to the terminal of its tree. Tree arcs always go from a node with distance d to one with
+//distance d-1, so an orphan is adopted by looking at its neighbors only (no walks to the terminal),
+//and a node that cannot be adopted at its level is relabeled to the next possible one.
+//
+//The interface mirrors Graph from maxflow\graph.h, including the reuse of the trees between calls:
+//after changing the terminal capacities call mark_node for the changed nodes and maxflow(true).
+//Edges must be added before the first call to maxflow (or after reset).
+template <typename captype, typename tcaptype, typename flowtype> class IBFSGraph
+{
+public:
+	typedef enum
+	{
+		SOURCE	= 0,
+		SINK	= 1
+	} termtype;
+	typedef int node_id;
+
+	//same meaning as in Graph: estimates of the number of nodes and edges
+	IBFSGraph(int node_num_max, int edge_num_max);
+
+	node_id add_node(int num = 1);
+	void add_edge(node_id i, node_id j, captype cap, captype rev_cap);
+	void add_tweights(node_id i, tcaptype cap_source, tcaptype cap_sink);
+
+	//computes the maxflow. With reuse_trees, only the nodes passed to mark_node since the last call are revisited
+	flowtype maxflow(bool reuse_trees = false);
+
+	termtype what_segment(node_id i, termtype default_segm = SOURCE)
+	{
+		if (nodes[i].parent == NONE) return default_segm;
+		return nodes[i].is_sink ? SINK : SOURCE;
+	}
+
+	//same as in Graph: should be called for every node whose terminal capacities changed before maxflow(true)
+	void mark_node(node_id i)
+	{
+		if (!nodes[i].is_marked)
+		{
+			nodes[i].is_marked = 1;
+			marked.push_back(i);
+		}
+	}
+
+	void reset();
+
+	//same as in Graph: restore_capacities brings back the capacities and the flow saved by save_capacities,
+	//the next maxflow must not reuse the trees
+	void save_capacities();
+	void restore_capacities();
+	void set_saved_edge(int k, captype cap, captype rev_cap);
+
+	int get_node_num() { return node_num; }
+
+private:
+	//special values of node::parent
+	enum { NONE = -1, TERMINAL = -2, ORPHAN = -3 };
+
+	struct node
+	{
+		int				first;		//first arc in the arcs array, the arcs of the node end at the first arc of the next node
+		int				parent;		//arc to the parent in the tree, or one of the special values (NONE for free nodes)
+		int				next;		//next node in the same active bucket
+		int				dist;		//distance to the terminal of the tree
+		unsigned char	is_sink;	//which tree the node is in (if parent != NONE)
+		unsigned char	is_active;	//the node is in an active bucket (needs to be scanned)
+		unsigned char	is_marked;	//set by mark_node
+
+		tcaptype		tr_cap;		//if tr_cap > 0 then tr_cap is residual capacity of the arc SOURCE->node
+									//otherwise         -tr_cap is residual capacity of the arc node->SINK
+	};
+
+	struct arc
+	{
+		int			head;
+		int			sister;		//reverse arc
+		captype		r_cap;		//residual capacity
+	};
+
+	struct edge
+	{
+		node_id		i, j;
+		captype		cap, rev_cap;
+	};
+
+	std::vector<node>	nodes;		//node_num+1 entries, the last one terminates the arc list of the last node
+	std::vector<arc>	arcs;
+	std::vector<int>	edge_arc;	//arc from i to j of each edge
+	std::vector<edge>	edges;		//edges added since the last rebuild of the arcs array
+	int					node_num;
+	bool				arcs_valid;
+
+	flowtype			flow;
+
+	std::vector<captype>	saved_rcap;		//set by save_capacities
+	std::vector<tcaptype>	saved_trcap;
+	flowtype				saved_flow;
+
+	//active nodes of each tree (0 - source, 1 - sink), bucketed by the distance
+	std::vector<int>	buckets[2];
+	int					active_num[2];
+	int					active_min[2];	//no active nodes of the tree below this distance
+
+	//orphans of the current augmentation with their distances, the closest to the terminal first
+	std::priority_queue<std::pair<int,int>, std::vector<std::pair<int,int> >, std::greater<std::pair<int,int> > > orphans;
+	std::vector<int>	marked;
+
+	void build_arcs();
+	void maxflow_init();
+	void maxflow_reuse_trees_init();
+
+	void set_active(int i);
+	int next_active(int tree);
+
+	void grow_source(int i);
+	void grow_sink(int i);
+	void augment(int a);
+	void set_orphan(int i);
+	void process_orphans();
+	void process_orphan(int i);
+	void orphan_children(int i);
+	void set_free(int i);
+};
+
+#endif
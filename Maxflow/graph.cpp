@@ -5,19 +5,22 @@
 #include <stdlib.h>
 #include <string.h>
 #include "graph.h"
+#include "../ScratchStorage.h"
 
 
 template <typename captype, typename tcaptype, typename flowtype> 
 	Graph<captype, tcaptype, flowtype>::Graph(int node_num_max, int edge_num_max, void (*err_function)(char *))
 	: node_num(0),
 	  nodeptr_block(NULL),
-	  error_function(err_function)
+	  error_function(err_function),
+	  saved_rcap(NULL),
+	  saved_trcap(NULL)
 {
 	if (node_num_max < 16) node_num_max = 16;
 	if (edge_num_max < 16) edge_num_max = 16;
 
-	nodes = (node*) malloc(node_num_max*sizeof(node));
-	arcs = (arc*) malloc(2*edge_num_max*sizeof(arc));
+	nodes = (node*) ScratchAlloc(node_num_max*sizeof(node));
+	arcs = (arc*) ScratchAlloc(2*edge_num_max*sizeof(arc));
 	if (!nodes || !arcs) { if (error_function) (*error_function)("Not enough memory!"); exit(1); }
 
 	node_last = nodes;
@@ -37,8 +40,10 @@ template <typename captype, typename tcaptype, typename flowtype>
 		delete nodeptr_block; 
 		nodeptr_block = NULL; 
 	}
-	free(nodes);
-	free(arcs);
+	ScratchFree(nodes);
+	ScratchFree(arcs);
+	ScratchFree(saved_rcap);
+	ScratchFree(saved_trcap);
 }
 
 template <typename captype, typename tcaptype, typename flowtype> 
@@ -54,19 +59,66 @@ template <typename captype, typename tcaptype, typename flowtype>
 		nodeptr_block = NULL; 
 	}
 
+	ScratchFree(saved_rcap);
+	ScratchFree(saved_trcap);
+	saved_rcap = NULL;
+	saved_trcap = NULL;
+
 	maxflow_iteration = 0;
 	flow = 0;
 }
 
+template <typename captype, typename tcaptype, typename flowtype> 
+	void Graph<captype,tcaptype,flowtype>::save_capacities()
+{
+	node *i;
+	arc *a;
+
+	ScratchFree(saved_rcap);
+	ScratchFree(saved_trcap);
+	saved_rcap = (captype*) ScratchAlloc((arc_last-arcs+1)*sizeof(captype));
+	saved_trcap = (tcaptype*) ScratchAlloc((node_num+1)*sizeof(tcaptype));
+	if (!saved_rcap || !saved_trcap) { if (error_function) (*error_function)("Not enough memory!"); exit(1); }
+
+	for (a=arcs; a<arc_last; a++) saved_rcap[a-arcs] = a->r_cap;
+	for (i=nodes; i<node_last; i++) saved_trcap[i-nodes] = i->tr_cap;
+	saved_flow = flow;
+}
+
+template <typename captype, typename tcaptype, typename flowtype> 
+	void Graph<captype,tcaptype,flowtype>::restore_capacities()
+{
+	node *i;
+	arc *a;
+
+	if (!saved_rcap) { if (error_function) (*error_function)("restore_capacities() without save_capacities()!"); exit(1); }
+
+	for (a=arcs; a<arc_last; a++) a->r_cap = saved_rcap[a-arcs];
+	for (i=nodes; i<node_last; i++) i->tr_cap = saved_trcap[i-nodes];
+	flow = saved_flow;
+	maxflow_iteration = 0;
+}
+
+template <typename captype, typename tcaptype, typename flowtype> 
+	void Graph<captype,tcaptype,flowtype>::set_saved_edge(int k, captype cap, captype rev_cap)
+{
+	assert(saved_rcap && k >= 0 && 2*k+1 < arc_last-arcs);
+	assert(cap >= 0 && rev_cap >= 0);
+
+	saved_rcap[2*k] = cap;
+	saved_rcap[2*k+1] = rev_cap;
+}
+
 template <typename captype, typename tcaptype, typename flowtype> 
 	void Graph<captype,tcaptype,flowtype>::reallocate_nodes(int num)
 {
 	int node_num_max = (int)(node_max - nodes);
+	size_t old_size = node_num_max*sizeof(node);
 	node* nodes_old = nodes;
 
 	node_num_max += node_num_max / 2;
 	if (node_num_max < node_num + num) node_num_max = node_num + num;
-	nodes = (node*) realloc(nodes_old, node_num_max*sizeof(node));
+	nodes = (node*) ScratchRealloc(nodes_old, old_size, node_num_max*sizeof(node));
 	if (!nodes) { if (error_function) (*error_function)("Not enough memory!"); exit(1); }
 
 	node_last = nodes + node_num;
@@ -89,8 +141,10 @@ template <typename captype, typename tcaptype, typename flowtype>
 	int arc_num = (int)(arc_last - arcs);
 	arc* arcs_old = arcs;
 
+	size_t old_size = arc_num_max*sizeof(arc);
+
 	arc_num_max += arc_num_max / 2; if (arc_num_max & 1) arc_num_max ++;
-	arcs = (arc*) realloc(arcs_old, arc_num_max*sizeof(arc));
+	arcs = (arc*) ScratchRealloc(arcs_old, old_size, arc_num_max*sizeof(arc));
 	if (!arcs) { if (error_function) (*error_function)("Not enough memory!"); exit(1); }
 
 	arc_last = arcs + arc_num;
@@ -78,6 +78,8 @@ public:
 	// (and node_num_max can be zero). However, if the count is exceeded, then 
 	// the internal memory is reallocated (increased by 50%) which is expensive. 
 	// Also, temporarily the amount of allocated memory would be more than twice than needed.
+	// The node and arc arrays (and the saved capacities) are allocated with ScratchAlloc (ScratchStorage.h),
+	// so they are memory-mapped files after SetScratchDirectory.
 	// Similarly for edges.
 	// If you wish to avoid this overhead, you can download version 2.2, where nodes and edges are stored in blocks.
 	Graph(int node_num_max, int edge_num_max, void (*err_function)(char *) = NULL);
@@ -142,6 +144,17 @@ public:
 	// (see functions below).
 	void reset();
 
+	// Saves the residual capacities of all arcs (including terminal arcs) and the flow.
+	// restore_capacities() brings them back: this is the same as calling reset() and
+	// the same add_node()/add_edge()/add_tweights() calls again, but the graph is not rebuilt,
+	// only the capacities are copied. The graph structure must not change in between
+	// (reset() discards the saved capacities), and the next maxflow() must not reuse trees.
+	void save_capacities();
+	void restore_capacities();
+	// Changes the saved capacities of the k-th edge (counting add_edge() calls from 0),
+	// they are used from the next call to restore_capacities().
+	void set_saved_edge(int k, captype cap, captype rev_cap);
+
 	////////////////////////////////////////////////////////////////////////////////
 	// 2. Functions for getting pointers to arcs and for reading graph structure. //
 	//    NOTE: adding new arcs may invalidate these pointers (if reallocation    //
@@ -306,6 +319,10 @@ private:
 
 	flowtype			flow;		// total flow
 
+	captype				*saved_rcap;	// set by save_capacities()
+	tcaptype			*saved_trcap;
+	flowtype			saved_flow;
+
 	// reusing trees & list of changed pixels
 	int					maxflow_iteration; // counter
 	Block<node_id>		*changed_list;
@@ -0,0 +1,401 @@
+/*
+This software contains the C++ implementation of the "branch-and-mincut" framework for image segmentation
+with various high-level priors as described in the paper:
+
+V. Lempitsky, A. Blake, C. Rother. Image Segmentation by Branch-and-Mincut.
+In proceedings of European Conference on Computer Vision (ECCV), October 2008.
+
+The software contains the core algorithm and an example of its application (globally-optimal
+segmentations under Chan-Vese functional).
+
+Implemented by Victor Lempitsky, 2008
+*/
+
+#include "PushRelabel.h"
+#include <assert.h>
+
+#define NONE (-1)
+
+template <typename captype, typename tcaptype, typename flowtype>
+	PushRelabelGraph<captype,tcaptype,flowtype>::PushRelabelGraph(int node_num_max, int edge_num_max)
+{
+	nodes.reserve(node_num_max+1);
+	edges.reserve(edge_num_max);
+	reset();
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void PushRelabelGraph<captype,tcaptype,flowtype>::reset()
+{
+	node_num = 0;
+	nodes.resize(1);
+	nodes[0].first = 0;
+	arcs.clear();
+	edges.clear();
+	edge_arc.clear();
+	saved_rcap.clear();
+	saved_excess.clear();
+	arcs_valid = false;
+	labels_valid = false;
+	flow = 0;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void PushRelabelGraph<captype,tcaptype,flowtype>::save_capacities()
+{
+	if(!arcs_valid)
+		build_arcs();
+
+	int i;
+	saved_rcap.resize(arcs.size());
+	for(i = 0; i < (int)arcs.size(); i++)
+		saved_rcap[i] = arcs[i].r_cap;
+	saved_excess.resize(node_num);
+	for(i = 0; i < node_num; i++)
+		saved_excess[i] = nodes[i].excess;
+	saved_flow = flow;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void PushRelabelGraph<captype,tcaptype,flowtype>::restore_capacities()
+{
+	assert(saved_rcap.size() == arcs.size() && (int)saved_excess.size() == node_num);
+
+	int i;
+	for(i = 0; i < (int)arcs.size(); i++)
+		arcs[i].r_cap = saved_rcap[i];
+	for(i = 0; i < node_num; i++)
+		nodes[i].excess = saved_excess[i];
+	flow = saved_flow;
+	labels_valid = false;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void PushRelabelGraph<captype,tcaptype,flowtype>::set_saved_edge(int k, captype cap, captype rev_cap)
+{
+	assert(saved_rcap.size() == arcs.size() && k >= 0 && k < (int)edge_arc.size());
+	assert(cap >= 0 && rev_cap >= 0);
+
+	int a = edge_arc[k];
+	saved_rcap[a] = cap;
+	saved_rcap[arcs[a].sister] = rev_cap;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	typename PushRelabelGraph<captype,tcaptype,flowtype>::node_id PushRelabelGraph<captype,tcaptype,flowtype>::add_node(int num)
+{
+	assert(num > 0);
+
+	node_id first = node_num;
+	node_num += num;
+	nodes.resize(node_num+1);
+	for(int i = first; i <= node_num; i++)
+	{
+		nodes[i].first = 0;
+		nodes[i].excess = 0;
+		nodes[i].d = 0;
+	}
+	arcs_valid = false;
+	return first;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void PushRelabelGraph<captype,tcaptype,flowtype>::add_edge(node_id i, node_id j, captype cap, captype rev_cap)
+{
+	assert(i >= 0 && i < node_num);
+	assert(j >= 0 && j < node_num);
+	assert(i != j);
+	assert(cap >= 0);
+	assert(rev_cap >= 0);
+	assert(arcs.empty()); //edges cannot be added after maxflow
+
+	edge e;
+	e.i = i;
+	e.j = j;
+	e.cap = cap;
+	e.rev_cap = rev_cap;
+	edges.push_back(e);
+	arcs_valid = false;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void PushRelabelGraph<captype,tcaptype,flowtype>::add_tweights(node_id i, tcaptype cap_source, tcaptype cap_sink)
+{
+	assert(i >= 0 && i < node_num);
+
+	//the excess plays the role of the residual capacity SOURCE->node in Graph
+	tcaptype delta = nodes[i].excess;
+	if (delta > 0) cap_source += delta;
+	else           cap_sink   -= delta;
+	flow += (cap_source < cap_sink) ? cap_source : cap_sink;
+	nodes[i].excess = cap_source - cap_sink;
+}
+
+//arcs are stored contiguously per node (forward star), which keeps the scans in discharge and
+//global_relabel sequential in memory
+template <typename captype, typename tcaptype, typename flowtype>
+	void PushRelabelGraph<captype,tcaptype,flowtype>::build_arcs()
+{
+	int i, k;
+	for(i = 0; i <= node_num; i++)
+		nodes[i].first = 0;
+	for(k = 0; k < (int)edges.size(); k++)
+	{
+		nodes[edges[k].i].first++;
+		nodes[edges[k].j].first++;
+	}
+	int sum = 0;
+	for(i = 0; i <= node_num; i++)
+	{
+		int deg = nodes[i].first;
+		nodes[i].first = sum;
+		nodes[i].current = sum; //used as the insertion position below
+		sum += deg;
+	}
+	arcs.resize(sum);
+	edge_arc.resize(edges.size());
+	for(k = 0; k < (int)edges.size(); k++)
+	{
+		const edge& e = edges[k];
+		int a = edge_arc[k] = nodes[e.i].current++;
+		int b = nodes[e.j].current++;
+		arcs[a].head = e.j;
+		arcs[a].sister = b;
+		arcs[a].r_cap = e.cap;
+		arcs[b].head = e.i;
+		arcs[b].sister = a;
+		arcs[b].r_cap = e.rev_cap;
+	}
+	std::vector<edge>().swap(edges);
+
+	active.resize(node_num+1);
+	inactive.resize(node_num+1);
+	queue.resize(node_num);
+	arcs_valid = true;
+}
+
+/***********************************************************************/
+
+template <typename captype, typename tcaptype, typename flowtype>
+	inline void PushRelabelGraph<captype,tcaptype,flowtype>::add_inactive(int v)
+{
+	node& n = nodes[v];
+	n.bprev = NONE;
+	n.bnext = inactive[n.d];
+	if (n.bnext != NONE) nodes[n.bnext].bprev = v;
+	inactive[n.d] = v;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	inline void PushRelabelGraph<captype,tcaptype,flowtype>::remove_inactive(int v)
+{
+	node& n = nodes[v];
+	if (n.bprev != NONE) nodes[n.bprev].bnext = n.bnext;
+	else                 inactive[n.d] = n.bnext;
+	if (n.bnext != NONE) nodes[n.bnext].bprev = n.bprev;
+}
+
+//exact distances to the sink by a backward breadth first search from the nodes with residual sink capacity.
+//Nodes that cannot reach the sink get the label node_num and are not put into the buckets.
+template <typename captype, typename tcaptype, typename flowtype>
+	void PushRelabelGraph<captype,tcaptype,flowtype>::global_relabel()
+{
+	int v, a, head = 0, tail = 0;
+
+	for(v = 0; v <= node_num; v++)
+	{
+		active[v] = inactive[v] = NONE;
+	}
+	for(v = 0; v < node_num; v++)
+	{
+		node& n = nodes[v];
+		n.current = n.first;
+		if(n.excess < 0)
+		{
+			n.d = 0;
+			queue[tail++] = v;
+		}
+		else
+			n.d = node_num;
+	}
+
+	amax = dmax = 0;
+	while(head < tail)
+	{
+		v = queue[head++];
+		node& n = nodes[v];
+		int d = n.d+1;
+		for(a = n.first; a < nodes[v+1].first; a++)
+		{
+			node& w = nodes[arcs[a].head];
+			if(w.d == node_num && arcs[arcs[a].sister].r_cap > 0)
+			{
+				w.d = d;
+				queue[tail++] = arcs[a].head;
+			}
+		}
+
+		if(n.excess > 0)
+		{
+			n.bnext = active[n.d];
+			active[n.d] = v;
+			if(n.d > amax) amax = n.d;
+		}
+		else
+			add_inactive(v);
+		dmax = n.d;
+	}
+	work = 0;
+}
+
+//all nodes with labels from d up to dmax cannot reach the sink anymore
+template <typename captype, typename tcaptype, typename flowtype>
+	void PushRelabelGraph<captype,tcaptype,flowtype>::gap(int d)
+{
+	for(int k = d; k <= dmax; k++)
+	{
+		int v;
+		for(v = active[k]; v != NONE; v = nodes[v].bnext)
+			nodes[v].d = node_num;
+		for(v = inactive[k]; v != NONE; v = nodes[v].bnext)
+			nodes[v].d = node_num;
+		active[k] = inactive[k] = NONE;
+	}
+	dmax = d-1;
+	if(amax > dmax) amax = dmax;
+}
+
+//pushes the excess of v to the admissible arcs, relabeling it when they are exhausted
+template <typename captype, typename tcaptype, typename flowtype>
+	void PushRelabelGraph<captype,tcaptype,flowtype>::discharge(int v)
+{
+	node& n = nodes[v];
+	int end = nodes[v+1].first;
+
+	while(1)
+	{
+		int d = n.d-1;
+		int a;
+		for(a = n.current; a < end; a++)
+		{
+			arc& e = arcs[a];
+			if(e.r_cap <= 0) continue;
+			node& w = nodes[e.head];
+			if(w.d != d) continue;
+
+			captype delta = (n.excess < e.r_cap) ? (captype)n.excess : e.r_cap;
+			e.r_cap -= delta;
+			arcs[e.sister].r_cap += delta;
+			n.excess -= delta;
+
+			tcaptype old = w.excess;
+			w.excess += delta;
+			if(old < 0)
+			{
+				//absorbed by the sink
+				flow += (-old < delta) ? -old : delta;
+			}
+			if(old <= 0 && w.excess > 0)
+			{
+				remove_inactive(e.head);
+				w.bnext = active[d];
+				active[d] = e.head;
+				if(d > amax) amax = d;
+			}
+
+			if(n.excess == 0) break;
+		}
+
+		if(a < end)
+		{
+			//all excess pushed, the current arc may still be admissible
+			n.current = a;
+			add_inactive(v);
+			return;
+		}
+
+		//relabel
+		d = n.d;
+		if(active[d] == NONE && inactive[d] == NONE)
+		{
+			//v was the last node with this label
+			n.d = node_num;
+			gap(d);
+			return;
+		}
+
+		int dmin = node_num;
+		int amin = n.first;
+		work += 12 + end-n.first;
+		for(a = n.first; a < end; a++)
+		{
+			if(arcs[a].r_cap > 0 && nodes[arcs[a].head].d < dmin)
+			{
+				dmin = nodes[arcs[a].head].d;
+				amin = a;
+			}
+		}
+		n.d = dmin+1;
+		n.current = amin;
+		if(n.d >= node_num)
+		{
+			n.d = node_num;
+			return;
+		}
+		if(n.d > dmax) dmax = n.d;
+	}
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	typename PushRelabelGraph<captype,tcaptype,flowtype>::termtype PushRelabelGraph<captype,tcaptype,flowtype>::what_segment(node_id i, termtype)
+{
+	if(!labels_valid)
+	{
+		if(!arcs_valid)
+			build_arcs();
+		global_relabel();
+		labels_valid = true;
+	}
+	return nodes[i].d < node_num ? SINK : SOURCE;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	flowtype PushRelabelGraph<captype,tcaptype,flowtype>::maxflow(bool)
+{
+	if(!arcs_valid)
+		build_arcs();
+
+	//the labels of the previous call are not valid anymore if the sink capacities have changed
+	global_relabel();
+
+	//frequency of the global relabels as in HIPR: twice per O(n+m) work in the relabels
+	//(in size_t: with 8-connectivity the int would overflow above about 100M pixels)
+	size_t globalUpdate = 2*(6*(size_t)node_num + arcs.size()/2);
+	while(amax >= 0)
+	{
+		int v = active[amax];
+		if(v == NONE)
+		{
+			amax--;
+			continue;
+		}
+		active[amax] = nodes[v].bnext;
+		discharge(v);
+
+		if(work > globalUpdate)
+			global_relabel();
+	}
+
+	//the exact labels for what_segment are computed only when they are asked for
+	labels_valid = false;
+
+	return flow;
+}
+
+#undef NONE
+
+#ifdef _MSC_VER
+#pragma warning(disable: 4661)
+#endif
+
+template class PushRelabelGraph<int,int,int>;
@@ -0,0 +1,123 @@
+/*
+This software contains the C++ implementation of the "branch-and-mincut" framework for image segmentation
+with various high-level priors as described in the paper:
+
+V. Lempitsky, A. Blake, C. Rother. Image Segmentation by Branch-and-Mincut.
+In proceedings of European Conference on Computer Vision (ECCV), October 2008.
+
+The software contains the core algorithm and an example of its application (globally-optimal
+segmentations under Chan-Vese functional).
+
+Implemented by Victor Lempitsky, 2008
+*/
+
+#ifndef PUSH_RELABEL_H
+#define PUSH_RELABEL_H
+
+#include <stddef.h>
+#include <vector>
+
+//Highest-label push-relabel maxflow (Goldberg-Tarjan, with the global relabeling and gap heuristics
+//as in Cherkassky and Goldberg, "On Implementing Push-Relabel Method for the Maximum Flow Problem").
+//The interface mirrors Graph from maxflow\graph.h so that both can be used by the same code:
+//add_node/add_edge build the graph, add_tweights can be called at any time, maxflow can be called repeatedly.
+//
+//Only the first phase is run: the result is a maximum preflow, which is enough for the flow value and the cut.
+//The preflow is kept between calls: add_tweights only reparameterizes the terminal capacities of a node
+//(exactly as in Graph), so the next maxflow starts from the previous residual network and only routes
+//the flow that has changed. Distance labels are recomputed by a global relabel at the start of each call,
+//so mark_node is not needed (it is accepted for compatibility).
+//
+//Edges must be added before the first call to maxflow (or after reset).
+template <typename captype, typename tcaptype, typename flowtype> class PushRelabelGraph
+{
+public:
+	typedef enum
+	{
+		SOURCE	= 0,
+		SINK	= 1
+	} termtype;
+	typedef int node_id;
+
+	//same meaning as in Graph: estimates of the number of nodes and edges
+	PushRelabelGraph(int node_num_max, int edge_num_max);
+
+	node_id add_node(int num = 1);
+	void add_edge(node_id i, node_id j, captype cap, captype rev_cap);
+	void add_tweights(node_id i, tcaptype cap_source, tcaptype cap_sink);
+
+	//computes the maxflow, starting from the current preflow. reuse_trees is ignored (the preflow is always reused)
+	flowtype maxflow(bool reuse_trees = false);
+
+	//SINK for the nodes that can still send flow to the sink in the residual network, SOURCE for the others.
+	//This is the same cut as the one returned by Graph (nodes that are free in Graph are reported as SOURCE).
+	termtype what_segment(node_id i, termtype default_segm = SOURCE);
+
+	void mark_node(node_id) {}
+
+	void reset();
+
+	//same as in Graph: restore_capacities brings back the capacities and the flow saved by save_capacities
+	void save_capacities();
+	void restore_capacities();
+	void set_saved_edge(int k, captype cap, captype rev_cap);
+
+	int get_node_num() { return node_num; }
+
+private:
+	struct node
+	{
+		int			first;		//first arc in the arcs array, the arcs of the node end at the first arc of the next node
+		int			current;	//current arc for the discharge
+		int			d;			//distance label, node_num if the sink is not reachable
+		int			bnext;		//next node in the bucket
+		int			bprev;		//previous node in the bucket (inactive buckets only)
+		tcaptype	excess;		//if excess > 0 then this is the excess of the preflow at the node,
+								//otherwise -excess is the residual capacity of the arc node->SINK
+	};
+
+	struct arc
+	{
+		int			head;
+		int			sister;		//reverse arc
+		captype		r_cap;		//residual capacity
+	};
+
+	struct edge
+	{
+		node_id		i, j;
+		captype		cap, rev_cap;
+	};
+
+	std::vector<node>	nodes;		//node_num+1 entries, the last one terminates the arc list of the last node
+	std::vector<arc>	arcs;
+	std::vector<edge>	edges;		//edges added since the last rebuild of the arcs array
+	std::vector<int>	edge_arc;	//arc from i to j of each edge
+	int					node_num;
+	bool				arcs_valid;
+	bool				labels_valid;	//false if the labels have to be recomputed before what_segment
+
+	flowtype			flow;
+
+	std::vector<captype>	saved_rcap;		//set by save_capacities
+	std::vector<tcaptype>	saved_excess;
+	flowtype				saved_flow;
+
+	//buckets indexed by the distance label
+	std::vector<int>	active;		//stacks of active nodes
+	std::vector<int>	inactive;	//doubly linked lists of the other nodes with d < node_num
+	int					amax;		//no active nodes above this label
+	int					dmax;		//no nodes with d < node_num above this label
+	std::vector<int>	queue;		//for the breadth first search
+	size_t				work;		//work since the last global relabel
+
+	void build_arcs();
+	void global_relabel();
+	void discharge(int v);
+	void gap(int d);
+
+	void add_inactive(int v);
+	void remove_inactive(int v);
+};
+
+#endif
@@ -0,0 +1,146 @@
+/*
+This software contains the C++ implementation of the "branch-and-mincut" framework for image segmentation
+with various high-level priors as described in the paper:
+
+V. Lempitsky, A. Blake, C. Rother. Image Segmentation by Branch-and-Mincut.
+In proceedings of European Conference on Computer Vision (ECCV), October 2008.
+
+The software contains the core algorithm and an example of its application (globally-optimal
+segmentations under Chan-Vese functional).
+
+Implemented by Victor Lempitsky, 2008
+*/
+
+#include "ScratchStorage.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+//////////////////////////////////////////////
+
+struct ScratchMapping
+{
+	size_t size;
+#ifdef _WIN32
+	HANDLE file, mapping;
+#endif
+};
+
+static std::string scratchDirectory; //empty for the heap
+static std::map<void *, ScratchMapping> scratchMappings; //the arrays that are mapped files
+
+void SetScratchDirectory(const char *dir)
+{
+#pragma omp critical(scratchStorage)
+	scratchDirectory = dir ? dir : "";
+}
+
+const char *GetScratchDirectory()
+{
+	return scratchDirectory.empty() ? NULL : scratchDirectory.c_str();
+}
+
+//a new file of size bytes in the directory mapped for reading and writing, NULL on failure
+static void *mapScratchFile(const std::string& dir, size_t size, ScratchMapping& m)
+{
+	m.size = size;
+#ifdef _WIN32
+	char name[MAX_PATH];
+	if(!GetTempFileNameA(dir.c_str(), "bm", 0, name)) return NULL;
+	m.file = CreateFileA(name, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+		FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+	if(m.file == INVALID_HANDLE_VALUE) { DeleteFileA(name); return NULL; }
+	m.mapping = CreateFileMappingA(m.file, NULL, PAGE_READWRITE, (DWORD)((unsigned long long)size >> 32), (DWORD)size, NULL);
+	if(!m.mapping) { CloseHandle(m.file); return NULL; }
+	void *base = MapViewOfFile(m.mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+	if(!base) { CloseHandle(m.mapping); CloseHandle(m.file); return NULL; }
+	return base;
+#else
+	std::string name = dir+"/bmXXXXXX";
+	int fd = mkstemp(&name[0]);
+	if(fd < 0) return NULL;
+	unlink(name.c_str()); //the file lives as long as the mapping
+	if(ftruncate(fd, (off_t)size)) { close(fd); return NULL; }
+	void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	return base == MAP_FAILED ? NULL : base;
+#endif
+}
+
+static void unmapScratchFile(void *base, ScratchMapping& m)
+{
+#ifdef _WIN32
+	UnmapViewOfFile(base);
+	CloseHandle(m.mapping);
+	CloseHandle(m.file);
+#else
+	munmap(base, m.size);
+#endif
+}
+
+void *ScratchAlloc(size_t bytes)
+{
+	std::string dir;
+#pragma omp critical(scratchStorage)
+	dir = scratchDirectory;
+	if(dir.empty() || bytes < SCRATCH_MIN_BYTES)
+		return malloc(bytes);
+
+	ScratchMapping m;
+	void *base = mapScratchFile(dir, bytes, m);
+	if(!base)
+		return NULL;
+#pragma omp critical(scratchStorage)
+	scratchMappings[base] = m;
+	return base;
+}
+
+void *ScratchRealloc(void *ptr, size_t oldBytes, size_t bytes)
+{
+	if(!ptr)
+		return ScratchAlloc(bytes);
+	bool mapped;
+#pragma omp critical(scratchStorage)
+	mapped = scratchMappings.count(ptr) != 0;
+	//heap arrays stay on the heap while they are small
+	if(!mapped && (bytes < SCRATCH_MIN_BYTES || !GetScratchDirectory()))
+		return realloc(ptr, bytes);
+
+	void *moved = ScratchAlloc(bytes);
+	if(!moved)
+		return NULL;
+	memcpy(moved, ptr, oldBytes < bytes ? oldBytes : bytes);
+	ScratchFree(ptr);
+	return moved;
+}
+
+void ScratchFree(void *ptr)
+{
+	if(!ptr)
+		return;
+	bool mapped;
+	ScratchMapping m;
+#pragma omp critical(scratchStorage)
+	{
+		std::map<void *, ScratchMapping>::iterator found = scratchMappings.find(ptr);
+		mapped = found != scratchMappings.end();
+		if(mapped)
+		{
+			m = found->second;
+			scratchMappings.erase(found);
+		}
+	}
+	if(mapped)
+		unmapScratchFile(ptr, m);
+	else
+		free(ptr);
+}
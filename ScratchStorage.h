@@ -0,0 +1,37 @@
+/*
+This software contains the C++ implementation of the "branch-and-mincut" framework for image segmentation
+with various high-level priors as described in the paper:
+
+V. Lempitsky, A. Blake, C. Rother. Image Segmentation by Branch-and-Mincut.
+In proceedings of European Conference on Computer Vision (ECCV), October 2008.
+
+The software contains the core algorithm and an example of its application (globally-optimal
+segmentations under Chan-Vese functional).
+
+Implemented by Victor Lempitsky, 2008
+*/
+
+#ifndef SCRATCH_STORAGE_H
+#define SCRATCH_STORAGE_H
+
+#include <stddef.h>
+
+//Storage of the large arrays of the graphs (nodes, arcs, saved capacities, edge lists, persistency contractions, unaries,
+//pairwise terms) for images that do not fit into the physical memory. By default they are on the heap. After
+//SetScratchDirectory(dir) every new array of at least SCRATCH_MIN_BYTES is a shared mapping of its own temporary file
+//in dir (deleted when the array is freed, or at once where the system allows it), so the system writes its pages out
+//to the file instead of running out of memory.
+//This is slower, most of all if the pages are not accessed locally (see NODE_ORDER_TILES).
+//The functions follow malloc, realloc and free (NULL if the storage cannot be allocated; ScratchRealloc also needs the old
+//size) and can be called from any thread. The directory applies to the whole process, NULL switches back to the heap
+//for the next arrays.
+#define SCRATCH_MIN_BYTES (1 << 20)
+
+void SetScratchDirectory(const char *dir);
+const char *GetScratchDirectory(); //NULL for the heap
+
+void *ScratchAlloc(size_t bytes);
+void *ScratchRealloc(void *ptr, size_t oldBytes, size_t bytes);
+void ScratchFree(void *ptr);
+
+#endif
@@ -0,0 +1,515 @@
+/*
+This software contains the C++ implementation of the "branch-and-mincut" framework for image segmentation
+with various high-level priors as described in the paper:
+
+V. Lempitsky, A. Blake, C. Rother. Image Segmentation by Branch-and-Mincut.
+In proceedings of European Conference on Computer Vision (ECCV), October 2008.
+
+The software contains the core algorithm and an example of its application (globally-optimal
+segmentations under Chan-Vese functional).
+
+Implemented by Victor Lempitsky, 2008
+*/
+
+#include "SegmentationOutput.h"
+#include "imageio.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define USE_SSE2
+#include <emmintrin.h>
+#endif
+
+void SegmentationToMask(const int *segm, int n, unsigned char *mask)
+{
+	int i = 0;
+#ifdef USE_SSE2
+	//16 labels at a time: pack to bytes with saturation, then turn every non-zero byte into 255
+	const __m128i zero = _mm_setzero_si128();
+	for(; i+16 <= n; i += 16)
+	{
+		__m128i a = _mm_packs_epi32(_mm_loadu_si128((const __m128i *)(segm+i)), _mm_loadu_si128((const __m128i *)(segm+i+4)));
+		__m128i b = _mm_packs_epi32(_mm_loadu_si128((const __m128i *)(segm+i+8)), _mm_loadu_si128((const __m128i *)(segm+i+12)));
+		__m128i bytes = _mm_packs_epi16(a, b);
+		_mm_storeu_si128((__m128i *)(mask+i), _mm_andnot_si128(_mm_cmpeq_epi8(bytes, zero), _mm_set1_epi8(-1)));
+	}
+#endif
+	for(; i < n; i++)
+		mask[i] = segm[i] ? 255 : 0;
+}
+
+void SegmentationToMask(const PackedMask& segm, unsigned char *mask)
+{
+	int n = segm.width*segm.height;
+	for(int i = 0; i < n; i += 32)
+	{
+		unsigned int word = segm.bits[i >> 5];
+		int end = n-i < 32 ? n-i : 32;
+		for(int k = 0; k < end; k++)
+			mask[i+k] = (unsigned char)(0u - ((word >> k) & 1));
+	}
+}
+
+void PackedMaskToRuns(const PackedMask& segm, std::vector<int>& runs)
+{
+	int n = segm.width*segm.height;
+	int label = 0, runStart = 0;
+	runs.clear();
+	for(int i = 0; i < n; i += 32)
+	{
+		unsigned int word = segm.bits[i >> 5];
+		int end = n-i < 32 ? n-i : 32;
+		//whole words without a label change are skipped at once
+		if(end == 32 && word == (label ? 0xFFFFFFFFu : 0u))
+			continue;
+		for(int k = 0; k < end; k++)
+			if((int)((word >> k) & 1) != label)
+			{
+				runs.push_back(i+k-runStart);
+				runStart = i+k;
+				label ^= 1;
+			}
+	}
+	runs.push_back(n-runStart);
+}
+
+inline void paintBoundary(unsigned char *p)
+{
+	p[0] = 0;
+	p[1] = 0;
+	p[2] = 255;
+}
+
+//a pixel is on the boundary if its label differs from one of its 4 neighbours.
+//Labels are compared with xor, so the mask may hold any byte values.
+void DrawBoundary24bpp(unsigned char *bgr, const unsigned char *mask, int w, int h)
+{
+	for(int y = 0; y < h; y++)
+	{
+		const unsigned char *row = mask + (size_t)w*y;
+		const unsigned char *up = y > 0 ? row-w : row; //comparing with itself at the image border
+		const unsigned char *down = y < h-1 ? row+w : row;
+		unsigned char *out = bgr + (size_t)3*w*y;
+
+		//the first and the last pixel of the row are handled by the scalar loop
+		int x = 1;
+		if(w > 1 && ((row[0] ^ row[1]) | (row[0] ^ up[0]) | (row[0] ^ down[0])))
+			paintBoundary(out);
+#ifdef USE_SSE2
+		const __m128i zero = _mm_setzero_si128();
+		for(; x+16 <= w-1; x += 16)
+		{
+			__m128i c = _mm_loadu_si128((const __m128i *)(row+x));
+			__m128i diff = _mm_or_si128(
+				_mm_or_si128(_mm_xor_si128(c, _mm_loadu_si128((const __m128i *)(row+x-1))),
+							 _mm_xor_si128(c, _mm_loadu_si128((const __m128i *)(row+x+1)))),
+				_mm_or_si128(_mm_xor_si128(c, _mm_loadu_si128((const __m128i *)(up+x))),
+							 _mm_xor_si128(c, _mm_loadu_si128((const __m128i *)(down+x)))));
+			int bits = _mm_movemask_epi8(_mm_cmpeq_epi8(diff, zero)) ^ 0xFFFF;
+			for(int k = 0; bits; k++, bits >>= 1)
+				if(bits & 1)
+					paintBoundary(out + 3*(x+k));
+		}
+#endif
+		for(; x < w-1; x++)
+			if((row[x] ^ row[x-1]) | (row[x] ^ row[x+1]) | (row[x] ^ up[x]) | (row[x] ^ down[x]))
+				paintBoundary(out + 3*x);
+		if(w > 1 && ((row[w-1] ^ row[w-2]) | (row[w-1] ^ up[w-1]) | (row[w-1] ^ down[w-1])))
+			paintBoundary(out + 3*(w-1));
+		else if(w == 1 && ((row[0] ^ up[0]) | (row[0] ^ down[0])))
+			paintBoundary(out);
+	}
+}
+
+static bool writeMaskAndOverlay(const unsigned char *mask, int w, int h, const char *imagePath,
+								const char *maskFile, const char *overlayFile)
+{
+	bool ok = true;
+	if(maskFile)
+		ok = WriteImage(maskFile, mask, w, h, w, PIXEL_GRAY8);
+
+	if(overlayFile)
+	{
+		int iw, ih;
+		unsigned char *bgr = NULL;
+		if(ReadImageSize(imagePath, iw, ih) && iw == w && ih == h)
+			bgr = (unsigned char *)AllocAligned((size_t)3*w*h);
+		if(bgr && DecodeImage(imagePath, bgr, 3*w, PIXEL_BGR24))
+		{
+			DrawBoundary24bpp(bgr, mask, w, h);
+			ok = WriteImage(overlayFile, bgr, w, h, 3*w, PIXEL_BGR24) && ok;
+		}
+		else
+			ok = false;
+		FreeAligned(bgr);
+	}
+	return ok;
+}
+
+bool WriteSegmentation(const int *segm, int w, int h, const char *imagePath,
+					   const char *maskFile, const char *overlayFile)
+{
+	if(!maskFile && !overlayFile)
+		return true;
+
+	unsigned char *mask = (unsigned char *)AllocAligned((size_t)w*h);
+	if(!mask) return false;
+	SegmentationToMask(segm, w*h, mask);
+	bool ok = writeMaskAndOverlay(mask, w, h, imagePath, maskFile, overlayFile);
+	FreeAligned(mask);
+	return ok;
+}
+
+//binary PGM written row by row from the packed bits, without a buffer of the whole mask
+static bool writePackedMaskPgm(const PackedMask& segm, const char *filename)
+{
+	FILE *f = fopen(filename, "wb");
+	if(!f) return false;
+	int w = segm.width, h = segm.height;
+	fprintf(f, "P5\n%d %d\n255\n", w, h);
+	unsigned char *row = (unsigned char *)malloc(w > 0 ? w : 1);
+	bool ok = row != NULL;
+	for(int y = 0; ok && y < h; y++)
+	{
+		for(int x = 0; x < w; x++)
+			row[x] = segm.Get(y*w+x) ? 255 : 0;
+		ok = fwrite(row, 1, w, f) == (size_t)w;
+	}
+	free(row);
+	return fclose(f) == 0 && ok;
+}
+
+bool WriteSegmentation(const PackedMask& segm, const char *imagePath, const char *maskFile, const char *overlayFile)
+{
+	if(!maskFile && !overlayFile)
+		return true;
+
+	size_t len = maskFile ? strlen(maskFile) : 0;
+	if(maskFile && !overlayFile && !(len >= 4 && (!strcmp(maskFile+len-4, ".png") || !strcmp(maskFile+len-4, ".PNG"))))
+		return writePackedMaskPgm(segm, maskFile);
+
+	int w = segm.width, h = segm.height;
+	unsigned char *mask = (unsigned char *)AllocAligned((size_t)w*h);
+	if(!mask) return false;
+	SegmentationToMask(segm, mask);
+	bool ok = writeMaskAndOverlay(mask, w, h, imagePath, maskFile, overlayFile);
+	FreeAligned(mask);
+	return ok;
+}
+
+//////////////////////////////////////////////
+
+//marching squares. Cell (x,y), 0 <= x <= w, 0 <= y <= h, has the pixels (x-1,y-1), (x,y-1), (x,y), (x-1,y)
+//as its corners; pixels outside the image are background. Contour vertices are the midpoints of the
+//cell edges, identified by the pair of pixels they separate.
+
+enum { EDGE_TOP, EDGE_RIGHT, EDGE_BOTTOM, EDGE_LEFT };
+
+//edges joined by the segments of each cell case (bit 1 - top-left corner, 2 - top-right,
+//4 - bottom-right, 8 - bottom-left); -1 terminates the list
+static const signed char cellSegments[16][5] = {
+	{-1}, {EDGE_TOP, EDGE_LEFT, -1}, {EDGE_TOP, EDGE_RIGHT, -1}, {EDGE_LEFT, EDGE_RIGHT, -1},
+	{EDGE_RIGHT, EDGE_BOTTOM, -1}, {EDGE_TOP, EDGE_LEFT, EDGE_RIGHT, EDGE_BOTTOM, -1}, {EDGE_TOP, EDGE_BOTTOM, -1}, {EDGE_LEFT, EDGE_BOTTOM, -1},
+	{EDGE_LEFT, EDGE_BOTTOM, -1}, {EDGE_TOP, EDGE_BOTTOM, -1}, {EDGE_TOP, EDGE_RIGHT, EDGE_LEFT, EDGE_BOTTOM, -1}, {EDGE_RIGHT, EDGE_BOTTOM, -1},
+	{EDGE_LEFT, EDGE_RIGHT, -1}, {EDGE_TOP, EDGE_RIGHT, -1}, {EDGE_TOP, EDGE_LEFT, -1}, {-1}
+};
+
+struct ContourTracer
+{
+	int w, h;
+	int hCount; //vertices on horizontal pixel pairs: h*(w+1), followed by w*(h+1) on vertical pairs
+	int *next; //next vertex along the contour, -1 if the vertex is not on a contour
+
+	int VertexId(int x, int y, int edge) const
+	{
+		switch(edge)
+		{
+		case EDGE_TOP: return (y-1)*(w+1)+x;
+		case EDGE_BOTTOM: return y*(w+1)+x;
+		case EDGE_LEFT: return hCount + y*w + x-1;
+		default: return hCount + y*w + x;
+		}
+	}
+	void VertexCoords(int id, int& px, int& py) const //half-pixel units
+	{
+		if(id < hCount)
+		{
+			px = 2*(id % (w+1))-1;
+			py = 2*(id / (w+1));
+		}
+		else
+		{
+			px = 2*((id-hCount) % w);
+			py = 2*((id-hCount) / w)-1;
+		}
+	}
+};
+
+static void buildContourLinks(const PackedMask& segm, ContourTracer& t)
+{
+	int w = segm.width, h = segm.height;
+	t.w = w;
+	t.h = h;
+	t.hCount = h*(w+1);
+	int n = t.hCount + w*(h+1);
+	t.next = new int[n];
+	for(int i = 0; i < n; i++) t.next[i] = -1;
+
+	for(int y = 0; y <= h; y++)
+		for(int x = 0; x <= w; x++)
+		{
+			int tl = x > 0 && y > 0 ? segm.Get((y-1)*w+x-1) : 0;
+			int tr = x < w && y > 0 ? segm.Get((y-1)*w+x) : 0;
+			int br = x < w && y < h ? segm.Get(y*w+x) : 0;
+			int bl = x > 0 && y < h ? segm.Get(y*w+x-1) : 0;
+			int c = tl | (tr << 1) | (br << 2) | (bl << 3);
+			if(c == 0 || c == 15) continue;
+
+			//corners and edge midpoints in half-pixel units
+			int cx[4] = {2*x-2, 2*x, 2*x, 2*x-2}, cy[4] = {2*y-2, 2*y-2, 2*y, 2*y}; //TL, TR, BR, BL
+			int ex[4] = {2*x-1, 2*x, 2*x-1, 2*x-2}, ey[4] = {2*y-2, 2*y-1, 2*y, 2*y-1}; //top, right, bottom, left
+			for(const signed char *s = cellSegments[c]; *s >= 0; s += 2)
+			{
+				int a = s[0], b = s[1];
+				//a corner on a known side of the segment: the one shared by both edges, or top-left
+				//for segments crossing the cell (top-left is shared by the top and the left edge)
+				int corner = 0;
+				if((a+1)%4 == b) corner = b;
+				else if((b+1)%4 == a) corner = a;
+				int fg = (c >> corner) & 1;
+				//the corner is on the left of a->b if the cross product is positive (y pointing down)
+				int dx = ex[b]-ex[a], dy = ey[b]-ey[a];
+				int side = dy*(cx[corner]-ex[a]) - dx*(cy[corner]-ey[a]);
+				if((side > 0) != (fg != 0))
+				{
+					int tmp = a;
+					a = b;
+					b = tmp;
+				}
+				t.next[t.VertexId(x, y, a)] = t.VertexId(x, y, b);
+			}
+		}
+}
+
+//removes the vertices lying on the line through their neighbours
+static void removeCollinear(std::vector<int>& pts)
+{
+	int n = (int)pts.size()/2, m = 0;
+	std::vector<int> out;
+	out.reserve(pts.size());
+	for(int i = 0; i < n; i++)
+	{
+		int p = (i+n-1)%n, q = (i+1)%n;
+		long long cross = (long long)(pts[2*i]-pts[2*p])*(pts[2*q+1]-pts[2*i+1]) -
+						  (long long)(pts[2*i+1]-pts[2*p+1])*(pts[2*q]-pts[2*i]);
+		if(cross)
+		{
+			out.push_back(pts[2*i]);
+			out.push_back(pts[2*i+1]);
+			m++;
+		}
+	}
+	if(m >= 3)
+		pts.swap(out);
+}
+
+static void douglasPeucker(const std::vector<int>& pts, int first, int last, double tol2, std::vector<char>& keep)
+{
+	int n = (int)pts.size()/2;
+	double ax = pts[2*first], ay = pts[2*first+1];
+	double bx = pts[2*(last%n)], by = pts[2*(last%n)+1];
+	double dx = bx-ax, dy = by-ay, len2 = dx*dx+dy*dy;
+	double best = -1;
+	int bestIdx = -1;
+	for(int i = first+1; i < last; i++)
+	{
+		double px = pts[2*i]-ax, py = pts[2*i+1]-ay, d2;
+		if(len2 > 0)
+		{
+			double cross = px*dy - py*dx;
+			d2 = cross*cross/len2;
+		}
+		else
+			d2 = px*px+py*py;
+		if(d2 > best)
+		{
+			best = d2;
+			bestIdx = i;
+		}
+	}
+	if(bestIdx >= 0 && best > tol2)
+	{
+		keep[bestIdx] = 1;
+		douglasPeucker(pts, first, bestIdx, tol2, keep);
+		douglasPeucker(pts, bestIdx, last, tol2, keep);
+	}
+}
+
+//closed-polygon simplification: the polygon is split at vertex 0 and the vertex farthest from it
+static void simplifyContour(std::vector<int>& pts, double tolerance)
+{
+	int n = (int)pts.size()/2;
+	if(n <= 4) return;
+	double tol2 = 4*tolerance*tolerance; //half-pixel units
+	int far = 0;
+	double farD = -1;
+	for(int i = 1; i < n; i++)
+	{
+		double dx = pts[2*i]-pts[0], dy = pts[2*i+1]-pts[1];
+		if(dx*dx+dy*dy > farD)
+		{
+			farD = dx*dx+dy*dy;
+			far = i;
+		}
+	}
+	std::vector<char> keep(n, 0);
+	keep[0] = keep[far] = 1;
+	douglasPeucker(pts, 0, far, tol2, keep);
+	douglasPeucker(pts, far, n, tol2, keep);
+
+	std::vector<int> out;
+	for(int i = 0; i < n; i++)
+		if(keep[i])
+		{
+			out.push_back(pts[2*i]);
+			out.push_back(pts[2*i+1]);
+		}
+	if(out.size() >= 6)
+		pts.swap(out);
+}
+
+//follows all contours, passing each finished polygon to the callback
+static void traceContours(const PackedMask& segm, double tolerance,
+						  void (*emit)(const std::vector<int>& pts, bool hole, void *ctx), void *ctx)
+{
+	ContourTracer t;
+	buildContourLinks(segm, t);
+	int n = t.hCount + t.w*(t.h+1);
+	std::vector<int> pts;
+	for(int start = 0; start < n; start++)
+	{
+		if(t.next[start] < 0) continue;
+		pts.clear();
+		long long area2 = 0; //twice the signed area
+		int v = start;
+		do
+		{
+			int x, y, nx, ny, nv = t.next[v];
+			t.next[v] = -1;
+			t.VertexCoords(v, x, y);
+			t.VertexCoords(nv, nx, ny);
+			pts.push_back(x);
+			pts.push_back(y);
+			area2 += (long long)x*ny - (long long)nx*y;
+			v = nv;
+		}
+		while(v != start);
+		removeCollinear(pts);
+		if(tolerance > 0)
+			simplifyContour(pts, tolerance);
+		//foreground on the left with y pointing down makes outer boundaries negative
+		emit(pts, area2 > 0, ctx);
+	}
+	delete[] t.next;
+}
+
+static void appendContour(const std::vector<int>& pts, bool hole, void *ctx)
+{
+	std::vector<Contour>& contours = *(std::vector<Contour> *)ctx;
+	contours.push_back(Contour());
+	contours.back().points = pts;
+	contours.back().hole = hole;
+}
+
+void TraceContours(const PackedMask& segm, double tolerance, std::vector<Contour>& contours)
+{
+	contours.clear();
+	traceContours(segm, tolerance, appendContour, &contours);
+}
+
+//Binary contour format (little-endian):
+//  "BMCT", uint32 width, uint32 height
+//  per polygon: uint8 flags (1 = hole), varint vertex count, then for every vertex the zigzag varint
+//  deltas of x and y in half-pixel units (the first vertex relative to (0,0))
+//  terminated by a polygon with flags 0 and count 0
+struct ContourFile
+{
+	FILE *f;
+	ContourFormat format;
+	int count;
+};
+
+static void putVarint(FILE *f, unsigned int v)
+{
+	while(v >= 128)
+	{
+		fputc((int)(v & 127) | 128, f);
+		v >>= 7;
+	}
+	fputc((int)v, f);
+}
+
+static void putUint32(FILE *f, unsigned int v)
+{
+	for(int k = 0; k < 4; k++) fputc((int)((v >> (8*k)) & 255), f);
+}
+
+static void writeContour(const std::vector<int>& pts, bool hole, void *ctx)
+{
+	ContourFile& cf = *(ContourFile *)ctx;
+	int n = (int)pts.size()/2;
+	if(cf.format == CONTOUR_BINARY)
+	{
+		fputc(hole ? 1 : 0, cf.f);
+		putVarint(cf.f, n);
+		int px = 0, py = 0;
+		for(int i = 0; i < n; i++)
+		{
+			int dx = pts[2*i]-px, dy = pts[2*i+1]-py;
+			putVarint(cf.f, (unsigned int)((dx << 1) ^ (dx >> 31)));
+			putVarint(cf.f, (unsigned int)((dy << 1) ^ (dy >> 31)));
+			px = pts[2*i];
+			py = pts[2*i+1];
+		}
+	}
+	else
+	{
+		fprintf(cf.f, "%s\n{\"hole\":%s,\"points\":[", cf.count ? "," : "", hole ? "true" : "false");
+		for(int i = 0; i < 2*n; i++)
+			fprintf(cf.f, "%s%g", i ? "," : "", 0.5*pts[i]);
+		fputs("]}", cf.f);
+	}
+	cf.count++;
+}
+
+bool WriteContours(const PackedMask& segm, const char *filename, ContourFormat format, double tolerance)
+{
+	ContourFile cf;
+	cf.f = fopen(filename, "wb");
+	if(!cf.f) return false;
+	cf.format = format;
+	cf.count = 0;
+
+	if(format == CONTOUR_BINARY)
+	{
+		fwrite("BMCT", 1, 4, cf.f);
+		putUint32(cf.f, segm.width);
+		putUint32(cf.f, segm.height);
+	}
+	else
+		fprintf(cf.f, "{\"width\":%d,\"height\":%d,\"contours\":[", segm.width, segm.height);
+
+	traceContours(segm, tolerance, writeContour, &cf);
+
+	if(format == CONTOUR_BINARY)
+	{
+		fputc(0, cf.f);
+		fputc(0, cf.f);
+	}
+	else
+		fputs("\n]}\n", cf.f);
+	bool ok = !ferror(cf.f);
+	return fclose(cf.f) == 0 && ok;
+}
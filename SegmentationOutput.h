@@ -0,0 +1,67 @@
+/*
+This software contains the C++ implementation of the "branch-and-mincut" framework for image segmentation
+with various high-level priors as described in the paper:
+
+V. Lempitsky, A. Blake, C. Rother. Image Segmentation by Branch-and-Mincut.
+In proceedings of European Conference on Computer Vision (ECCV), October 2008.
+
+The software contains the core algorithm and an example of its application (globally-optimal
+segmentations under Chan-Vese functional).
+
+Implemented by Victor Lempitsky, 2008
+*/
+
+#ifndef SEGMENTATION_OUTPUT_H
+#define SEGMENTATION_OUTPUT_H
+
+#include "BranchAndMincut.h"
+#include <vector>
+
+//Headless output stage: writes segmentation results to files without any GUI.
+//Everything works on 8-bit buffers; no step is needed unless the corresponding output is requested.
+
+//converts a 0/1 segmentation (as returned by BranchAndMincut) into an 8-bit mask with 255 for the foreground
+void SegmentationToMask(const int *segm, int n, unsigned char *mask);
+void SegmentationToMask(const PackedMask& segm, unsigned char *mask);
+
+//run-length encoding of a packed segmentation in row-major order: alternating lengths of
+//background and foreground runs, starting with background (the first run can be empty)
+void PackedMaskToRuns(const PackedMask& segm, std::vector<int>& runs);
+
+//Vector output: the segmentation is traced into closed polygons with marching squares.
+//Vertices lie on the midpoints between neighbouring pixel centres and are stored in half-pixel
+//units (pixel (x,y) has its centre at (2x,2y)). Foreground is on the left of each polygon when
+//walking along it in image coordinates (y pointing down), so outer boundaries and holes have
+//opposite orientations. Diagonally touching foreground pixels are treated as separate regions.
+struct Contour
+{
+	std::vector<int> points; //x0, y0, x1, y1, ... in half-pixel units, the closing edge is implicit
+	bool hole; //true if the polygon encloses background inside a foreground region
+};
+
+//traces all contours. With tolerance > 0 (in pixels) the polygons are simplified with Douglas-Peucker;
+//collinear vertices are always removed, which is lossless.
+void TraceContours(const PackedMask& segm, double tolerance, std::vector<Contour>& contours);
+
+enum ContourFormat
+{
+	CONTOUR_JSON,  //{"width":w,"height":h,"contours":[{"hole":false,"points":[x0,y0,...]},...]} in pixel units
+	CONTOUR_BINARY //see WriteContours in the cpp file
+};
+
+//traces the contours and streams each polygon to the file as soon as it is closed
+bool WriteContours(const PackedMask& segm, const char *filename, ContourFormat format, double tolerance);
+
+//paints the pixels on the boundary of the mask (4-connectivity) red in a BGR image.
+//Same result as DrawSegmentation24bpp in image.h
+void DrawBoundary24bpp(unsigned char *bgr, const unsigned char *mask, int w, int h);
+
+//writes the mask and/or the boundary overlay on top of the colour image at imagePath.
+//Pass NULL as maskFile or overlayFile to skip that output (the image is only decoded for the overlay).
+//PNG is written for ".png" names, PGM/PPM otherwise. Returns false if any requested file failed.
+//A PGM mask without an overlay is written row by row from the packed segmentation (no buffer of the image size).
+bool WriteSegmentation(const int *segm, int w, int h, const char *imagePath,
+					   const char *maskFile, const char *overlayFile);
+bool WriteSegmentation(const PackedMask& segm, const char *imagePath, const char *maskFile, const char *overlayFile);
+
+#endif
@@ -0,0 +1,114 @@
+/*
+This software contains the C++ implementation of the "branch-and-mincut" framework for image segmentation
+with various high-level priors as described in the paper:
+
+V. Lempitsky, A. Blake, C. Rother. Image Segmentation by Branch-and-Mincut.
+In proceedings of European Conference on Computer Vision (ECCV), October 2008.
+
+The software contains the core algorithm and an example of its application (globally-optimal
+segmentations under Chan-Vese functional).
+
+Implemented by Victor Lempitsky, 2008
+*/
+
+#include "Superpixels.h"
+#include <stdlib.h>
+#include <vector>
+
+//union-find forest of the regions
+struct Regions
+{
+	std::vector<int> parent;
+	std::vector<int> size; //pixels of each region (valid at the roots)
+	std::vector<int> internal; //largest edge merged into each region (valid at the roots)
+
+	Regions(int n): parent(n), size(n, 1), internal(n, 0)
+	{
+		for(int i = 0; i < n; i++)
+			parent[i] = i;
+	}
+
+	int Find(int i)
+	{
+		int root = i;
+		while(parent[root] != root)
+			root = parent[root];
+		while(parent[i] != root)
+		{
+			int next = parent[i];
+			parent[i] = root;
+			i = next;
+		}
+		return root;
+	}
+
+	//the edges come in increasing order, so diff is the largest edge of the joined region
+	void Join(int a, int b, int diff)
+	{
+		if(size[a] < size[b])
+		{
+			int t = a;
+			a = b;
+			b = t;
+		}
+		parent[b] = a;
+		size[a] += size[b];
+		internal[a] = diff;
+	}
+};
+
+int ComputeSuperpixels(const unsigned char *image, int w, int h, int scale, int minSize, int *labels)
+{
+	int n = w*h, i, k, x, y;
+
+	//edge 2i goes from pixel i to the right, 2i+1 down. They are bucketed by the intensity difference
+	std::vector<int> start(257, 0), order;
+	for(y = 0; y < h; y++)
+		for(x = 0; x < w; x++)
+		{
+			i = y*w+x;
+			if(x+1 < w)
+				start[abs(image[i]-image[i+1])+1]++;
+			if(y+1 < h)
+				start[abs(image[i]-image[i+w])+1]++;
+		}
+	for(k = 1; k <= 256; k++)
+		start[k] += start[k-1];
+	order.resize(start[256]);
+	for(y = 0; y < h; y++)
+		for(x = 0; x < w; x++)
+		{
+			i = y*w+x;
+			if(x+1 < w)
+				order[start[abs(image[i]-image[i+1])]++] = 2*i;
+			if(y+1 < h)
+				order[start[abs(image[i]-image[i+w])]++] = 2*i+1;
+		}
+
+	Regions regions(n);
+	for(int pass = 0; pass < 2; pass++)
+		for(k = 0; k < (int)order.size(); k++)
+		{
+			int p = order[k] >> 1, q = order[k] & 1 ? p+w : p+1;
+			int diff = abs(image[p]-image[q]);
+			int a = regions.Find(p), b = regions.Find(q);
+			if(a == b)
+				continue;
+			if(pass == 0 ? diff <= regions.internal[a]+double(scale)/regions.size[a] &&
+							diff <= regions.internal[b]+double(scale)/regions.size[b] :
+						   regions.size[a] < minSize || regions.size[b] < minSize)
+				regions.Join(a, b, diff);
+		}
+
+	//numbering the roots
+	std::vector<int> id(n, -1);
+	int count = 0;
+	for(i = 0; i < n; i++)
+	{
+		int root = regions.Find(i);
+		if(id[root] < 0)
+			id[root] = count++;
+		labels[i] = id[root];
+	}
+	return count;
+}
@@ -0,0 +1,25 @@
+/*
+This software contains the C++ implementation of the "branch-and-mincut" framework for image segmentation
+with various high-level priors as described in the paper:
+
+V. Lempitsky, A. Blake, C. Rother. Image Segmentation by Branch-and-Mincut.
+In proceedings of European Conference on Computer Vision (ECCV), October 2008.
+
+The software contains the core algorithm and an example of its application (globally-optimal
+segmentations under Chan-Vese functional).
+
+Implemented by Victor Lempitsky, 2008
+*/
+
+#ifndef SUPERPIXELS_H
+#define SUPERPIXELS_H
+
+//Superpixels for the approximate (preview) mode: connected regions of similar intensity of an 8-bit image, found with
+//the graph-based segmentation of P. Felzenszwalb, D. Huttenlocher, "Efficient Graph-Based Image Segmentation", IJCV 2004.
+//The edges of the 4-connected grid are processed by increasing intensity difference (a counting sort, as the differences
+//are 0..255), and two regions are merged if their edge is not larger than the largest edge inside either of them plus
+//scale/size of that region. Regions smaller than minSize pixels are merged into a neighbour at the end.
+//The time is linear in the number of pixels. Fills labels[w*h] with 0..count-1 and returns count
+int ComputeSuperpixels(const unsigned char *image, int w, int h, int scale, int minSize, int *labels);
+
+#endif
@@ -0,0 +1,163 @@
+/*
+This software contains the C++ implementation of the "branch-and-mincut" framework for image segmentation
+with various high-level priors as described in the paper:
+
+V. Lempitsky, A. Blake, C. Rother. Image Segmentation by Branch-and-Mincut.
+In proceedings of European Conference on Computer Vision (ECCV), October 2008.
+
+The software contains the core algorithm and an example of its application (globally-optimal
+segmentations under Chan-Vese functional).
+
+Implemented by Victor Lempitsky, 2008
+*/
+
+#include "TiledMincut.h"
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+//unaries of the leaf and the pairwise terms: what each pixel pays for either label, with the commonUnaries split as
+//in the graph of BranchAndMincut (so the energies agree with the bounds)
+struct LeafTerms
+{
+	int width, height;
+	std::vector<gtype> bgCosts, fgCosts;
+	const gtype *pairwise;
+	int edges, dx[8], dy[8];
+
+	LeafTerms(int w, int h, Branch *leaf, const gtype *pairwise_, const gtype *commonUnaries, Neighbourhood nb)
+		: width(w), height(h), bgCosts(w*h), fgCosts(w*h), pairwise(pairwise_), edges(NeighbourEdges(nb))
+	{
+		leaf->GetUnaries(w, h, &bgCosts[0], &fgCosts[0]);
+		if(commonUnaries)
+			for(int i = 0; i < w*h; i++)
+			{
+				if(commonUnaries[i] > 0)
+					fgCosts[i] += commonUnaries[i];
+				else
+					bgCosts[i] -= commonUnaries[i];
+			}
+		for(int k = 0; k < edges; k++)
+			GetNeighbourOffset(nb, k, &dx[k], &dy[k]);
+	}
+};
+
+//solves the pixels of the window [x0,x1)x[y0,y1) whose fixed label is negative (all of them for fixed = NULL) on one graph.
+//The edges between these pixels and the other pixels of the window become t-links, the edges leaving the window are dropped.
+//The labels of the solved pixels inside [cx0,cx1)x[cy0,cy1) are written to labels, which may be the same array as fixed
+static void SolveWindow(const LeafTerms& t, int x0, int y0, int x1, int y1, const signed char *fixed,
+						int cx0, int cy0, int cx1, int cy1, signed char *labels)
+{
+	int x, y, k, ww = x1-x0, nodeNum = 0;
+	std::vector<int> nodes(ww*(y1-y0), -1);
+	for(y = y0; y < y1; y++)
+		for(x = x0; x < x1; x++)
+			if(!fixed || fixed[y*t.width+x] < 0)
+				nodes[(y-y0)*ww+x-x0] = nodeNum++;
+	if(!nodeNum)
+		return;
+
+	GraphT graph(nodeNum, nodeNum*t.edges);
+	graph.add_node(nodeNum);
+	for(y = y0; y < y1; y++)
+		for(x = x0; x < x1; x++)
+		{
+			int i = y*t.width+x, n = nodes[(y-y0)*ww+x-x0];
+			if(n >= 0)
+				graph.add_tweights(n, t.fgCosts[i], t.bgCosts[i]);
+			for(k = 0; k < t.edges; k++)
+			{
+				int x2 = x+t.dx[k], y2 = y+t.dy[k];
+				if(x2 < x0 || x2 >= x1 || y2 < y0 || y2 >= y1)
+					continue;
+				int j = y2*t.width+x2, n2 = nodes[(y2-y0)*ww+x2-x0];
+				gtype w = t.pairwise[i*t.edges+k];
+				if(n >= 0 && n2 >= 0)
+					graph.add_edge(n, n2, w, w);
+				//the edge to a fixed pixel is cut if the free one takes the other label
+				else if(n >= 0)
+					graph.add_tweights(n, fixed[j] ? 0 : w, fixed[j] ? w : 0);
+				else if(n2 >= 0)
+					graph.add_tweights(n2, fixed[i] ? 0 : w, fixed[i] ? w : 0);
+			}
+		}
+	graph.maxflow();
+
+	for(y = std::max(y0, cy0); y < std::min(y1, cy1); y++)
+		for(x = std::max(x0, cx0); x < std::min(x1, cx1); x++)
+		{
+			int n = nodes[(y-y0)*ww+x-x0];
+			if(n >= 0)
+				labels[y*t.width+x] = (signed char)graph.what_segment(n);
+		}
+}
+
+static gtype LabelingEnergy(const LeafTerms& t, const signed char *labels)
+{
+	gtype energy = 0;
+	for(int y = 0; y < t.height; y++)
+		for(int x = 0; x < t.width; x++)
+		{
+			int i = y*t.width+x;
+			energy += labels[i] ? t.fgCosts[i] : t.bgCosts[i];
+			for(int k = 0; k < t.edges; k++)
+			{
+				int x2 = x+t.dx[k], y2 = y+t.dy[k];
+				if(x2 >= 0 && x2 < t.width && y2 >= 0 && y2 < t.height && labels[y2*t.width+x2] != labels[i])
+					energy += t.pairwise[i*t.edges+k];
+			}
+		}
+	return energy;
+}
+
+//pixels within seam of a border between two tiles (in one coordinate)
+static bool InSeam(int x, int size, int tileSize, int seam)
+{
+	int offset = x%tileSize;
+	return (offset < seam && x >= tileSize) || (offset >= tileSize-seam && x-offset+tileSize < size);
+}
+
+gtype TiledMincut(int imwidth, int imheight, Branch *leaf, gtype *pairwise, gtype *commonUnaries, PackedMask& segmentation,
+				  Neighbourhood neighbourhood, int tileSize, int overlap, int seam)
+{
+	int i, x, y;
+	LeafTerms terms(imwidth, imheight, leaf, pairwise, commonUnaries, neighbourhood);
+	std::vector<signed char> labels(imwidth*imheight);
+	tileSize = std::max(tileSize, 2*seam+1);
+
+	int tilesX = (imwidth+tileSize-1)/tileSize, tilesY = (imheight+tileSize-1)/tileSize;
+#pragma omp parallel for schedule(dynamic)
+	for(int tile = 0; tile < tilesX*tilesY; tile++)
+	{
+		int cx0 = (tile%tilesX)*tileSize, cy0 = (tile/tilesX)*tileSize;
+		int cx1 = std::min(cx0+tileSize, imwidth), cy1 = std::min(cy0+tileSize, imheight);
+		SolveWindow(terms, std::max(cx0-overlap, 0), std::max(cy0-overlap, 0), std::min(cx1+overlap, imwidth),
+			std::min(cy1+overlap, imheight), NULL, cx0, cy0, cx1, cy1, &labels[0]);
+	}
+
+	//the seams are freed and solved with the rest fixed
+	if(seam > 0 && tilesX*tilesY > 1)
+	{
+		for(y = 0; y < imheight; y++)
+			for(x = 0; x < imwidth; x++)
+				if(InSeam(x, imwidth, tileSize, seam) || InSeam(y, imheight, tileSize, seam))
+					labels[y*imwidth+x] = -1;
+		SolveWindow(terms, 0, 0, imwidth, imheight, &labels[0], 0, 0, imwidth, imheight, &labels[0]);
+	}
+
+	segmentation.Resize(imwidth, imheight);
+	for(i = 0; i < imwidth*imheight; i++)
+		if(labels[i])
+			segmentation.bits[i >> 5] |= 1u << (i & 31);
+	return LabelingEnergy(terms, &labels[0])+leaf->GetConstant();
+}
+
+gtype SegmentationEnergy(int imwidth, int imheight, Branch *leaf, gtype *pairwise, gtype *commonUnaries,
+						 const PackedMask& segmentation, Neighbourhood neighbourhood)
+{
+	LeafTerms terms(imwidth, imheight, leaf, pairwise, commonUnaries, neighbourhood);
+	std::vector<signed char> labels(imwidth*imheight);
+	for(int i = 0; i < imwidth*imheight; i++)
+		labels[i] = (signed char)segmentation.Get(i);
+	return LabelingEnergy(terms, &labels[0])+leaf->GetConstant();
+}
@@ -0,0 +1,33 @@
+/*
+This software contains the C++ implementation of the "branch-and-mincut" framework for image segmentation
+with various high-level priors as described in the paper:
+
+V. Lempitsky, A. Blake, C. Rother. Image Segmentation by Branch-and-Mincut.
+In proceedings of European Conference on Computer Vision (ECCV), October 2008.
+
+The software contains the core algorithm and an example of its application (globally-optimal
+segmentations under Chan-Vese functional).
+
+Implemented by Victor Lempitsky, 2008
+*/
+
+#ifndef TILED_MINCUT_H
+#define TILED_MINCUT_H
+
+#include "BranchAndMincut.h"
+
+//Final segmentation of a leaf (e.g. the optimum returned by BranchAndMincut, once its means are known) for huge images,
+//without a graph of the whole image. The image is split into tileSize x tileSize tiles; every tile is solved with a margin
+//of overlap pixels on its own small graph, the tiles in parallel (OpenMP), and keeps the labels of its own pixels.
+//The band of seam pixels on both sides of every border between two tiles is then solved once more as one graph, with
+//the pixels outside the band fixed to their labels. The pairwise and commonUnaries terms are as for BranchAndMincut.
+//The result is normally, but not provably, the minimum cut of the whole image (a larger overlap and seam make a
+//difference less likely). Returns the energy of segmentation, comparable with the bound of the leaf
+gtype TiledMincut(int imwidth, int imheight, Branch *leaf, gtype *pairwise, gtype *commonUnaries, PackedMask& segmentation,
+				  Neighbourhood neighbourhood = NEIGHBOURHOOD_8, int tileSize = 512, int overlap = 32, int seam = 16);
+
+//energy of a segmentation (1 is foreground) of the leaf, as its bound would be for the minimum cut
+gtype SegmentationEnergy(int imwidth, int imheight, Branch *leaf, gtype *pairwise, gtype *commonUnaries,
+						 const PackedMask& segmentation, Neighbourhood neighbourhood = NEIGHBOURHOOD_8);
+
+#endif
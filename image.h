@@ -37,6 +37,27 @@ template<class T> T* LoadImage8bpp(const char *filename, int& width, int& height
 	return image;
 }
 
+//loads a single-channel image keeping up to 16 bits per pixel (8-bit files are returned as is)
+template<class T> T* LoadImage16bpp(const char *filename, int& width, int& height)
+{
+	IplImage *im = cvLoadImage(filename, CV_LOAD_IMAGE_GRAYSCALE | CV_LOAD_IMAGE_ANYDEPTH);
+	if(!im) return NULL;
+	
+	width = im->width;
+	height = im->height;
+	T *image = new T[width*height];
+
+	for(int y = 0, i = 0; y < height; y++)
+		for(int x = 0; x < width; x++, i++)
+			if(im->depth == IPL_DEPTH_16U)
+				image[i] = (T)(((ushort*)(im->imageData + im->widthStep*y))[x]);
+			else
+				image[i] = (T)(((uchar*)(im->imageData + im->widthStep*y))[x]);
+
+	cvReleaseImage(&im);
+	return image;
+}
+
 template<class T> T* LoadImage24bpp(const char *filename, int& width, int& height)
 {
 	IplImage *im = cvLoadImage(filename, 1);
@@ -65,15 +86,15 @@ template<class T> void ShowImage24bpp(T *image, int width, int height, int pause
 	
 
 	for(int y = 0, i =0; y < height; y++)
+	{
+		uchar *row = (uchar*)(out->imageData + out->widthStep*y);
 		for(int x = 0; x < width; x++, i++)
 		{
-			CvScalar s;
-			s.val[0] = image[3*i];
-			s.val[1] = image[3*i+1];
-			s.val[2] = image[3*i+2];
-			//s.val[0] = s.val[1] = s.val[2] = double(image[i]-minVal)/double(maxVal-minVal+0.0001)*255;
-			cvSet2D(out, y, x, s);
+			row[3*x] = (uchar)image[3*i];
+			row[3*x+1] = (uchar)image[3*i+1];
+			row[3*x+2] = (uchar)image[3*i+2];
 		}
+	}
 
 
 	if(outFile)
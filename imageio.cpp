@@ -0,0 +1,1010 @@
+/*
+This software contains the C++ implementation of the "branch-and-mincut" framework for image segmentation
+with various high-level priors as described in the paper:
+
+V. Lempitsky, A. Blake, C. Rother. Image Segmentation by Branch-and-Mincut.
+In proceedings of European Conference on Computer Vision (ECCV), October 2008.
+
+The software contains the core algorithm and an example of its application (globally-optimal
+segmentations under Chan-Vese functional).
+
+Implemented by Victor Lempitsky, 2008
+*/
+
+#include "imageio.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+//////////////////////////////////////////////
+
+//memory mapping of whole files (read-only)
+
+static bool mapFile(const char *filename, MappedImage& im)
+{
+	memset(&im, 0, sizeof(im));
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(file == INVALID_HANDLE_VALUE) return false;
+	LARGE_INTEGER size;
+	if(!GetFileSizeEx(file, &size) || size.QuadPart == 0) { CloseHandle(file); return false; }
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if(!mapping) { CloseHandle(file); return false; }
+	void *base = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if(!base) { CloseHandle(mapping); CloseHandle(file); return false; }
+	im.fileHandle = file;
+	im.mapHandle = mapping;
+	im.size = (size_t)size.QuadPart;
+#else
+	int fd = open(filename, O_RDONLY);
+	if(fd < 0) return false;
+	struct stat st;
+	if(fstat(fd, &st) || st.st_size == 0) { close(fd); return false; }
+	void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); //the mapping stays valid after closing the descriptor
+	if(base == MAP_FAILED) return false;
+	im.size = st.st_size;
+#endif
+	im.base = base;
+	return true;
+}
+
+void UnmapImage(MappedImage& im)
+{
+	if(!im.base) return;
+#ifdef _WIN32
+	UnmapViewOfFile(im.base);
+	CloseHandle(im.mapHandle);
+	CloseHandle(im.fileHandle);
+#else
+	munmap(im.base, im.size);
+#endif
+	im.base = NULL;
+	im.pixels = NULL;
+}
+
+void *AllocAligned(size_t size)
+{
+#ifdef _WIN32
+	return _aligned_malloc(size, 64);
+#else
+	void *ptr;
+	if(posix_memalign(&ptr, 64, size)) return NULL;
+	return ptr;
+#endif
+}
+
+void FreeAligned(void *ptr)
+{
+#ifdef _WIN32
+	_aligned_free(ptr);
+#else
+	free(ptr);
+#endif
+}
+
+//////////////////////////////////////////////
+
+//colour to gray conversion, BT.601 weights in 14-bit fixed point (as in OpenCV)
+inline int rgb2gray(int r, int g, int b)
+{
+	return (r*4899 + g*9617 + b*1868 + 8192) >> 14;
+}
+
+//////////////////////////////////////////////
+
+//binary PGM/PPM header
+
+struct PnmHeader
+{
+	int width, height, maxval, channels;
+	size_t dataOffset;
+};
+
+static bool pnmSkipSpace(const unsigned char *data, size_t size, size_t& pos)
+{
+	while(pos < size)
+	{
+		if(data[pos] == '#')
+			while(pos < size && data[pos] != '\n') pos++;
+		else if(data[pos] == ' ' || data[pos] == '\t' || data[pos] == '\r' || data[pos] == '\n')
+			pos++;
+		else
+			return true;
+	}
+	return false;
+}
+
+static bool pnmReadInt(const unsigned char *data, size_t size, size_t& pos, int& val)
+{
+	if(!pnmSkipSpace(data, size, pos) || data[pos] < '0' || data[pos] > '9') return false;
+	for(val = 0; pos < size && data[pos] >= '0' && data[pos] <= '9'; pos++)
+		val = val*10 + (data[pos]-'0');
+	return true;
+}
+
+static bool parsePnmHeader(const unsigned char *data, size_t size, PnmHeader& hdr)
+{
+	if(size < 2 || data[0] != 'P' || (data[1] != '5' && data[1] != '6')) return false;
+	hdr.channels = data[1] == '5' ? 1 : 3;
+	size_t pos = 2;
+	if(!pnmReadInt(data, size, pos, hdr.width) || !pnmReadInt(data, size, pos, hdr.height) ||
+	   !pnmReadInt(data, size, pos, hdr.maxval))
+		return false;
+	if(hdr.width <= 0 || hdr.height <= 0 || hdr.maxval <= 0 || hdr.maxval > 65535) return false;
+	hdr.dataOffset = pos+1; //exactly one whitespace character after maxval
+	size_t bytes = (size_t)hdr.width*hdr.height*hdr.channels*(hdr.maxval > 255 ? 2 : 1);
+	return hdr.dataOffset + bytes <= size;
+}
+
+//the 8-bit formats get the samples rescaled from 0..maxval to 0..255, PIXEL_GRAY16 keeps them as they are
+static bool decodePnm(const unsigned char *data, const PnmHeader& hdr, void *pixels, int stride, PixelFormat format)
+{
+	const unsigned char *src = data + hdr.dataOffset;
+	int sampleBytes = hdr.maxval > 255 ? 2 : 1;
+	int rowBytes = hdr.width*hdr.channels*sampleBytes;
+	int maxval = hdr.maxval, half = maxval/2;
+
+	for(int y = 0; y < hdr.height; y++, src += rowBytes)
+	{
+		unsigned char *dst = (unsigned char *)pixels + (size_t)stride*y;
+		if(maxval == 255 && hdr.channels == 1 && format == PIXEL_GRAY8)
+		{
+			memcpy(dst, src, hdr.width);
+			continue;
+		}
+		for(int x = 0; x < hdr.width; x++)
+		{
+			int v[3];
+			for(int c = 0; c < hdr.channels; c++)
+			{
+				const unsigned char *s = src + (x*hdr.channels+c)*sampleBytes;
+				v[c] = sampleBytes == 2 ? (s[0] << 8) | s[1] : s[0];
+			}
+			if(hdr.channels == 1)
+				v[1] = v[2] = v[0];
+			switch(format)
+			{
+			case PIXEL_GRAY8:
+				dst[x] = (unsigned char)((rgb2gray(v[0], v[1], v[2])*255 + half)/maxval);
+				break;
+			case PIXEL_GRAY16:
+				((unsigned short *)dst)[x] = (unsigned short)(hdr.channels == 1 ? v[0] : rgb2gray(v[0], v[1], v[2]));
+				break;
+			case PIXEL_BGR24:
+				for(int c = 0; c < 3; c++)
+					dst[3*x+c] = (unsigned char)((v[2-c]*255 + half)/maxval);
+				break;
+			}
+		}
+	}
+	return true;
+}
+
+//////////////////////////////////////////////
+
+//inflate (RFC 1951) - just enough for the PNG decoder below
+
+#define HUFF_FAST_BITS 9
+
+struct Huffman
+{
+	unsigned short fast[1 << HUFF_FAST_BITS]; //(length << 9) | symbol, 0 if the code is longer than HUFF_FAST_BITS
+	unsigned short firstCode[16];
+	unsigned short firstSymbol[16];
+	int maxCode[17];
+	unsigned char size[288];
+	unsigned short value[288];
+};
+
+struct Inflater
+{
+	const unsigned char *in, *inEnd;
+	unsigned int bits; //bit buffer, LSB first
+	int numBits;
+	unsigned char *out, *outStart, *outEnd;
+
+	void Fill()
+	{
+		while(numBits <= 24)
+		{
+			unsigned int b = in < inEnd ? *in : 0; //reading past the end feeds zeros, caught by the length checks
+			in++;
+			bits |= b << numBits;
+			numBits += 8;
+		}
+	}
+	int Bits(int n)
+	{
+		if(numBits < n) Fill();
+		int v = bits & ((1 << n)-1);
+		bits >>= n;
+		numBits -= n;
+		return v;
+	}
+};
+
+inline int bitReverse(int v, int bits)
+{
+	v = ((v & 0xAAAA) >> 1) | ((v & 0x5555) << 1);
+	v = ((v & 0xCCCC) >> 2) | ((v & 0x3333) << 2);
+	v = ((v & 0xF0F0) >> 4) | ((v & 0x0F0F) << 4);
+	v = ((v & 0xFF00) >> 8) | ((v & 0x00FF) << 8);
+	return v >> (16-bits);
+}
+
+static bool buildHuffman(Huffman *h, const unsigned char *lengths, int num)
+{
+	int i, k = 0, code = 0;
+	int nextCode[16], sizes[17];
+
+	memset(sizes, 0, sizeof(sizes));
+	memset(h->fast, 0, sizeof(h->fast));
+	for(i = 0; i < num; i++) sizes[lengths[i]]++;
+	sizes[0] = 0;
+	for(i = 1; i < 16; i++)
+		if(sizes[i] > (1 << i)) return false;
+	for(i = 1; i < 16; i++)
+	{
+		nextCode[i] = code;
+		h->firstCode[i] = (unsigned short)code;
+		h->firstSymbol[i] = (unsigned short)k;
+		code += sizes[i];
+		if(sizes[i] && code-1 >= (1 << i)) return false; //over-subscribed
+		h->maxCode[i] = code << (16-i);
+		code <<= 1;
+		k += sizes[i];
+	}
+	h->maxCode[16] = 0x10000;
+	for(i = 0; i < num; i++)
+	{
+		int s = lengths[i];
+		if(!s) continue;
+		int c = nextCode[s] - h->firstCode[s] + h->firstSymbol[s];
+		h->size[c] = (unsigned char)s;
+		h->value[c] = (unsigned short)i;
+		if(s <= HUFF_FAST_BITS)
+			for(int j = bitReverse(nextCode[s], s); j < (1 << HUFF_FAST_BITS); j += 1 << s)
+				h->fast[j] = (unsigned short)((s << 9) | i);
+		nextCode[s]++;
+	}
+	return true;
+}
+
+static int decodeSymbol(Inflater& z, const Huffman *h)
+{
+	if(z.numBits < 16) z.Fill();
+	int b = h->fast[z.bits & ((1 << HUFF_FAST_BITS)-1)];
+	if(b)
+	{
+		int s = b >> 9;
+		z.bits >>= s;
+		z.numBits -= s;
+		return b & 511;
+	}
+	int k = bitReverse(z.bits & 0xFFFF, 16), s;
+	for(s = HUFF_FAST_BITS+1; k >= h->maxCode[s]; s++);
+	if(s >= 16) return -1;
+	b = (k >> (16-s)) - h->firstCode[s] + h->firstSymbol[s];
+	if(b >= 288 || h->size[b] != s) return -1;
+	z.bits >>= s;
+	z.numBits -= s;
+	return h->value[b];
+}
+
+static const int lengthBase[29] = {3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258};
+static const int lengthExtra[29] = {0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0};
+static const int distBase[30] = {1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577};
+static const int distExtra[30] = {0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13};
+
+static bool inflateBlock(Inflater& z, const Huffman *lit, const Huffman *dist)
+{
+	while(1)
+	{
+		int sym = decodeSymbol(z, lit);
+		if(sym < 0) return false;
+		if(sym < 256)
+		{
+			if(z.out >= z.outEnd) return false;
+			*z.out++ = (unsigned char)sym;
+			continue;
+		}
+		if(sym == 256) return true;
+		sym -= 257;
+		if(sym >= 29) return false;
+		int len = lengthBase[sym] + (lengthExtra[sym] ? z.Bits(lengthExtra[sym]) : 0);
+		sym = decodeSymbol(z, dist);
+		if(sym < 0 || sym >= 30) return false;
+		int d = distBase[sym] + (distExtra[sym] ? z.Bits(distExtra[sym]) : 0);
+		if(z.out - z.outStart < d || z.outEnd - z.out < len) return false;
+		unsigned char *src = z.out - d;
+		if(d == 1)
+		{
+			memset(z.out, *src, len);
+			z.out += len;
+		}
+		else
+			while(len--) *z.out++ = *src++;
+	}
+}
+
+static bool inflateDynamicTables(Inflater& z, Huffman *lit, Huffman *dist)
+{
+	static const unsigned char order[19] = {16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15};
+	unsigned char lengths[286+32], codeLengths[19];
+	Huffman lengthCode;
+
+	int hlit = z.Bits(5) + 257;
+	int hdist = z.Bits(5) + 1;
+	int hclen = z.Bits(4) + 4;
+	if(hlit > 286 || hdist > 32) return false;
+
+	memset(codeLengths, 0, sizeof(codeLengths));
+	for(int i = 0; i < hclen; i++)
+		codeLengths[order[i]] = (unsigned char)z.Bits(3);
+	if(!buildHuffman(&lengthCode, codeLengths, 19)) return false;
+
+	int n = 0;
+	while(n < hlit+hdist)
+	{
+		int c = decodeSymbol(z, &lengthCode);
+		if(c < 0 || c >= 19) return false;
+		if(c < 16)
+		{
+			lengths[n++] = (unsigned char)c;
+			continue;
+		}
+		int fill = 0, rep;
+		if(c == 16)
+		{
+			if(!n) return false;
+			fill = lengths[n-1];
+			rep = 3 + z.Bits(2);
+		}
+		else if(c == 17)
+			rep = 3 + z.Bits(3);
+		else
+			rep = 11 + z.Bits(7);
+		if(n + rep > hlit+hdist) return false;
+		memset(lengths+n, fill, rep);
+		n += rep;
+	}
+	return buildHuffman(lit, lengths, hlit) && buildHuffman(dist, lengths+hlit, hdist);
+}
+
+//decompresses a zlib stream into out, which should be exactly as large as the uncompressed data
+static bool zlibDecompress(const unsigned char *in, size_t inSize, unsigned char *out, size_t outSize)
+{
+	if(inSize < 2 || (in[0] & 15) != 8 || ((in[0] << 8) | in[1]) % 31 || (in[1] & 32))
+		return false; //not deflate, bad header checksum or a preset dictionary
+
+	Inflater z;
+	z.in = in+2;
+	z.inEnd = in+inSize;
+	z.bits = 0;
+	z.numBits = 0;
+	z.out = z.outStart = out;
+	z.outEnd = out+outSize;
+
+	Huffman *lit = new Huffman, *dist = new Huffman;
+	bool ok = true, last = false;
+	while(ok && !last)
+	{
+		last = z.Bits(1) != 0;
+		int type = z.Bits(2);
+		if(type == 0)
+		{
+			//stored block: drop the bits up to the byte boundary, then flush the bit buffer
+			z.Bits(z.numBits & 7);
+			unsigned char header[4];
+			for(int i = 0; i < 4; i++) header[i] = (unsigned char)z.Bits(8);
+			int len = header[0] | (header[1] << 8);
+			int nlen = header[2] | (header[3] << 8);
+			if(len != (~nlen & 0xFFFF) || z.outEnd - z.out < len) { ok = false; break; }
+			while(len && z.numBits) { *z.out++ = (unsigned char)z.Bits(8); len--; }
+			if(z.inEnd - z.in < len) { ok = false; break; }
+			memcpy(z.out, z.in, len);
+			z.out += len;
+			z.in += len;
+		}
+		else if(type == 1)
+		{
+			unsigned char lengths[288+32];
+			memset(lengths, 8, 144);
+			memset(lengths+144, 9, 112);
+			memset(lengths+256, 7, 24);
+			memset(lengths+280, 8, 8);
+			memset(lengths+288, 5, 32);
+			ok = buildHuffman(lit, lengths, 288) && buildHuffman(dist, lengths+288, 32) && inflateBlock(z, lit, dist);
+		}
+		else if(type == 2)
+			ok = inflateDynamicTables(z, lit, dist) && inflateBlock(z, lit, dist);
+		else
+			ok = false;
+		if(z.in > z.inEnd + 4) ok = false; //ran past the end of the input
+	}
+	delete lit;
+	delete dist;
+	return ok && z.out == z.outEnd;
+}
+
+//////////////////////////////////////////////
+
+//PNG
+
+struct PngInfo
+{
+	int width, height, bitDepth, colorType, interlace;
+	int channels; //samples per pixel in the file
+	unsigned char palette[256][3];
+	int paletteSize;
+	const unsigned char *data; //file contents
+	size_t size;
+};
+
+inline unsigned int readBE32(const unsigned char *p)
+{
+	return ((unsigned int)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static bool isPng(const unsigned char *data, size_t size)
+{
+	static const unsigned char signature[8] = {137,80,78,71,13,10,26,10};
+	return size >= 8+25 && !memcmp(data, signature, 8) && !memcmp(data+12, "IHDR", 4);
+}
+
+static bool parsePngHeader(const unsigned char *data, size_t size, PngInfo& png)
+{
+	if(!isPng(data, size)) return false;
+	const unsigned char *ihdr = data+16;
+	png.width = (int)readBE32(ihdr);
+	png.height = (int)readBE32(ihdr+4);
+	png.bitDepth = ihdr[8];
+	png.colorType = ihdr[9];
+	png.interlace = ihdr[12];
+	png.data = data;
+	png.size = size;
+	png.paletteSize = 0;
+	memset(png.palette, 0, sizeof(png.palette));
+	switch(png.colorType)
+	{
+	case 0: png.channels = 1; break;
+	case 2: png.channels = 3; break;
+	case 3: png.channels = 1; break;
+	case 4: png.channels = 2; break;
+	case 6: png.channels = 4; break;
+	default: return false;
+	}
+	return png.width > 0 && png.height > 0 && ihdr[10] == 0 && ihdr[11] == 0 &&
+		(png.bitDepth == 8 || png.bitDepth == 16 || (png.bitDepth < 8 && png.channels == 1));
+}
+
+inline int paeth(int a, int b, int c)
+{
+	int p = a+b-c, pa = abs(p-a), pb = abs(p-b), pc = abs(p-c);
+	if(pa <= pb && pa <= pc) return a;
+	return pb <= pc ? b : c;
+}
+
+//undoes the PNG scanline filter in place, prev is NULL for the first row
+static bool unfilterRow(unsigned char *row, const unsigned char *prev, int filter, int rowBytes, int bpp)
+{
+	int i;
+	switch(filter)
+	{
+	case 0:
+		break;
+	case 1:
+		for(i = bpp; i < rowBytes; i++) row[i] = (unsigned char)(row[i] + row[i-bpp]);
+		break;
+	case 2:
+		if(prev)
+			for(i = 0; i < rowBytes; i++) row[i] = (unsigned char)(row[i] + prev[i]);
+		break;
+	case 3:
+		for(i = 0; i < rowBytes; i++)
+			row[i] = (unsigned char)(row[i] + (((i >= bpp ? row[i-bpp] : 0) + (prev ? prev[i] : 0)) >> 1));
+		break;
+	case 4:
+		for(i = 0; i < rowBytes; i++)
+			row[i] = (unsigned char)(row[i] + paeth(i >= bpp ? row[i-bpp] : 0, prev ? prev[i] : 0,
+													 i >= bpp && prev ? prev[i-bpp] : 0));
+		break;
+	default:
+		return false;
+	}
+	return true;
+}
+
+//converts one unfiltered PNG row into the requested pixel format
+static void convertPngRow(const PngInfo& png, const unsigned char *src, unsigned char *dst, PixelFormat format)
+{
+	int x, w = png.width;
+
+	//fast paths for the common 8-bit layouts
+	if(png.bitDepth == 8 && png.colorType != 3)
+	{
+		int n = png.channels;
+		if(format == PIXEL_GRAY8)
+		{
+			if(n == 1) memcpy(dst, src, w);
+			else if(n == 2) for(x = 0; x < w; x++) dst[x] = src[2*x];
+			else for(x = 0; x < w; x++, src += n) dst[x] = (unsigned char)rgb2gray(src[0], src[1], src[2]);
+			return;
+		}
+		if(format == PIXEL_BGR24 && n >= 3)
+		{
+			for(x = 0; x < w; x++, src += n, dst += 3)
+			{
+				dst[0] = src[2];
+				dst[1] = src[1];
+				dst[2] = src[0];
+			}
+			return;
+		}
+	}
+
+	//generic path: fetch each pixel as 16-bit RGB
+	for(x = 0; x < w; x++)
+	{
+		int r, g, b;
+		if(png.bitDepth == 16)
+		{
+			const unsigned char *s = src + 2*png.channels*x;
+			r = (s[0] << 8) | s[1];
+			if(png.channels >= 3)
+			{
+				g = (s[2] << 8) | s[3];
+				b = (s[4] << 8) | s[5];
+			}
+			else g = b = r;
+		}
+		else if(png.bitDepth == 8)
+		{
+			const unsigned char *s = src + png.channels*x;
+			if(png.colorType == 3)
+			{
+				r = png.palette[s[0]][0]*257;
+				g = png.palette[s[0]][1]*257;
+				b = png.palette[s[0]][2]*257;
+			}
+			else if(png.channels >= 3)
+			{
+				r = s[0]*257;
+				g = s[1]*257;
+				b = s[2]*257;
+			}
+			else g = b = r = s[0]*257;
+		}
+		else
+		{
+			//1, 2 or 4 bits per pixel, most significant bits first
+			int perByte = 8/png.bitDepth, mask = (1 << png.bitDepth)-1;
+			int v = (src[x/perByte] >> ((perByte-1-x%perByte)*png.bitDepth)) & mask;
+			if(png.colorType == 3)
+			{
+				r = png.palette[v][0]*257;
+				g = png.palette[v][1]*257;
+				b = png.palette[v][2]*257;
+			}
+			else g = b = r = v*65535/mask;
+		}
+
+		bool gray = png.channels < 3 && png.colorType != 3;
+		switch(format)
+		{
+		case PIXEL_GRAY8:
+			if(gray) dst[x] = (unsigned char)(r >> 8);
+			else if(png.bitDepth == 16) dst[x] = (unsigned char)(rgb2gray(r, g, b) >> 8);
+			else dst[x] = (unsigned char)rgb2gray(r >> 8, g >> 8, b >> 8);
+			break;
+		case PIXEL_GRAY16:
+			//8-bit samples are kept in the 0..255 range, as with LoadImage16bpp
+			((unsigned short *)dst)[x] = (unsigned short)((gray ? r : rgb2gray(r, g, b)) / (png.bitDepth == 16 ? 1 : 257));
+			break;
+		case PIXEL_BGR24:
+			dst[3*x] = (unsigned char)(b >> 8);
+			dst[3*x+1] = (unsigned char)(g >> 8);
+			dst[3*x+2] = (unsigned char)(r >> 8);
+			break;
+		}
+	}
+}
+
+static bool decodePng(PngInfo& png, void *pixels, int stride, PixelFormat format)
+{
+	if(png.interlace) return false; //Adam7 is not supported
+
+	//gathering the IDAT chunks into one zlib stream
+	size_t pos = 8, idatSize = 0;
+	unsigned char *idat = NULL;
+	bool ok = true;
+	while(ok && pos + 12 <= png.size)
+	{
+		size_t len = readBE32(png.data+pos);
+		const unsigned char *type = png.data+pos+4, *chunk = png.data+pos+8;
+		if(pos + 12 + len > png.size) { ok = false; break; }
+		if(!memcmp(type, "PLTE", 4))
+		{
+			png.paletteSize = (int)(len/3 > 256 ? 256 : len/3);
+			memcpy(png.palette, chunk, 3*png.paletteSize);
+		}
+		else if(!memcmp(type, "IDAT", 4))
+		{
+			unsigned char *grown = (unsigned char *)realloc(idat, idatSize+len);
+			if(!grown) { ok = false; break; }
+			idat = grown;
+			memcpy(idat+idatSize, chunk, len);
+			idatSize += len;
+		}
+		else if(!memcmp(type, "IEND", 4))
+			break;
+		pos += 12 + len;
+	}
+	if(png.colorType == 3 && !png.paletteSize) ok = false;
+
+	int bpp = (png.channels*png.bitDepth+7)/8; //bytes per complete pixel, used by the filters
+	int rowBytes = (png.width*png.channels*png.bitDepth+7)/8;
+	size_t rawSize = (size_t)(rowBytes+1)*png.height;
+	unsigned char *raw = ok ? (unsigned char *)malloc(rawSize) : NULL;
+	ok = raw && zlibDecompress(idat, idatSize, raw, rawSize);
+	free(idat);
+
+	for(int y = 0; ok && y < png.height; y++)
+	{
+		unsigned char *row = raw + (size_t)(rowBytes+1)*y;
+		ok = unfilterRow(row+1, y ? row+1-(rowBytes+1) : NULL, row[0], rowBytes, bpp);
+		if(ok && png.colorType == 3)
+		{
+			//indices outside the palette are clamped to the last entry
+			for(int x = 0; png.bitDepth == 8 && x < png.width; x++)
+				if(row[1+x] >= png.paletteSize) row[1+x] = (unsigned char)(png.paletteSize-1);
+		}
+		if(ok)
+			convertPngRow(png, row+1, (unsigned char *)pixels + (size_t)stride*y, format);
+	}
+	free(raw);
+	return ok;
+}
+
+//////////////////////////////////////////////
+
+bool ReadImageSize(const char *filename, int& width, int& height, int *bitDepth, int *channels)
+{
+	//only the header is needed, the mapping is not touched beyond it
+	MappedImage file;
+	if(!mapFile(filename, file)) return false;
+	const unsigned char *data = (const unsigned char *)file.base;
+
+	PnmHeader pnm;
+	PngInfo png;
+	bool ok = true;
+	if(parsePnmHeader(data, file.size, pnm))
+	{
+		width = pnm.width;
+		height = pnm.height;
+		if(bitDepth) *bitDepth = pnm.maxval > 255 ? 16 : 8;
+		if(channels) *channels = pnm.channels;
+	}
+	else if(parsePngHeader(data, file.size, png))
+	{
+		width = png.width;
+		height = png.height;
+		if(bitDepth) *bitDepth = png.bitDepth;
+		if(channels) *channels = png.colorType == 3 ? 3 : png.channels;
+	}
+	else
+		ok = false;
+	UnmapImage(file);
+	return ok;
+}
+
+bool DecodeImage(const char *filename, void *pixels, int stride, PixelFormat format)
+{
+	MappedImage file;
+	if(!mapFile(filename, file)) return false;
+	const unsigned char *data = (const unsigned char *)file.base;
+
+	PnmHeader pnm;
+	PngInfo png;
+	bool ok = false;
+	if(parsePnmHeader(data, file.size, pnm))
+		ok = decodePnm(data, pnm, pixels, stride, format);
+	else if(parsePngHeader(data, file.size, png))
+		ok = decodePng(png, pixels, stride, format);
+	UnmapImage(file);
+	return ok;
+}
+
+bool MapImage(const char *filename, MappedImage& im)
+{
+	if(!mapFile(filename, im)) return false;
+	PnmHeader pnm;
+	if(!parsePnmHeader((const unsigned char *)im.base, im.size, pnm) || pnm.channels != 1 || pnm.maxval != 255)
+	{
+		UnmapImage(im);
+		return false;
+	}
+	im.width = pnm.width;
+	im.height = pnm.height;
+	im.bitDepth = 8;
+	im.pixels = (const unsigned char *)im.base + pnm.dataOffset;
+	return true;
+}
+
+bool MapRawImage(const char *filename, int width, int height, int bitDepth, MappedImage& im, size_t offset)
+{
+	if(width <= 0 || height <= 0 || (bitDepth != 8 && bitDepth != 16)) return false;
+	if(!mapFile(filename, im)) return false;
+	if(offset + (size_t)width*height*(bitDepth/8) > im.size)
+	{
+		UnmapImage(im);
+		return false;
+	}
+	im.width = width;
+	im.height = height;
+	im.bitDepth = bitDepth;
+	im.pixels = (const unsigned char *)im.base + offset;
+	return true;
+}
+
+//////////////////////////////////////////////
+
+//deflate with the fixed Huffman code and a single-candidate hash match finder.
+//Fast and good enough for masks and overlays, which are dominated by long runs.
+
+struct BitWriter
+{
+	unsigned char *out;
+	size_t pos;
+	unsigned int bits;
+	int numBits;
+
+	void Put(unsigned int v, int n) //n bits of v, LSB first
+	{
+		bits |= v << numBits;
+		numBits += n;
+		while(numBits >= 8)
+		{
+			out[pos++] = (unsigned char)bits;
+			bits >>= 8;
+			numBits -= 8;
+		}
+	}
+	void PutHuffman(int code, int n) //Huffman codes are stored MSB first
+	{
+		Put(bitReverse(code, n), n);
+	}
+	void Flush()
+	{
+		if(numBits) Put(0, 8-numBits);
+	}
+};
+
+static void putLiteral(BitWriter& bw, int v)
+{
+	if(v < 144) bw.PutHuffman(0x30+v, 8);
+	else if(v < 256) bw.PutHuffman(0x190+v-144, 9);
+	else if(v < 280) bw.PutHuffman(v-256, 7);
+	else bw.PutHuffman(0xC0+v-280, 8);
+}
+
+#define DEFLATE_HASH_BITS 15
+
+inline int hash3(const unsigned char *p)
+{
+	return ((p[0] << 10) ^ (p[1] << 5) ^ p[2]) & ((1 << DEFLATE_HASH_BITS)-1);
+}
+
+//returns the size of the raw deflate stream written to out (at least n + n/8 + 16 bytes)
+static size_t deflateFixed(const unsigned char *in, size_t n, unsigned char *out)
+{
+	BitWriter bw;
+	bw.out = out;
+	bw.pos = 0;
+	bw.bits = 0;
+	bw.numBits = 0;
+	bw.Put(1, 1); //last block
+	bw.Put(1, 2); //fixed Huffman codes
+
+	int *head = new int[1 << DEFLATE_HASH_BITS];
+	for(int k = 0; k < (1 << DEFLATE_HASH_BITS); k++) head[k] = -1;
+
+	size_t i = 0;
+	while(i < n)
+	{
+		int len = 0, dist = 0;
+		if(i+3 <= n)
+		{
+			int h = hash3(in+i);
+			int cand = head[h];
+			head[h] = (int)i;
+			if(cand >= 0 && i-cand <= 32768)
+			{
+				size_t maxLen = n-i < 258 ? n-i : 258;
+				while(len < (int)maxLen && in[cand+len] == in[i+len]) len++;
+				dist = (int)(i-cand);
+			}
+		}
+		if(len < 3)
+		{
+			putLiteral(bw, in[i++]);
+			continue;
+		}
+
+		int c = 28, d = 29;
+		while(lengthBase[c] > len) c--;
+		putLiteral(bw, 257+c);
+		if(lengthExtra[c]) bw.Put(len-lengthBase[c], lengthExtra[c]);
+		while(distBase[d] > dist) d--;
+		bw.PutHuffman(d, 5);
+		if(distExtra[d]) bw.Put(dist-distBase[d], distExtra[d]);
+
+		for(size_t k = i+1; k < i+len && k+3 <= n; k++)
+			head[hash3(in+k)] = (int)k;
+		i += len;
+	}
+	putLiteral(bw, 256);
+	bw.Flush();
+	delete[] head;
+	return bw.pos;
+}
+
+static unsigned int crc32(unsigned int crc, const unsigned char *p, size_t n)
+{
+	unsigned int table[256];
+	for(unsigned int k = 0; k < 256; k++)
+	{
+		unsigned int c = k;
+		for(int j = 0; j < 8; j++) c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+		table[k] = c;
+	}
+	crc = ~crc;
+	while(n--) crc = table[(crc ^ *p++) & 255] ^ (crc >> 8);
+	return ~crc;
+}
+
+inline void writeBE32(unsigned char *p, unsigned int v)
+{
+	p[0] = (unsigned char)(v >> 24);
+	p[1] = (unsigned char)(v >> 16);
+	p[2] = (unsigned char)(v >> 8);
+	p[3] = (unsigned char)v;
+}
+
+static bool writePngChunk(FILE *f, const char *type, const unsigned char *data, size_t len)
+{
+	unsigned char header[8], footer[4];
+	writeBE32(header, (unsigned int)len);
+	memcpy(header+4, type, 4);
+	writeBE32(footer, crc32(crc32(0, header+4, 4), data, len));
+	return fwrite(header, 1, 8, f) == 8 && fwrite(data, 1, len, f) == len && fwrite(footer, 1, 4, f) == 4;
+}
+
+//copies one row into the file sample layout (RGB order, big-endian 16-bit samples)
+static void packRow(const unsigned char *src, unsigned char *dst, int width, PixelFormat format)
+{
+	int x;
+	switch(format)
+	{
+	case PIXEL_GRAY8:
+		memcpy(dst, src, width);
+		break;
+	case PIXEL_GRAY16:
+		for(x = 0; x < width; x++)
+		{
+			unsigned short v = ((const unsigned short *)src)[x];
+			dst[2*x] = (unsigned char)(v >> 8);
+			dst[2*x+1] = (unsigned char)v;
+		}
+		break;
+	case PIXEL_BGR24:
+		for(x = 0; x < width; x++, src += 3, dst += 3)
+		{
+			dst[0] = src[2];
+			dst[1] = src[1];
+			dst[2] = src[0];
+		}
+		break;
+	}
+}
+
+static bool writePng(FILE *f, const unsigned char *pixels, int width, int height, int stride, PixelFormat format)
+{
+	int channels = format == PIXEL_BGR24 ? 3 : 1, bitDepth = format == PIXEL_GRAY16 ? 16 : 8;
+	int rowBytes = width*channels*bitDepth/8;
+	size_t rawSize = (size_t)(rowBytes+1)*height;
+
+	//filtered scanlines: "up" for photographic content, none for 8-bit gray (masks)
+	unsigned char *raw = (unsigned char *)malloc(rawSize);
+	unsigned char *z = (unsigned char *)malloc(rawSize + rawSize/8 + 64);
+	if(!raw || !z) { free(raw); free(z); return false; }
+	int filter = format == PIXEL_GRAY8 ? 0 : 2;
+	for(int y = 0; y < height; y++)
+	{
+		unsigned char *row = raw + (size_t)(rowBytes+1)*y;
+		row[0] = (unsigned char)filter;
+		packRow(pixels + (size_t)stride*y, row+1, width, format);
+	}
+	for(int y = height-1; filter && y > 0; y--)
+	{
+		unsigned char *row = raw + (size_t)(rowBytes+1)*y + 1;
+		for(int i = 0; i < rowBytes; i++) row[i] = (unsigned char)(row[i] - row[i-rowBytes-1]);
+	}
+
+	//zlib stream: header, deflate data, Adler-32
+	z[0] = 0x78;
+	z[1] = 0x01;
+	size_t zSize = 2 + deflateFixed(raw, rawSize, z+2);
+	unsigned int s1 = 1, s2 = 0;
+	for(size_t i = 0; i < rawSize; )
+	{
+		size_t end = i + 5552 < rawSize ? i + 5552 : rawSize; //largest block without overflow
+		for(; i < end; i++)
+		{
+			s1 += raw[i];
+			s2 += s1;
+		}
+		s1 %= 65521;
+		s2 %= 65521;
+	}
+	writeBE32(z+zSize, (s2 << 16) | s1);
+	zSize += 4;
+
+	static const unsigned char signature[8] = {137,80,78,71,13,10,26,10};
+	unsigned char ihdr[13];
+	writeBE32(ihdr, width);
+	writeBE32(ihdr+4, height);
+	ihdr[8] = (unsigned char)bitDepth;
+	ihdr[9] = (unsigned char)(channels == 3 ? 2 : 0);
+	ihdr[10] = ihdr[11] = ihdr[12] = 0;
+	bool ok = fwrite(signature, 1, 8, f) == 8 && writePngChunk(f, "IHDR", ihdr, 13) &&
+		writePngChunk(f, "IDAT", z, zSize) && writePngChunk(f, "IEND", NULL, 0);
+	free(raw);
+	free(z);
+	return ok;
+}
+
+static bool writePnm(FILE *f, const unsigned char *pixels, int width, int height, int stride, PixelFormat format)
+{
+	int channels = format == PIXEL_BGR24 ? 3 : 1, sampleBytes = format == PIXEL_GRAY16 ? 2 : 1;
+	fprintf(f, "P%c\n%d %d\n%d\n", channels == 3 ? '6' : '5', width, height, sampleBytes == 2 ? 65535 : 255);
+	size_t rowBytes = (size_t)width*channels*sampleBytes;
+	unsigned char *row = (unsigned char *)malloc(rowBytes);
+	if(!row) return false;
+	bool ok = true;
+	for(int y = 0; ok && y < height; y++)
+	{
+		const unsigned char *src = pixels + (size_t)stride*y;
+		if(format == PIXEL_GRAY8)
+			ok = fwrite(src, 1, rowBytes, f) == rowBytes;
+		else
+		{
+			packRow(src, row, width, format);
+			ok = fwrite(row, 1, rowBytes, f) == rowBytes;
+		}
+	}
+	free(row);
+	return ok;
+}
+
+bool WriteImage(const char *filename, const void *pixels, int width, int height, int stride, PixelFormat format)
+{
+	FILE *f = fopen(filename, "wb");
+	if(!f) return false;
+	size_t len = strlen(filename);
+	bool png = len >= 4 && (!strcmp(filename+len-4, ".png") || !strcmp(filename+len-4, ".PNG"));
+	bool ok = png ? writePng(f, (const unsigned char *)pixels, width, height, stride, format)
+				  : writePnm(f, (const unsigned char *)pixels, width, height, stride, format);
+	return fclose(f) == 0 && ok;
+}
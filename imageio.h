@@ -0,0 +1,90 @@
+/*
+This software contains the C++ implementation of the "branch-and-mincut" framework for image segmentation
+with various high-level priors as described in the paper:
+
+V. Lempitsky, A. Blake, C. Rother. Image Segmentation by Branch-and-Mincut.
+In proceedings of European Conference on Computer Vision (ECCV), October 2008.
+
+The software contains the core algorithm and an example of its application (globally-optimal
+segmentations under Chan-Vese functional).
+
+Implemented by Victor Lempitsky, 2008
+*/
+
+#ifndef IMAGE_IO_H
+#define IMAGE_IO_H
+
+#include <stddef.h>
+
+//Image input without OpenCV. Supported formats:
+// - PNG (non-interlaced, any colour type, 1 to 16 bits per sample)
+// - binary PGM/PPM (P5/P6), 8 or 16 bits per sample (rescaled by maxval to the 8-bit formats)
+// - headerless raw files (memory mapping only)
+//Pixels are decoded straight into caller-owned buffers. 8-bit PGM and raw files can be
+//memory mapped, in which case the pixels are used in place without any copy.
+
+enum PixelFormat
+{
+	PIXEL_GRAY8,  //one unsigned char per pixel
+	PIXEL_GRAY16, //one unsigned short per pixel, 8-bit files are stored as is (not rescaled)
+	PIXEL_BGR24   //three unsigned chars per pixel in the OpenCV channel order
+};
+
+//reads the image dimensions (and optionally the bit depth and number of channels) from the file header.
+//Returns false if the file is missing or the format is not supported.
+bool ReadImageSize(const char *filename, int& width, int& height, int *bitDepth = NULL, int *channels = NULL);
+
+//decodes the image into a caller-owned buffer with the given row stride (in bytes).
+//Colour images are converted to gray with the ITU-R BT.601 weights (same as cvLoadImage(filename, 0)),
+//alpha is ignored. Returns false on failure; the buffer contents are then undefined.
+bool DecodeImage(const char *filename, void *pixels, int stride, PixelFormat format);
+
+//cache-line aligned allocation, the memory should be released with FreeAligned
+void *AllocAligned(size_t size);
+void FreeAligned(void *ptr);
+
+//loads a grayscale image into an aligned buffer (T = unsigned char or unsigned short).
+//The returned array should be released with FreeAligned.
+template<class T> T* LoadImageAligned(const char *filename, int& width, int& height)
+{
+	if(!ReadImageSize(filename, width, height))
+		return NULL;
+	T *image = (T *)AllocAligned(sizeof(T)*width*height);
+	if(!image) return NULL;
+	if(!DecodeImage(filename, image, sizeof(T)*width, sizeof(T) == 1 ? PIXEL_GRAY8 : PIXEL_GRAY16))
+	{
+		FreeAligned(image);
+		return NULL;
+	}
+	return image;
+}
+
+//read-only view of an image file mapped into memory
+struct MappedImage
+{
+	const unsigned char *pixels; //first pixel, rows are width*bitDepth/8 bytes apart
+	int width;
+	int height;
+	int bitDepth;
+
+	void *base; //start of the mapping
+	size_t size;
+#ifdef _WIN32
+	void *fileHandle;
+	void *mapHandle;
+#endif
+};
+
+//maps an 8-bit binary PGM file with maxval 255. Returns false for any other format (use DecodeImage then).
+bool MapImage(const char *filename, MappedImage& im);
+
+//maps a headerless file with row-major grayscale pixels in the native byte order, starting at offset
+bool MapRawImage(const char *filename, int width, int height, int bitDepth, MappedImage& im, size_t offset = 0);
+
+void UnmapImage(MappedImage& im);
+
+//Image output without OpenCV. The file format is chosen by the extension: ".png" writes a PNG,
+//anything else a binary PGM (gray formats) or PPM (PIXEL_BGR24). Returns false if the file cannot be written.
+bool WriteImage(const char *filename, const void *pixels, int width, int height, int stride, PixelFormat format);
+
+#endif